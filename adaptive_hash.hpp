@@ -0,0 +1,123 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+struct AdaptiveHashOptions {
+  // index where the records of keys which are searched often are, a search
+  // of an indexed key whose leaf is in the pool pins the leaf and reads its
+  // slot without the descent. an entry is checked against the version of
+  // the frame, a split, a change or an eviction of the leaf makes it stale
+  bool enabled = false;
+  // searches of a key before it is indexed. keys share the counters, some
+  // are indexed a little early
+  uint8_t hot_threshold = 4;
+  size_t max_entries = 1 << 16;
+};
+
+struct AdaptiveHashStats {
+  size_t hits = 0;    // searches answered by the index
+  size_t misses = 0;  // searches of keys it doesn't have, or stale entries
+  size_t entries = 0;
+};
+
+// A hash map from hot keys to where their records are. Lookups are counted in
+// a table of small counters, a key is added once its counter reaches the
+// threshold. The map is split in shards with their own latch, and an entry is
+// found by the hash of its key, so a lookup allocates nothing.
+template <typename Value> class AdaptiveHashIndex {
+public:
+  explicit AdaptiveHashIndex(AdaptiveHashOptions options) : options_(options) {
+    options_.max_entries = std::max(options_.max_entries, kShards);
+    counters_ = std::make_unique<std::atomic<uint8_t>[]>(kCounters *
+                                                         options_.max_entries);
+  }
+
+  static uint64_t hash(std::string_view key) {
+    return std::hash<std::string_view>{}(key);
+  }
+
+  // @brief the value of key, false if it isn't indexed
+  bool find(std::string_view key, uint64_t h, Value &value) const {
+    const Shard &shard = shards_[h % kShards];
+    std::shared_lock<std::shared_mutex> lock{shard.latch};
+    auto it = shard.map.find(h);
+    if (it == shard.map.end() || it->second.first != key) {
+      return false;
+    }
+    value = it->second.second;
+    return true;
+  }
+
+  // @brief count a search of key the index didn't answer, true when the key
+  // became hot
+  bool touch(uint64_t h) {
+    auto &counter = counters_[(h >> 16) % (kCounters * options_.max_entries)];
+    if (counter.fetch_add(1, std::memory_order_relaxed) + 1 <
+        options_.hot_threshold) {
+      return false;
+    }
+    counter.store(0, std::memory_order_relaxed);
+    return true;
+  }
+
+  void insert(std::string_view key, uint64_t h, Value value) {
+    Shard &shard = shards_[h % kShards];
+    std::unique_lock<std::shared_mutex> lock{shard.latch};
+    if (shard.map.size() >= options_.max_entries / kShards &&
+        !shard.map.count(h)) {
+      // any entry makes room, a hot one comes back
+      shard.map.erase(shard.map.begin());
+      entries_.fetch_sub(1, std::memory_order_relaxed);
+    }
+    auto [it, inserted] =
+        shard.map.insert_or_assign(h, std::make_pair(std::string(key), value));
+    if (inserted) {
+      entries_.fetch_add(1, std::memory_order_relaxed);
+    }
+  }
+
+  void erase(std::string_view key, uint64_t h) {
+    Shard &shard = shards_[h % kShards];
+    std::unique_lock<std::shared_mutex> lock{shard.latch};
+    auto it = shard.map.find(h);
+    if (it != shard.map.end() && it->second.first == key) {
+      shard.map.erase(it);
+      entries_.fetch_sub(1, std::memory_order_relaxed);
+    }
+  }
+
+  void clear() {
+    for (auto &shard : shards_) {
+      std::unique_lock<std::shared_mutex> lock{shard.latch};
+      entries_.fetch_sub(shard.map.size(), std::memory_order_relaxed);
+      shard.map.clear();
+    }
+  }
+
+  size_t size() const { return entries_.load(std::memory_order_relaxed); }
+
+private:
+  static constexpr size_t kShards = 16;
+  // counters per entry
+  static constexpr size_t kCounters = 4;
+
+  struct Shard {
+    mutable std::shared_mutex latch;
+    // hash -> key and value, a colliding key replaces the entry
+    std::unordered_map<uint64_t, std::pair<std::string, Value>> map;
+  };
+
+  AdaptiveHashOptions options_;
+  std::unique_ptr<std::atomic<uint8_t>[]> counters_;
+  std::array<Shard, kShards> shards_;
+  std::atomic<size_t> entries_{0};
+};
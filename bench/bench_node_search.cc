@@ -0,0 +1,189 @@
+// Searches inside internal nodes keyed by 8 byte big endian ids.
+//
+// usage: bench_node_search [nodes] [probes]
+//
+// The ids are drawn uniform, skewed towards small ids, or in clustered runs,
+// sorted and cut into full nodes like a bulk build does. Each node is
+// searched three ways: the binary search InternalNode used before, its
+// find_idx, which starts from the slot its model predicts when the fit is
+// good, and a linear count of the smaller ids with vector compares over a
+// copy of the ids. Half of the probes are ids of the node, half fall between.
+
+#include "../bplus_tree.hpp"
+
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+
+key_type id_key(uint64_t id) {
+  key_type key{'t', '/'};
+  for (int i = 7; i >= 0; --i) {
+    key.push_back(static_cast<char>(id >> (i * 8)));
+  }
+  return key;
+}
+
+// the binary search of InternalNode::find_idx before the model
+int binary_idx(const InternalNode &node, const key_type &key) {
+  int l = -1, r = node.size();
+  while (l + 1 != r) {
+    int mid = (l + r) / 2;
+    if (key_cmp(key, node.key(mid)) > 0) {
+      l = mid;
+    } else {
+      r = mid;
+    }
+  }
+  return r;
+}
+
+// the ids of a node as numbers which sort like the keys, padded to the
+// vector width with the largest one
+struct IdArray {
+  using lanes = uint64_t __attribute__((vector_size(32)));
+  static constexpr size_t kLanes = sizeof(lanes) / sizeof(uint64_t);
+
+  std::vector<lanes> ids;
+
+  // keys compare as chars, a signed char sorts 0x80 first
+  static uint64_t number(const key_type &key) {
+    uint64_t v = 0;
+    for (size_t i = 2; i < 10; ++i) {
+      uint8_t byte = static_cast<uint8_t>(key[i]);
+      v = v << 8 | (std::is_signed_v<char> ? byte ^ 0x80 : byte);
+    }
+    return v;
+  }
+
+  explicit IdArray(const InternalNode &node) {
+    ids.resize((node.size() + kLanes - 1) / kLanes);
+    for (size_t i = 0; i < ids.size() * kLanes; ++i) {
+      auto &key = node.key(std::min(i, node.size() - 1));
+      ids[i / kLanes][i % kLanes] = i < node.size() ? number(key) : UINT64_MAX;
+    }
+  }
+
+  // the number of ids below key, the ids are the whole keys after the prefix
+  int lower(const key_type &key) const {
+    lanes probe = lanes{} + number(key);
+    lanes count{};
+    for (auto &v : ids) {
+      count -= v < probe;
+    }
+    uint64_t sum = 0;
+    for (size_t i = 0; i < kLanes; ++i) {
+      sum += count[i];
+    }
+    return static_cast<int>(sum);
+  }
+};
+
+std::vector<uint64_t> make_ids(const std::string &dist, size_t n,
+                               std::mt19937_64 &rng) {
+  std::vector<uint64_t> ids;
+  std::uniform_real_distribution<double> unit(0, 1);
+  while (ids.size() < n) {
+    if (dist == "uniform") {
+      ids.push_back(rng());
+    } else if (dist == "skewed") {
+      // most ids small, the gaps grow with the id
+      ids.push_back(static_cast<uint64_t>(std::pow(unit(rng), 8) * 0x1p63));
+    } else {
+      // runs of consecutive ids far apart
+      uint64_t base = rng();
+      for (int i = 0; i < 16 && ids.size() < n; ++i) {
+        ids.push_back(base + i);
+      }
+    }
+  }
+  std::sort(ids.begin(), ids.end());
+  ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+  return ids;
+}
+
+template <typename Search>
+double run(const std::vector<std::pair<size_t, key_type>> &probes,
+           Search search, long &check) {
+  auto start = std::chrono::steady_clock::now();
+  long sum = 0;
+  for (auto &[node, key] : probes) {
+    sum += search(node, key);
+  }
+  auto end = std::chrono::steady_clock::now();
+  check = sum;
+  return std::chrono::duration<double, std::nano>(end - start).count() /
+         probes.size();
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+  size_t num_nodes = argc > 1 ? std::stoul(argv[1]) : 4096;
+  size_t num_probes = argc > 2 ? std::stoul(argv[2]) : 4000000;
+
+  for (std::string dist : {"uniform", "skewed", "clustered"}) {
+    std::mt19937_64 rng(42);
+    // a node of these keys holds a little under 40
+    auto ids = make_ids(dist, num_nodes * 40, rng);
+
+    std::vector<InternalNode> nodes(1);
+    std::vector<std::vector<uint64_t>> node_ids(1);
+    for (auto id : ids) {
+      nodes.back().insert(id_key(id), 0);
+      node_ids.back().push_back(id);
+      if (!nodes.back().less_than(PAGE_SIZE)) {
+        nodes.back().remove(static_cast<int>(nodes.back().size()) - 1);
+        node_ids.back().pop_back();
+        nodes.emplace_back().insert(id_key(id), 0);
+        node_ids.emplace_back().push_back(id);
+      }
+    }
+    std::vector<IdArray> arrays;
+    size_t modeled = 0;
+    for (auto &node : nodes) {
+      arrays.emplace_back(node);
+      modeled += node.modeled();
+    }
+
+    std::vector<std::pair<size_t, key_type>> probes;
+    for (size_t i = 0; i < num_probes; ++i) {
+      size_t n = rng() % nodes.size();
+      auto &node = node_ids[n];
+      uint64_t id = node[rng() % node.size()];
+      probes.emplace_back(n, id_key(i % 2 ? id + 1 : id));
+    }
+
+    long binary_sum, model_sum, simd_sum;
+    double binary_ns = run(
+        probes,
+        [&](size_t n, const key_type &key) { return binary_idx(nodes[n], key); },
+        binary_sum);
+    double model_ns = run(
+        probes,
+        [&](size_t n, const key_type &key) { return nodes[n].find_idx(key); },
+        model_sum);
+    double simd_ns = run(
+        probes,
+        [&](size_t n, const key_type &key) { return arrays[n].lower(key); },
+        simd_sum);
+    if (binary_sum != model_sum || binary_sum != simd_sum) {
+      std::cerr << dist << ": searches disagree" << std::endl;
+      return 1;
+    }
+
+    std::cout << dist << ": " << nodes.size() << " nodes, "
+              << static_cast<double>(modeled) / nodes.size()
+              << " of them modeled\n";
+    std::cout << "  binary  " << binary_ns << " ns/search\n";
+    std::cout << "  model   " << model_ns << " ns/search\n";
+    std::cout << "  simd    " << simd_ns << " ns/search\n";
+  }
+  return 0;
+}
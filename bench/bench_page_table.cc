@@ -0,0 +1,134 @@
+// Fetch/unpin cycles on the page table of the buffer pool.
+//
+// usage: bench_page_table [frames] [pages] [ops]
+//
+// The first part replays the same access stream against the two std::map
+// tables the pool used before and against PageTable, a hit does the lookups
+// of fetch and unpin and a miss remaps a frame like change_page. The second
+// part runs fetch/unpin on a real pool whose pages are all resident.
+
+#include "../buffer_pool.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <map>
+#include <random>
+#include <string>
+#include <vector>
+
+// the tables of the pool before PageTable
+struct MapTable {
+  std::map<PageId, size_t> page_index;
+  std::map<PageId, Page *> page_map;
+
+  size_t find(PageId id) {
+    auto it = page_map.find(id);
+    return it == page_map.end() ? PageTable::npos : page_index[id];
+  }
+  void insert(PageId id, size_t frame, Page *page) {
+    page_index[id] = frame;
+    page_map[id] = page;
+  }
+  void erase(PageId id) {
+    page_index.erase(id);
+    page_map.erase(id);
+  }
+};
+
+struct FlatTable {
+  PageTable table;
+
+  explicit FlatTable(size_t frames) : table(frames) {}
+  size_t find(PageId id) { return table.find(id); }
+  void insert(PageId id, size_t frame, Page *) { table.insert(id, frame); }
+  void erase(PageId id) { table.erase(id); }
+};
+
+template <typename Table>
+double run_cycles(Table &table, const std::vector<PageId> &stream,
+                  size_t frames, size_t &hits) {
+  std::vector<PageId> owner(frames, INVALID_PAGE_ID);
+  size_t hand = 0;
+  hits = 0;
+
+  auto start = std::chrono::steady_clock::now();
+  for (auto id : stream) {
+    size_t frame = table.find(id); // fetch
+    if (frame == PageTable::npos) {
+      frame = hand;
+      hand = (hand + 1) % frames;
+      if (owner[frame] != INVALID_PAGE_ID) {
+        table.erase(owner[frame]);
+      }
+      owner[frame] = id;
+      table.insert(id, frame, nullptr);
+    } else {
+      ++hits;
+    }
+    frame = table.find(id); // unpin
+    if (frame == PageTable::npos) {
+      std::abort();
+    }
+  }
+  auto end = std::chrono::steady_clock::now();
+  return std::chrono::duration<double, std::nano>(end - start).count() /
+         stream.size();
+}
+
+int main(int argc, char *argv[]) {
+  size_t frames = argc > 1 ? std::stoul(argv[1]) : 1024;
+  size_t pages = argc > 2 ? std::stoul(argv[2]) : frames * 4 / 3;
+  size_t ops = argc > 3 ? std::stoul(argv[3]) : 4000000;
+
+  std::vector<PageId> stream(ops);
+  std::mt19937_64 rng(42);
+  for (auto &id : stream) {
+    id = static_cast<PageId>(rng() % pages) + 1;
+  }
+
+  size_t map_hits, flat_hits;
+  MapTable map_table;
+  FlatTable flat_table{frames};
+  double map_ns = run_cycles(map_table, stream, frames, map_hits);
+  double flat_ns = run_cycles(flat_table, stream, frames, flat_hits);
+  if (map_hits != flat_hits) {
+    std::cerr << "tables disagree" << std::endl;
+    return 1;
+  }
+
+  std::cout << "frames " << frames << " pages " << pages << " ops " << ops
+            << " hit rate " << static_cast<double>(flat_hits) / ops << "\n";
+  std::cout << "std::map   " << map_ns << " ns/cycle\n";
+  std::cout << "PageTable  " << flat_ns << " ns/cycle\n";
+  std::cout << "speedup    " << map_ns / flat_ns << "x\n";
+
+  // fetch/unpin through the pool, every page is resident
+  const char *file = "bench_page_table.db";
+  {
+    BufferPool pool{file, frames};
+    pool.open();
+    std::vector<PageId> ids;
+    for (size_t i = 0; i < frames; ++i) {
+      Page *p = pool.new_page();
+      ids.push_back(p->id);
+      pool.unpin(p->id, true);
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < ops; ++i) {
+      PageId id = ids[stream[i] % frames];
+      pool.fetch(id);
+      pool.unpin(id);
+    }
+    auto end = std::chrono::steady_clock::now();
+    std::cout << "pool fetch/unpin "
+              << std::chrono::duration<double, std::nano>(end - start).count() /
+                     ops
+              << " ns/cycle" << std::endl;
+    pool.close();
+  }
+  std::remove(file);
+  return 0;
+}
@@ -0,0 +1,172 @@
+// Hit rates of the replacers on page access traces.
+//
+// usage: bench_replacer [frames] [trace]
+//   frames  cache size in pages, default 256
+//   trace   file with one page id per line, the generated workloads are used
+//           when it is missing
+//
+// The generated workloads are point lookups with a zipf skew, the same
+// lookups mixed with full scans of a cold range, and a loop over slightly
+// more pages than the cache holds.
+
+#include "../replacer.hpp"
+
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
+using Trace = std::vector<int64_t>;
+
+// replay the trace like the buffer pool: the replacer sees frame indexes, a
+// hit pins and unpins the frame and a miss reuses the victim's frame
+template <typename Replacer> double hit_rate(const Trace &trace, size_t frames) {
+  Replacer replacer = [&] {
+    if constexpr (std::is_constructible_v<Replacer, size_t>) {
+      return Replacer(frames);
+    } else {
+      return Replacer();
+    }
+  }();
+  auto bind = [&](size_t frame, int64_t page) {
+    if constexpr (requires { replacer.bind(frame, page); }) {
+      replacer.bind(frame, page);
+    }
+  };
+
+  std::unordered_map<int64_t, size_t> frame_of;
+  std::vector<int64_t> page_of(frames);
+  for (size_t i = 0; i < frames; ++i) {
+    page_of[i] = -1 - static_cast<int64_t>(i);
+    bind(i, page_of[i]);
+    replacer.put(i);
+  }
+
+  size_t hits = 0;
+  for (auto id : trace) {
+    size_t frame;
+    if (auto it = frame_of.find(id); it != frame_of.end()) {
+      ++hits;
+      frame = it->second;
+      replacer.remove(frame);
+    } else {
+      if (!replacer.victim(frame)) {
+        std::abort();
+      }
+      frame_of.erase(page_of[frame]);
+      page_of[frame] = id;
+      frame_of[id] = frame;
+      bind(frame, id);
+    }
+    replacer.put(frame);
+  }
+  return trace.empty() ? 0 : static_cast<double>(hits) / trace.size();
+}
+
+class Zipf {
+public:
+  Zipf(size_t n, double theta) : cdf_(n) {
+    double sum = 0;
+    for (size_t i = 0; i < n; ++i) {
+      sum += 1.0 / std::pow(i + 1, theta);
+      cdf_[i] = sum;
+    }
+    for (auto &c : cdf_) {
+      c /= sum;
+    }
+  }
+
+  template <typename Rng> int64_t operator()(Rng &rng) {
+    double u = std::uniform_real_distribution<double>(0, 1)(rng);
+    return std::lower_bound(cdf_.begin(), cdf_.end(), u) - cdf_.begin();
+  }
+
+private:
+  std::vector<double> cdf_;
+};
+
+static Trace point_trace(size_t frames, size_t ops) {
+  std::mt19937_64 rng(1);
+  Zipf zipf{frames * 8, 0.9};
+  Trace trace;
+  for (size_t i = 0; i < ops; ++i) {
+    trace.push_back(zipf(rng));
+  }
+  return trace;
+}
+
+static Trace mixed_trace(size_t frames, size_t ops) {
+  std::mt19937_64 rng(2);
+  Zipf zipf{frames * 8, 0.9};
+  Trace trace;
+  int64_t cold = frames * 8;
+  while (trace.size() < ops) {
+    for (size_t i = 0; i < frames * 4; ++i) {
+      trace.push_back(zipf(rng));
+    }
+    // a scan reads twice the cache through the leaf chain
+    for (size_t i = 0; i < frames * 2; ++i) {
+      trace.push_back(cold++);
+    }
+  }
+  return trace;
+}
+
+static Trace loop_trace(size_t frames, size_t ops) {
+  Trace trace;
+  size_t n = frames + frames / 4;
+  for (size_t i = 0; i < ops; ++i) {
+    trace.push_back(i % n);
+  }
+  return trace;
+}
+
+static void report(const std::string &name, const Trace &trace,
+                   size_t frames) {
+  std::cout << std::left << std::setw(8) << name << std::fixed
+            << std::setprecision(4) << std::setw(10)
+            << hit_rate<LruReplacer<size_t>>(trace, frames) << std::setw(10)
+            << hit_rate<FIFOReplacer<size_t>>(trace, frames) << std::setw(10)
+            << hit_rate<ClockReplacer<size_t>>(trace, frames) << std::setw(10)
+            << hit_rate<LruKReplacer<size_t>>(trace, frames) << std::setw(10)
+            << hit_rate<TwoQueueReplacer<size_t>>(trace, frames)
+            << std::setw(10) << hit_rate<ArcReplacer<size_t>>(trace, frames)
+            << std::endl;
+}
+
+int main(int argc, char *argv[]) {
+  size_t frames = argc > 1 ? std::stoul(argv[1]) : 256;
+  size_t ops = frames * 2000;
+
+  std::cout << std::left << std::setw(8) << "trace" << std::setw(10) << "lru"
+            << std::setw(10) << "fifo" << std::setw(10) << "clock"
+            << std::setw(10) << "lru-2" << std::setw(10) << "2q"
+            << std::setw(10) << "arc" << std::endl;
+
+  if (argc > 2) {
+    std::ifstream in(argv[2]);
+    if (!in) {
+      std::cerr << "open " << argv[2] << " failed" << std::endl;
+      return 1;
+    }
+    Trace trace;
+    int64_t id;
+    while (in >> id) {
+      trace.push_back(id);
+    }
+    report("file", trace, frames);
+    return 0;
+  }
+
+  report("point", point_trace(frames, ops), frames);
+  report("mixed", mixed_trace(frames, ops), frames);
+  report("loop", loop_trace(frames, ops), frames);
+  return 0;
+}
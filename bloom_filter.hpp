@@ -0,0 +1,95 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string_view>
+
+struct FilterOptions {
+  // keep a Bloom filter of the keys in memory, a search for a key it doesn't
+  // have returns before the descent. the filter is built from the leaves
+  // when the tree is opened, and again when it has twice the keys it was
+  // sized for or many of them were removed
+  bool enabled = false;
+  // about 1% false positives with 10
+  size_t bits_per_key = 10;
+};
+
+struct FilterStats {
+  size_t keys = 0;            // keys added, removed ones stay until a build
+  size_t bytes = 0;           // memory of the filter
+  size_t negatives = 0;       // searches it answered, no page was read
+  size_t false_positives = 0; // searches it passed which found nothing
+  size_t rebuilds = 0;
+
+  // @brief the share of the searches for absent keys the filter passed
+  double fpr() const {
+    size_t absent = negatives + false_positives;
+    return absent == 0 ? 0 : static_cast<double>(false_positives) / absent;
+  }
+};
+
+// A blocked Bloom filter: all probes of a key are in one block of a cache
+// line, so a lookup touches one line. The words are atomic, readers of a
+// copy-on-write tree check it while a writer adds.
+class BloomFilter {
+public:
+  static constexpr size_t kBlockBits = 512;
+  static constexpr size_t kBlockWords = kBlockBits / 64;
+
+  BloomFilter(size_t keys, size_t bits_per_key) {
+    size_t bits = std::max<size_t>(keys * bits_per_key, kBlockBits);
+    blocks_ = (bits + kBlockBits - 1) / kBlockBits;
+    words_ = std::make_unique<std::atomic<uint64_t>[]>(blocks_ * kBlockWords);
+    probes_ = std::clamp<size_t>(std::lround(bits_per_key * std::log(2.0)), 1,
+                                 16);
+  }
+
+  static uint64_t hash(std::string_view key) {
+    return std::hash<std::string_view>{}(key);
+  }
+
+  void add(uint64_t h) {
+    std::atomic<uint64_t> *block = block_of(h);
+    // double hashing, an odd step reaches different bits
+    uint32_t a = static_cast<uint32_t>(h);
+    uint32_t b = static_cast<uint32_t>(h >> 32) | 1;
+    for (size_t i = 0; i < probes_; ++i, a += b) {
+      block[(a >> 6) % kBlockWords].fetch_or(uint64_t{1} << (a & 63),
+                                             std::memory_order_relaxed);
+    }
+  }
+
+  bool may_contain(uint64_t h) const {
+    const std::atomic<uint64_t> *block = block_of(h);
+    // double hashing, an odd step reaches different bits
+    uint32_t a = static_cast<uint32_t>(h);
+    uint32_t b = static_cast<uint32_t>(h >> 32) | 1;
+    for (size_t i = 0; i < probes_; ++i, a += b) {
+      uint64_t word =
+          block[(a >> 6) % kBlockWords].load(std::memory_order_relaxed);
+      if (!(word & (uint64_t{1} << (a & 63)))) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  size_t bytes() const { return blocks_ * kBlockBits / 8; }
+
+private:
+  std::atomic<uint64_t> *block_of(uint64_t h) const {
+    // the high bits pick the block, the low ones the bits in it
+    uint64_t mixed = (h ^ (h >> 29)) * 0x9e3779b97f4a7c15ull;
+    return &words_[static_cast<size_t>(
+                       (static_cast<unsigned __int128>(mixed) * blocks_) >> 64) *
+                   kBlockWords];
+  }
+
+  size_t blocks_;
+  size_t probes_;
+  std::unique_ptr<std::atomic<uint64_t>[]> words_;
+};
@@ -1,15 +1,23 @@
 #pragma once
 #include "buffer_pool.hpp"
 #include "logger.hpp"
+#include "mmap_file.hpp"
 #include "replacer.hpp"
+#include <array>
+#include <atomic>
 #include <cassert>
 #include <cstddef>
 #include <cstdint>
 #include <cstdio>
 #include <cstring>
+#include <deque>
+#include <functional>
 #include <memory>
+#include <set>
+#include <shared_mutex>
 #include <string_view>
 #include <system_error>
+#include <unordered_map>
 
 using bytes = std::vector<char>;
 using key_type = bytes;
@@ -28,15 +36,30 @@ inline int key_cmp(const key_type &left, const key_type &right) {
   return res;
 }
 
+// A write buffered in an internal node on its way down to the leaves, see
+// BufferPoolOptions::write_buffer.
+// | type | key_size | val_size | key | val |
+struct Message {
+  enum Type : uint8_t { kInsert, kUpsert, kDelete };
+  static constexpr size_t kHeaderSize = sizeof(uint8_t) + sizeof(int) * 2;
+
+  Type type = kInsert;
+  key_type key;
+  value_type val;
+
+  size_t bytes() const { return kHeaderSize + key.size() + val.size(); }
+  bool operator==(const Message &other) const = default;
+};
+
 // If modfied this class, please modify insert and remove in BPlusTree
 // setting children's parent
-class InternalNode {
+class InternalNode : public DecodedNode {
 public:
   friend class BPlusTree;
 
   bool operator==(const InternalNode &other) const {
     return items_ == other.items_ && keys_ == other.keys_ &&
-           parent_ == other.parent_;
+           parent_ == other.parent_ && msgs_ == other.msgs_;
   }
 
   struct Element {
@@ -49,14 +72,24 @@ public:
     }
   };
 
-  bool contains(const key_type &key) {
+  bool contains(const key_type &key) const {
     auto [exist, idx] = find(key);
     return exist;
   }
 
-  int find_idx(const key_type &key);
-  auto find(const key_type &key) -> std::pair<bool, int>;
-  PageId child(const key_type &key);
+  int find_idx(const key_type &key) const;
+  auto find(const key_type &key) const -> std::pair<bool, int>;
+  PageId child(const key_type &key) const;
+  // index of the child key goes to, -1 if key is below the first key
+  int child_idx(const key_type &key) const;
+  // index of the first child which may hold key, a split leaves the records
+  // of a key in the children left of it too
+  int first_child_idx(const key_type &key) const {
+    return std::max(find_idx(key) - 1, 0);
+  }
+  void set_child(size_t idx, PageId child) { items_[idx].child = child; }
+  // @brief replace the key at idx, it stays between its neighbours
+  void set_key(size_t idx, key_type key);
   void insert(key_type key, PageId child);
   bool remove(const key_type &key);
   void remove(int idx);
@@ -67,17 +100,34 @@ public:
   void write(Page *p) const;
   void move_half_to(InternalNode &internal);
 
-  const Element &item(size_t idx) { return items_[idx]; }
-  const key_type &key(size_t idx) { return keys_[idx]; }
+  const Element &item(size_t idx) const { return items_[idx]; }
+  const key_type &key(size_t idx) const { return keys_[idx]; }
+  // @brief whether find_idx starts from the slot the model predicts
+  bool modeled() const { return model_err_ >= 0; }
   
   bool less_than(size_t page_size) const {
     size_t size = sizeof(Element) * items_.size() + meta_size();
     for (auto i = 0; i < items_.size(); ++i) {
       size += items_[i].key_size;
     }
-    return size < page_size;
+    return size + buffer_bytes_ < page_size;
   }
 
+  // The buffer of writes for the children, ordered by key, the writes of a
+  // key from the oldest.
+  void buffer(Message msg);
+  // @brief the newest buffered write of key, nullptr if there is none
+  const Message *buffered(const key_type &key) const;
+  // @brief remove and return the buffered writes of the child at idx
+  std::vector<Message> take_buffered(size_t idx);
+  // @brief the child whose buffered writes take the most bytes
+  size_t heaviest_child() const;
+  // @brief drop the buffered writes of the keys in [lo, hi), an empty hi has
+  // no upper bound
+  void remove_buffered(const key_type &lo, const key_type &hi);
+  const std::vector<Message> &messages() const { return msgs_; }
+  size_t buffer_bytes() const { return buffer_bytes_; }
+
   // // caller is right node, and new_node is left node
   // const key_type &split(InternalNode &new_node);
 
@@ -99,17 +149,35 @@ public:
 
 private:
   size_t meta_size() const {
-    return Page::offset() + sizeof num_keys_ + sizeof parent_;
+    return Page::offset() + sizeof num_keys_ + sizeof parent_ + sizeof(int);
   }
 
+  // the 8 bytes of key after the prefix all keys share, as a number which
+  // grows with the key
+  uint64_t model_key(const key_type &key) const;
+  // fit the line through the first and the last key and measure how far
+  // the slot it predicts for each key is. the model is used when the slots
+  // around the prediction are at most half the node
+  void refit();
+
   Page *p = nullptr;
   int num_keys_ = 0;
   PageId parent_ = INVALID_PAGE_ID;
   std::vector<Element> items_;
   std::vector<key_type> keys_;
+  // stored after the keys, a count and then the messages
+  std::vector<Message> msgs_;
+  size_t buffer_bytes_ = 0;
+  // the search model, kept with the decoded node only. slot = (model_key -
+  // model_lo_) * model_slope_ is at most model_err_ away from the slot, -1
+  // if the node has no model
+  size_t model_prefix_ = 0;
+  uint64_t model_lo_ = 0;
+  double model_slope_ = 0;
+  int model_err_ = -1;
 };
 
-class LeafNode {
+class LeafNode : public DecodedNode {
   using kv_type = std::pair<bytes, bytes>;
 
 public:
@@ -127,9 +195,9 @@ public:
     }
   };
 
-  bool get(const key_type &key, value_type &val);
+  bool get(const key_type &key, value_type &val) const;
 
-  value_type fetch(int idx) {
+  value_type fetch(int idx) const {
     assert(idx < items_.size());
     return kvs_[idx].second;
   }
@@ -137,8 +205,10 @@ public:
   void set_parent(PageId parent) { parent_ = parent; }
   PageId parent() const { return parent_; }
 
-  int find_idx(const key_type &key);
-  auto find(const key_type &key) -> std::pair<bool, int>;
+  int find_idx(const key_type &key) const;
+  // @brief the first record of key, or where key goes if it has none. the
+  // fingerprints are scanned before any key is compared
+  auto find(const key_type &key) const -> std::pair<bool, int>;
   void insert(key_type key, value_type val);
   bool remove(const key_type &key);
   void remove(int idx);
@@ -149,7 +219,7 @@ public:
   void move_half_to(LeafNode &new_node);
 
   size_t size() const { return items_.size(); }
-  key_type key(int idx) { return kvs_[idx].first; }
+  key_type key(int idx) const { return kvs_[idx].first; }
 
   PageId next() const { return next_; }
   void set_next(PageId next) { next_ = next; }
@@ -173,6 +243,10 @@ private:
     return Page::offset() + sizeof num_keys_ + sizeof parent_ + sizeof next_;
   }
 
+  static uint8_t fingerprint(const key_type &key);
+  int probe(uint8_t fp, int from) const;
+  int find_idx(const key_type &key, int l, int r) const;
+
 private:
   Page *p = nullptr;
 
@@ -183,18 +257,51 @@ private:
 
   std::vector<Element> items_;
   std::vector<std::pair<bytes, bytes>> kvs_;
+  // a byte of the hash of each key, kept with the decoded node only
+  std::vector<uint8_t> fps_;
 };
 
 class BPlusTree {
 public:
   friend class BPlusTreeTest;
 
-  BPlusTree(std::string_view db_name, size_t pool_size = 32)
-      : buffer_pool_(db_name, pool_size) {
-    buffer_pool_.open();
+  BPlusTree(std::string_view db_name, size_t pool_size = 32,
+            BufferPoolOptions options = {})
+      : buffer_pool_(db_name, pool_size, options) {
+    if (auto ec = buffer_pool_.open()) {
+      throw std::system_error(ec, "open tree file failed");
+    }
+    root_ = buffer_pool_.root();
+    cow_ = buffer_pool_.options_.cow.enabled;
+    if (!cow_) {
+      write_buffer_ =
+          std::min<size_t>(buffer_pool_.options_.write_buffer, PAGE_SIZE / 2);
+    }
+    cow_root_.store(root_);
+    rebuild_resident();
+    if (buffer_pool_.options_.filter.enabled) {
+      rebuild_filter();
+    }
+    // the records of buffered writes and copies aren't where a leaf says
+    if (buffer_pool_.options_.adaptive_hash.enabled && !cow_ &&
+        write_buffer_ == 0) {
+      adaptive_hash_ = std::make_unique<AdaptiveHashIndex<HashSlot>>(
+          buffer_pool_.options_.adaptive_hash);
+    }
   }
 
+  // @brief open a tree file read-only through a shared memory mapping. The
+  // nodes are read straight from the mapping and cached by the page cache of
+  // the OS, so opening reads only the meta page, lookups pin nothing, and
+  // processes serving the same file share its memory. Writes fail.
+  static std::unique_ptr<BPlusTree>
+  open_readonly_mmap(std::string_view db_name, MmapOptions options = {});
+
   void close() {
+    if (readonly_) {
+      mapped_ = MmapFile();
+      return;
+    }
     buffer_pool_.close();
   }
 
@@ -205,7 +312,7 @@ public:
   template <typename K, typename V> bool insert(const K &key, const V &val) {
     bool ok = insert(bytes(key.begin(), key.end()), bytes(val.begin(), val.end()));
     for (auto& i : buffer_pool_.pages_) {
-      assert(i->pin_count == 0);
+      assert(i.pin_count == 0);
     }
     return ok;
   }
@@ -218,16 +325,303 @@ public:
   }
 
   bool insert(key_type key, value_type val);
+  // @brief insert the record, or replace the value of the newest record of
+  // key. not in copy-on-write mode
+  bool upsert(key_type key, value_type val);
   bool search(const key_type &key, value_type &val);
+  // @brief remove every record of key, the leaves aren't merged. a buffered
+  // remove returns true, it isn't known yet whether the key was there. not
+  // in copy-on-write mode
   bool remove(const key_type &key);
+  // @brief remove the records whose keys are in [lo, hi), an empty hi has no
+  // upper bound. The subtrees inside the range are unlinked and their pages
+  // freed, of them only the internal nodes are read. The leaves of lo and
+  // hi are trimmed and a root left with one child is dropped, no nodes are
+  // merged. the freed pages the meta page has no room for are kept by
+  // close(), a crash before it leaks them. not in copy-on-write mode
+  bool remove_range(const key_type &lo, const key_type &hi);
+
+  // @brief call fn for the records whose keys are in [lo, hi) in ascending
+  // order, an empty hi has no upper bound. fn returns false to stop, returns
+  // the number of records visited
+  using scan_fn = std::function<bool(const key_type &, const value_type &)>;
+  size_t scan(const key_type &lo, const key_type &hi, const scan_fn &fn);
+
+  // Coroutine versions of search, insert and scan, they are run by a
+  // Scheduler. A page miss suspends the coroutine until the read completes,
+  // so one worker thread keeps many lookups in flight:
+  //
+  //   Scheduler scheduler{4};
+  //   bool found = scheduler.block_on(tree.co_search(key, val));
+  //
+  // Readers descend without holding the tree latch across a suspension, every
+  // page is validated against the tree version after it is fetched and the
+  // descent restarts if a writer ran in between.
+  Task<bool> co_search(key_type key, value_type &val);
+  Task<bool> co_insert(key_type key, value_type val);
+  Task<size_t> co_scan(key_type lo, key_type hi, scan_fn fn);
+
+  // @brief build an empty tree bottom-up, next() yields the records in
+  // ascending key order and returns false at the end
+  bool bulk_build(const std::function<bool(key_type &, value_type &)> &next,
+                  double fill_factor = 1.0);
+
+  class Cursor;
+
+  // A point-in-time view of a copy-on-write tree. The pages of its version
+  // are not reused while the snapshot or a cursor on it is alive, so reads
+  // see that version however long they run, and writers never wait for
+  // them. Releasing the last snapshot of a version frees what newer ones
+  // replaced.
+  class Snapshot : public std::enable_shared_from_this<Snapshot> {
+  public:
+    ~Snapshot();
+    Snapshot(const Snapshot &) = delete;
+    Snapshot &operator=(const Snapshot &) = delete;
+
+    bool search(const key_type &key, value_type &val) const;
+    size_t scan(const key_type &lo, const key_type &hi,
+                const scan_fn &fn) const;
+    // @brief a cursor on the first record whose key is not below lo
+    Cursor cursor(const key_type &lo = {}) const;
+    uint64_t version() const { return version_; }
+
+  private:
+    friend class BPlusTree;
+    Snapshot(BPlusTree &tree, uint64_t version, PageId root)
+        : tree_(tree), version_(version), root_(root) {}
+
+    BPlusTree &tree_;
+    uint64_t version_;
+    PageId root_;
+  };
+
+  // Iterates the records of a snapshot in key order, it keeps the snapshot
+  // alive. The path from the root is kept, the next leaf is found from it.
+  class Cursor {
+  public:
+    bool valid() const { return leaf_ != nullptr; }
+    const key_type &key() const { return key_; }
+    const value_type &value() const { return value_; }
+    void next();
+
+  private:
+    friend class Snapshot;
+    Cursor(std::shared_ptr<const Snapshot> snapshot, const key_type &lo);
+    // go down from the page to the first record not below lo
+    void descend(PageId id, const key_type &lo);
+    // move to the next leaf while the index is past the current one
+    void settle();
+
+    std::shared_ptr<const Snapshot> snapshot_;
+    std::vector<std::pair<std::shared_ptr<const InternalNode>, size_t>> path_;
+    std::shared_ptr<const LeafNode> leaf_;
+    size_t idx_ = 0;
+    key_type key_;
+    value_type value_;
+  };
+
+  // @brief pin the current version of the tree. Snapshots need copy-on-write
+  // mode, nullptr without it
+  std::shared_ptr<const Snapshot> snapshot();
+
+  // @brief make the writes so far durable. In copy-on-write mode this
+  // publishes the root on disk, and the pages the writes since replaced may
+  // be reused
+  void checkpoint();
+
+  bool empty() const { return root_ == INVALID_PAGE_ID; }
+  // @brief the tree was opened by open_readonly_mmap()
+  bool readonly() const { return readonly_; }
+
+  BufferPoolStats stats() { return buffer_pool_.stats(); }
+  // @brief the key filter, see FilterOptions. all zero when it's off
+  FilterStats filter_stats();
+  // @brief see AdaptiveHashOptions, all zero when it's off
+  AdaptiveHashStats adaptive_hash_stats() const;
 
   void print();
 
 private:
+  // the tree of open_readonly_mmap(), the pool is never opened
+  BPlusTree(std::string_view db_name, MmapFile file, MmapOptions options);
+
   Page *find_leaf(const key_type &key);
+  bool search_tree(const key_type &key, value_type &val);
+
+  // Adaptive hash index, see AdaptiveHashOptions. A slot is valid while its
+  // frame keeps the version it had, every change or reuse of the frame
+  // bumps it.
+  struct HashSlot {
+    PageId page;
+    size_t frame;
+    uint64_t version;
+    int slot;
+  };
+  // search the leaf slot of an indexed key, false if the key isn't indexed
+  // or its slot is stale
+  bool search_hashed(const key_type &key, uint64_t h, value_type &val);
+  // the search of key found its leaf pinned in p, a hot key is indexed
+  void index_hot(const key_type &key, uint64_t h, const Page *p,
+                 const LeafNode &leaf_node);
+  // run a write as one operation of the log
+  bool write(Message msg);
+  // apply the write to its leaf, under the exclusive latch
+  bool apply(Message msg);
+  bool insert_locked(key_type key, value_type val);
+  bool upsert_locked(key_type key, value_type val);
+  bool remove_locked(const key_type &key);
+
+  // A running remove_range(), the leaf of lo is trimmed but always kept and
+  // links to the leaf of hi once the leaves between are gone.
+  struct RangeRemoval {
+    const key_type &lo;
+    const key_type &hi;
+    PageId left;
+    PageId right;
+    std::vector<PageId> freed;
+  };
+  // remove the range from the subtree at id whose keys are below upper, an
+  // empty upper has no bound. levels counts the internal levels from id
+  // down, 0 is a leaf. first is set to the new first key of the node if the
+  // range took its first children
+  bool remove_range_in(PageId id, size_t levels, const key_type &upper,
+                       RangeRemoval &rm, key_type &first);
+  // add the pages of the subtree at id to freed, the leaves aren't read
+  bool drop_subtree(PageId id, size_t levels, std::vector<PageId> &freed);
+
+  // Write buffers, see BufferPoolOptions::write_buffer. The writes are added
+  // to the buffer of the node at id, the buffer is then written back with at
+  // most write_buffer_ bytes, and the writes taken out of it go down to the
+  // children. At a leaf they are applied in order.
+  bool flush_down(PageId id, std::vector<Message> msgs);
+  // apply the write to the leaf in memory, false leaves the leaf as it was
+  // if it would have to split
+  bool apply_to(LeafNode &leaf_node, const Message &msg);
+  // the pivots of an internal node leave write_buffer_ bytes of its page
+  bool fits(const InternalNode &node) const {
+    return node.less_than(PAGE_SIZE - write_buffer_ + node.buffer_bytes());
+  }
+  // scan the leaves with the writes buffered above them
+  size_t scan_buffered(const key_type &lo, const key_type &hi,
+                       const scan_fn &fn);
+  // collect the writes in [lo, hi) buffered in the subtree at id, with the
+  // depth of their node. levels is the number of internal levels below id
+  void collect_buffered(PageId id, size_t depth, size_t levels,
+                        const key_type &lo, const key_type &hi,
+                        std::vector<std::pair<size_t, Message>> &out);
+
+  // Pages of the read paths. In read-only mmap mode the page is a view of
+  // the mapping kept in view, nothing is pinned and release does nothing.
+  Page *read_page(PageId id, Page &view);
+  void release_page(Page *p);
+  Page *find_leaf(const key_type &key, Page &view);
+  // the page a descent from page_id reaches below the resident levels, with
+  // first the one on the way to the first leaf which may hold key
+  PageId descend_resident(PageId page_id, const key_type &key,
+                          bool first = false) const;
+  // fill resident_ from the root
+  void rebuild_resident();
+  // an internal node was written, its resident copy follows
+  void update_resident(PageId id, const InternalNode &node);
+
+  // the decoded node of a pinned page, readers of the frame share it until
+  // the page is modified
+  template <typename NodeType>
+  std::shared_ptr<const NodeType> read_node(Page *p);
+  // a shared lock on latch_, the read-only tree never changes and skips it
+  std::shared_lock<std::shared_mutex> read_latch();
+
+  // Prefetches the leaves in front of a scan. The leaves which follow come
+  // from the children of the current leaf's parent, or from its next pointer
+  // at the end of the parent. Read-ahead starts at the second leaf and the
+  // window doubles up to BufferPoolOptions::read_ahead.
+  class ReadAhead {
+  public:
+    explicit ReadAhead(BPlusTree &tree);
+    // @brief the scan reached the leaf
+    void advance(PageId id, const LeafNode &leaf);
+
+  private:
+    void refill(PageId id, const LeafNode &leaf);
+
+    BPlusTree &tree_;
+    size_t max_window_;
+    size_t window_ = 0;
+    size_t steps_ = 0;
+    // leaves after the current one, the first issued_ are prefetched
+    std::deque<PageId> ahead_;
+    size_t issued_ = 0;
+  };
+  // pin the leaf of key, version is the tree version the descent saw. with
+  // first the first leaf which may hold a record of key. returns nullptr if
+  // the tree is empty or a page can't be read
+  Task<Page *> co_find_leaf(const key_type &key, uint64_t &version,
+                            bool first = false);
   bool insert_parent(PageId parent, PageId left, PageId right, key_type key);
   bool make_tree(key_type k, value_type v);
   bool make_root(key_type k, PageId left, PageId right);
+
+  // Copy-on-write mode, see CowOptions. A write copies the path from the root
+  // to its leaf and publishes the copy of the root as a new version. The
+  // pages it replaced are freed once no reader holds an older version and
+  // the root on disk is newer.
+  bool insert_cow(key_type key, value_type val);
+  // write the node to a new page, or to two after a split, left and right
+  // are their ids and sep the first key of the right one
+  template <typename NodeType>
+  bool write_cow(NodeType &node, PageId &left, PageId &right, key_type &sep);
+  // make root the current version, freed are the pages it replaced
+  void publish_cow(PageId root, std::vector<PageId> freed);
+  // free the replaced pages which no reader or durable root refers to
+  void recycle_cow();
+  bool search_cow(const key_type &key, value_type &val);
+  bool search_from(PageId root, const key_type &key, value_type &val);
+  // fetch, decode and unpin, nullptr if the page can't be read
+  template <typename NodeType>
+  std::shared_ptr<const NodeType> load_node(PageId id);
+  // scan under the latch, in-place mode
+  size_t scan_locked(const key_type &lo, const key_type &hi,
+                     const scan_fn &fn);
+
+  // Key filter, see FilterOptions. It is replaced by a larger one built from
+  // the tree when the keys added outgrow it, or when many keys were removed.
+  void rebuild_filter();
+  // a write is going to run, its key is added
+  void filter_write(const Message &msg);
+  // the search can't find the key
+  bool filter_rejects(const key_type &key);
+
+  // visit the records of the subtree at id in [lo, hi), false stops
+  bool scan_cow(PageId id, const key_type &lo, const key_type &hi,
+                const scan_fn &fn, size_t &count);
+
+  // Holds the current version for a reader without the latch: its slot in
+  // cow_readers_ keeps the pages of the version from being reused. A reader
+  // which finds no free slot takes the shared latch, no write runs then.
+  class CowReader {
+  public:
+    explicit CowReader(BPlusTree &tree);
+    ~CowReader();
+    CowReader(const CowReader &) = delete;
+    CowReader &operator=(const CowReader &) = delete;
+
+    PageId root() const { return root_; }
+
+  private:
+    std::atomic<uint64_t> *slot_ = nullptr;
+    std::shared_lock<std::shared_mutex> lock_;
+    PageId root_ = INVALID_PAGE_ID;
+  };
+
+  // the right most internal node of a level while building bottom-up
+  struct BulkLevel {
+    Page *page = nullptr;
+    InternalNode node;
+  };
+  PageId bulk_append(std::vector<BulkLevel> &levels, size_t level,
+                     const key_type &key, PageId child, size_t limit,
+                     std::vector<PageId> &built);
   
   template <typename NodeType>
   void write_node(NodeType& n, Page* p) {
@@ -250,6 +644,7 @@ private:
       internal.read(page);
       internal.set_parent(parent);
       internal.write(page);
+      update_resident(p, internal);
     }
     buffer_pool_.unpin(p, true);
     return true;
@@ -263,9 +658,61 @@ private:
 private:
   PageId root_ = INVALID_PAGE_ID;
   BufferPool buffer_pool_;
+  bool readonly_ = false;
+  MmapFile mapped_;
+  // writers hold it exclusively and bump version_
+  std::shared_mutex latch_;
+  uint64_t version_ = 0;
+  // internal nodes of the top levels, see BufferPoolOptions::resident_levels.
+  // a split of one of them or a new root refills them after the insert
+  std::unordered_map<PageId, std::shared_ptr<const InternalNode>> resident_;
+  bool resident_stale_ = false;
+  // bytes of an internal page kept for buffered writes, 0 writes the leaves
+  // directly
+  size_t write_buffer_ = 0;
+
+  // the key filter, nullptr when it's off. readers of copy-on-write mode
+  // load it without the latch
+  std::atomic<std::shared_ptr<BloomFilter>> filter_;
+  static constexpr size_t kMinFilterKeys = 1024;
+  // the keys it was sized for, the writes since it was built
+  size_t filter_capacity_ = 0;
+  size_t filter_removed_ = 0;
+  FilterStats filter_stats_;
+  std::atomic<size_t> filter_negatives_{0};
+  std::atomic<size_t> filter_false_positives_{0};
+
+  // nullptr when it's off
+  std::unique_ptr<AdaptiveHashIndex<HashSlot>> adaptive_hash_;
+  std::atomic<size_t> hash_hits_{0};
+  std::atomic<size_t> hash_misses_{0};
+
+  // copy-on-write mode. the root is published before the version, a reader
+  // which sees a version reads its root or a newer one
+  bool cow_ = false;
+  std::atomic<PageId> cow_root_{INVALID_PAGE_ID};
+  std::atomic<uint64_t> cow_version_{1};
+  // the version of the root on disk
+  uint64_t durable_version_ = 1;
+  // the pages replaced by a version, readers of older ones may still use them
+  std::deque<std::pair<uint64_t, std::vector<PageId>>> cow_freed_;
+  // the versions readers hold, 0 is a free slot
+  static constexpr size_t kReaderSlots = 64;
+  std::array<std::atomic<uint64_t>, kReaderSlots> cow_readers_{};
+  // the versions snapshots hold
+  std::mutex snapshots_mutex_;
+  std::multiset<uint64_t> snapshots_;
 };
 
 #include "impl/internal_impl.ipp"
 #include "impl/leaf_impl.ipp"
 #include "impl/tree_insert_impl.ipp"
-#include "impl/tree_search_impl.ipp"
\ No newline at end of file
+#include "impl/tree_remove_impl.ipp"
+#include "impl/tree_search_impl.ipp"
+#include "impl/tree_bulk_load_impl.ipp"
+#include "impl/tree_coro_impl.ipp"
+#include "impl/tree_cow_impl.ipp"
+#include "impl/tree_buffer_impl.ipp"
+#include "impl/tree_filter_impl.ipp"
+#include "impl/tree_adaptive_hash_impl.ipp"
+#include "impl/tree_snapshot_impl.ipp"
\ No newline at end of file
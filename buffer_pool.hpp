@@ -1,19 +1,40 @@
 #pragma once
+#include <algorithm>
+#include <atomic>
 #include <cassert>
+#include <cerrno>
+#include <chrono>
+#include <climits>
+#include <condition_variable>
 #include <cstddef>
 #include <cstdint>
 #include <cstdio>
 #include <cstring>
-#include <map>
+#include <deque>
 #include <memory>
 #include <mutex>
+#include <unordered_map>
 #include <variant>
 #include <vector>
 #include <filesystem>
+#include <functional>
+#include <latch>
 #include <system_error>
-
+#include <thread>
+#include <type_traits>
+
+#include "adaptive_hash.hpp"
+#include "bloom_filter.hpp"
+#include "coro.hpp"
+#include "frame_arena.hpp"
+#include "io_backend.hpp"
 #include "logger.hpp"
+#include "memory_pressure.hpp"
+#include "page_table.hpp"
 #include "replacer.hpp"
+#include "wal.hpp"
+
+#include <sys/stat.h>
 
 constexpr int kInternalPageType = 1;
 constexpr int kLeafPageType = 2;
@@ -23,77 +44,157 @@ using PageId = long;
 constexpr PageId INVALID_PAGE_ID = -1;
 constexpr size_t PAGE_SIZE = 1024;
 
+// Page io on a raw fd with pread/pwrite, which carry their own offset, so
+// readers and writers don't serialize on a file position. The file grows in
+// chunks preallocated with fallocate, its size is cached.
 class DiskManager {
 public:
-  DiskManager(std::string_view filename, PageId next_start_id)
-      : db_filename_(filename), next_page_id_(next_start_id) {
-
-    std::filesystem::path file_path(db_filename_.data());
-    if (std::filesystem::exists(file_path) &&
-        std::filesystem::is_regular_file(file_path)) {
-      db_io_ = fopen(filename.data(), "rb+");
-    } else {
-      // create file
-      db_io_ = fopen(filename.data(), "wb+");
+  DiskManager(std::string_view filename, PageId next_start_id,
+              const IoOptions &io_options = {})
+      : db_filename_(filename), next_page_id_(next_start_id),
+        extend_chunk_(io_options.extend_chunk) {
+    fd_ = ::open(db_filename_.c_str(), O_RDWR | O_CREAT, 0644);
+    if (fd_ < 0) {
+      throw std::runtime_error("open file failed");
+    }
+    struct stat st;
+    if (fstat(fd_, &st) != 0) {
+      ::close(fd_);
+      throw std::runtime_error("stat file failed");
     }
+    file_size_ = st.st_size;
+    allocated_ = st.st_size;
 
-    if (db_io_ == nullptr) {
-      throw std::runtime_error("open file failed");
+    if (io_options.direct_io) {
+      direct_fd_ = ::open(db_filename_.c_str(), O_RDWR | O_DIRECT);
+      if (direct_fd_ < 0) {
+        LOG_DEBUG << "O_DIRECT is not supported";
+      }
     }
+    io_ = make_io_backend(fd_, direct_fd_, io_options);
   }
 
   ~DiskManager() { close(); }
 
   // @brief: set the next page id
-  void set_pid(PageId id) {
-    std::unique_lock<std::mutex> lock{mutex_};
-    next_page_id_ = id;
-  }
+  void set_pid(PageId id) { next_page_id_ = id; }
 
   bool read_page(PageId id, char *dst);
   bool write_page(PageId id, char *src);
+  // @brief write the pages with ids first, first + 1, ... with pwritev
+  bool write_pages(PageId first, const std::vector<char *> &pages);
+  // @brief make the written pages durable
+  bool sync() {
+    syncs_++;
+    return fdatasync(fd_) == 0;
+  }
+  // @brief the calls of sync()
+  size_t syncs() const { return syncs_; }
 
-  void close();
+  // @brief asynchronous page io, done is called on an io thread
+  void async_read_page(PageId id, char *dst, std::function<void(bool)> done) {
+    submit({page_request(IoRequest::Op::kRead, id, dst, std::move(done))});
+  }
+  void async_write_page(PageId id, char *src,
+                        std::function<void(bool)> done) {
+    submit({page_request(IoRequest::Op::kWrite, id, src, std::move(done))});
+  }
+  // @brief submit a batch of requests together
+  void submit(std::vector<IoRequest> reqs) {
+    for (auto &req : reqs) {
+      if (req.op == IoRequest::Op::kWrite) {
+        extend(req.offset + req.len);
+      }
+    }
+    io_->submit(std::move(reqs));
+  }
 
-  PageId alloc_page() {
-    std::unique_lock<std::mutex> lock{mutex_};
-    return next_page_id_++;
+  static IoRequest page_request(IoRequest::Op op, PageId id, char *buf,
+                                std::function<void(bool)> done) {
+    IoRequest req;
+    req.op = op;
+    req.offset = id * PAGE_SIZE;
+    req.buf = buf;
+    req.len = PAGE_SIZE;
+    req.done = std::move(done);
+    return req;
   }
 
+  IoBackend &io() { return *io_; }
+
+  void close();
+
+  PageId alloc_page() { return next_page_id_++; }
+
   PageId current_page_id() const { return next_page_id_; }
 
+  // @brief bytes written to the file, the preallocated space is not counted
+  size_t file_size() const { return file_size_; }
+
 private:
-  std::mutex mutex_;
+  // a write reaches end, the file size is raised and the space past the
+  // preallocated end is allocated in chunks
+  void extend(size_t end);
+
   std::string db_filename_;
 
   bool close_ = false;
-  FILE *db_io_ = nullptr;
 
-  PageId next_page_id_ = 1; // default 1
+  int fd_ = -1;
+  int direct_fd_ = -1;
+  std::unique_ptr<IoBackend> io_;
+
+  std::atomic<PageId> next_page_id_ = 1; // default 1
+
+  std::atomic<size_t> file_size_ = 0;
+  std::atomic<size_t> allocated_ = 0;
+  size_t extend_chunk_;
+  std::atomic<bool> preallocate_ = true;
+  std::atomic<size_t> syncs_ = 0;
 };
 
 // | page id | data |
+// The meta data of a frame, data points to the frame in the arena of the
+// buffer pool and is not owned by the page.
 class Page {
 public:
   Page(char *d) : data(d) {}
-  ~Page() {}
+  virtual ~Page() = default;
 
   std::int8_t dirty = 0;
   size_t pin_count = 0;
+  // index of the frame in the buffer pool
+  size_t frame = 0;
+  // sequence number when the page became dirty
+  std::uint64_t dirty_since = 0;
+  // bumped by every dirty unpin
+  std::uint64_t version = 0;
+  // an asynchronous read is filling the frame, waiters are called when it
+  // completes
+  bool loading = false;
+  std::vector<std::function<void()>> waiters;
+  // read by prefetch() and not fetched since
+  bool prefetched = false;
+  // the log record of the last change, the page isn't written before the
+  // record is durable
+  std::uint64_t lsn = 0;
+  // changed by the operation in progress, the page can't be written before
+  // the operation commits
+  bool in_txn = false;
 
   // need store in disk
   PageId id = INVALID_PAGE_ID;
   int page_type = 0;
 
-  std::unique_ptr<char> data = nullptr;
+  char *data = nullptr;
 
   bool is_dirty() const { return dirty == 1; }
   void set_dirty() { dirty = 1; }
   void clear_dirty() { dirty = 0; }
 
   virtual void deserialize() {
-    std::memcpy(&id, data.get(), sizeof(PageId));
-    std::memcpy(&page_type, data.get() + sizeof(PageId), sizeof(int));
+    std::memcpy(&id, data, sizeof(PageId));
+    std::memcpy(&page_type, data + sizeof(PageId), sizeof(int));
   }
 
   virtual void serliaze() {
@@ -101,8 +202,8 @@ public:
       //  data = std::make_unique<char>(PAGE_SIZE);
       assert(false);
     }
-    std::memcpy(data.get(), &id, sizeof(PageId));
-    std::memcpy(data.get() + sizeof(PageId), &page_type, sizeof(int));
+    std::memcpy(data, &id, sizeof(PageId));
+    std::memcpy(data + sizeof(PageId), &page_type, sizeof(int));
   }
 
   static size_t offset() { return sizeof(PageId) + sizeof(int); }
@@ -112,11 +213,18 @@ public:
     if (!data) {
       return nullptr;
     }
-    return (data.get() + data_offset());
+    return (data + data_offset());
   }
 };
 
-// |id| page count | free list size | free list | page 1 | page 2 | ... |
+// The decoded form of a frame's page. The buffer pool keeps it for the tree
+// until the page is modified or the frame is reused.
+class DecodedNode {
+public:
+  virtual ~DecodedNode() = default;
+};
+
+// |id| page count | free list size | next | prev | root | free list |
 class BfpMetaPage : public Page {
 public:
   BfpMetaPage(char *d) : Page(d) {}
@@ -125,16 +233,29 @@ public:
   size_t free_list_size = 0;
   PageId next = 0;  // next free list page id
   PageId prev = -1; // prev free list page id
-
-  constexpr static size_t offset =
-      sizeof(PageId) + sizeof(size_t) * 2 + sizeof(PageId) * 2; // 24
+  PageId root = INVALID_PAGE_ID; // root page id of the tree
+  // recovery redoes the log segments from this one on
+  uint64_t checkpoint = 0;
+  // the layout of the file, open() refuses a file of another one
+  uint32_t magic = kMagic;
+  uint32_t version = kVersion;
+  // BufferPoolOptions::write_buffer of the file, set when it is created
+  uint64_t write_buffer = 0;
+
+  constexpr static uint32_t kMagic = 0x46545042; // "BPTF"
+  constexpr static uint32_t kVersion = 2;
+
+  constexpr static size_t offset = sizeof(PageId) + sizeof(size_t) * 2 +
+                                   sizeof(PageId) * 3 + sizeof(uint64_t) +
+                                   sizeof(uint32_t) * 2 +
+                                   sizeof(uint64_t); // 72
   constexpr static size_t MAX_FREE_LIST_SIZE =
       (PAGE_SIZE - offset) / sizeof(PageId);
 
   PageId operator[](size_t idx) {
     assert(idx < free_list_size);
     PageId id;
-    std::memcpy(&id, data.get() + offset + idx * sizeof(PageId),
+    std::memcpy(&id, data + offset + idx * sizeof(PageId),
                 sizeof(PageId));
     return id;
   }
@@ -143,7 +264,7 @@ public:
     if (free_list_size >= MAX_FREE_LIST_SIZE) {
       return false;
     }
-    std::memcpy(data.get() + offset + free_list_size * sizeof(PageId), &id,
+    std::memcpy(data + offset + free_list_size * sizeof(PageId), &id,
                 sizeof(PageId));
     free_list_size++;
     return true;
@@ -155,7 +276,7 @@ public:
     }
     PageId id;
     std::memcpy(&id,
-                data.get() + offset + (free_list_size - 1) * sizeof(PageId),
+                data + offset + (free_list_size - 1) * sizeof(PageId),
                 sizeof(PageId));
     free_list_size--;
     return id;
@@ -163,28 +284,68 @@ public:
 
   void deserialize() override {
     Page::deserialize();
-    std::memcpy(&page_count, data.get() + sizeof(PageId), sizeof(size_t));
-    std::memcpy(&free_list_size, data.get() + sizeof(PageId) + sizeof(size_t),
+    std::memcpy(&page_count, data + sizeof(PageId), sizeof(size_t));
+    std::memcpy(&free_list_size, data + sizeof(PageId) + sizeof(size_t),
                 sizeof(size_t));
-    std::memcpy(&next, data.get() + sizeof(PageId) + sizeof(size_t) * 2,
+    std::memcpy(&next, data + sizeof(PageId) + sizeof(size_t) * 2,
                 sizeof(PageId));
     std::memcpy(&prev,
-                data.get() + sizeof(PageId) + sizeof(size_t) * 2 +
+                data + sizeof(PageId) + sizeof(size_t) * 2 +
                     sizeof(PageId),
                 sizeof(PageId));
+    std::memcpy(&root,
+                data + sizeof(PageId) + sizeof(size_t) * 2 +
+                    sizeof(PageId) * 2,
+                sizeof(PageId));
+    std::memcpy(&checkpoint,
+                data + sizeof(PageId) + sizeof(size_t) * 2 +
+                    sizeof(PageId) * 3,
+                sizeof(uint64_t));
+    std::memcpy(&magic,
+                data + sizeof(PageId) + sizeof(size_t) * 2 +
+                    sizeof(PageId) * 3 + sizeof(uint64_t),
+                sizeof(uint32_t));
+    std::memcpy(&version,
+                data + sizeof(PageId) + sizeof(size_t) * 2 +
+                    sizeof(PageId) * 3 + sizeof(uint64_t) + sizeof(uint32_t),
+                sizeof(uint32_t));
+    std::memcpy(&write_buffer,
+                data + sizeof(PageId) + sizeof(size_t) * 2 +
+                    sizeof(PageId) * 3 + sizeof(uint64_t) +
+                    sizeof(uint32_t) * 2,
+                sizeof(uint64_t));
   }
 
+  // @brief the page was written in the layout of this version
+  bool valid() const { return magic == kMagic && version == kVersion; }
+
   // serialize the meta page all the data
   void serliaze() override {
     Page::serliaze();
-    std::memcpy(data.get() + sizeof(PageId), &page_count, sizeof(size_t));
-    std::memcpy(data.get() + sizeof(PageId) + sizeof(size_t), &free_list_size,
+    std::memcpy(data + sizeof(PageId), &page_count, sizeof(size_t));
+    std::memcpy(data + sizeof(PageId) + sizeof(size_t), &free_list_size,
                 sizeof(size_t));
-    std::memcpy(data.get() + sizeof(PageId) + sizeof(size_t) * 2, &next,
+    std::memcpy(data + sizeof(PageId) + sizeof(size_t) * 2, &next,
                 sizeof(PageId));
-    std::memcpy(data.get() + sizeof(PageId) + sizeof(size_t) * 2 +
+    std::memcpy(data + sizeof(PageId) + sizeof(size_t) * 2 +
                     sizeof(PageId),
                 &prev, sizeof(PageId));
+    std::memcpy(data + sizeof(PageId) + sizeof(size_t) * 2 +
+                    sizeof(PageId) * 2,
+                &root, sizeof(PageId));
+    std::memcpy(data + sizeof(PageId) + sizeof(size_t) * 2 +
+                    sizeof(PageId) * 3,
+                &checkpoint, sizeof(uint64_t));
+    std::memcpy(data + sizeof(PageId) + sizeof(size_t) * 2 +
+                    sizeof(PageId) * 3 + sizeof(uint64_t),
+                &magic, sizeof(uint32_t));
+    std::memcpy(data + sizeof(PageId) + sizeof(size_t) * 2 +
+                    sizeof(PageId) * 3 + sizeof(uint64_t) + sizeof(uint32_t),
+                &version, sizeof(uint32_t));
+    std::memcpy(data + sizeof(PageId) + sizeof(size_t) * 2 +
+                    sizeof(PageId) * 3 + sizeof(uint64_t) +
+                    sizeof(uint32_t) * 2,
+                &write_buffer, sizeof(uint64_t));
   }
 
   // This data not include the meta data
@@ -195,20 +356,104 @@ public:
     if (!data) {
       return nullptr;
     }
-    return data.get() + data_offset();
+    return data + data_offset();
   }
 };
 
+struct CowOptions {
+  // copy-on-write mode of the tree: a write never changes a page in place,
+  // the leaf and its ancestors are written to new pages and the meta page
+  // publishes the new root. readers keep the version they started on
+  // without a latch, and a crash leaves the last published root. the log is
+  // not used
+  bool enabled = false;
+  // every write is durable when it returns: its pages are synced, then the
+  // meta page. false publishes the root on disk at checkpoint() and close()
+  // only, a crash loses the writes since
+  bool sync = true;
+};
+
+struct BufferPoolOptions {
+  // start a thread which writes dirty frames back before they are evicted
+  bool background_flush = false;
+  // the flusher starts when the ratio of dirty frames is above the high
+  // watermark, and writes the oldest dirty frames until it is below the low
+  // watermark
+  double dirty_high_watermark = 0.5;
+  double dirty_low_watermark = 0.25;
+  std::chrono::milliseconds flush_interval{100};
+  // max pages written by one round of the flusher, they are in flight
+  // together
+  size_t flush_batch = 32;
+
+  IoOptions io;
+  ArenaOptions arena;
+  WalOptions wal;
+  CowOptions cow;
+  FilterOptions filter;
+  AdaptiveHashOptions adaptive_hash;
+
+  // leaves a scan reads ahead, the window starts small and doubles while the
+  // scan goes on. 0 turns read-ahead off
+  size_t read_ahead = 16;
+
+  // keep the decoded node of every frame, a hit on a page which wasn't
+  // modified doesn't decode it again
+  bool cache_decoded = true;
+
+  // the tree keeps the decoded internal nodes of its top levels outside the
+  // pool, a descent through them fetches and pins nothing. the levels are
+  // filled from the root until resident_budget bytes, counted in pages, are
+  // used
+  size_t resident_levels = 2;
+  size_t resident_budget = 4 << 20;
+
+  // bytes of every internal page the tree keeps for a buffer of writes on
+  // their way to the leaves, as in a B-epsilon tree. a write lands in the
+  // buffer of the root, and a full buffer moves the writes of its busiest
+  // child one level down, so a leaf is read and written once for a batch of
+  // them. reads check the buffers on their path, and the fanout is lower.
+  // at most half a page, 0 turns it off. the setting is stored in the file
+  // when it is created, an existing file keeps its own. copy-on-write mode
+  // turns it off and can't open a file with buffers
+  size_t write_buffer = 0;
+
+  // resize() may grow the pool up to max_frames, the arena reserves the
+  // address space for them. 0 keeps the pool at its initial size
+  size_t max_frames = 0;
+  // memory pressure doesn't shrink the pool below min_frames, 0 means a
+  // quarter of the largest size. the frames below it are the fixed buffers
+  // of io_uring, a resize() under it doesn't give their memory back
+  size_t min_frames = 0;
+};
+
+struct BufferPoolStats {
+  size_t hits = 0;
+  size_t misses = 0;
+  size_t dirty_evictions = 0;   // misses which wrote a dirty victim
+  size_t background_writes = 0; // pages written by the flusher
+  size_t prefetches = 0;        // pages read by prefetch()
+  size_t prefetch_hits = 0;     // prefetched pages which were fetched
+  size_t wal_commits = 0;       // operations logged
+  size_t wal_syncs = 0;         // log syncs, a group of commits shares one
+  size_t wal_bytes = 0;         // the log a crash would redo
+  size_t checkpoints = 0;       // background checkpoints completed
+};
+
 template <ReplacerTraits<size_t> ReplacerType> class DefaultBufferPool {
 public:
   friend class BPlusTree;
   friend class BufferPoolTest;
   friend class BPlusTreeTest;
 
-  using PagePtr = std::unique_ptr<Page>;
+  DefaultBufferPool(std::string_view db, size_t bfp_size,
+                    BufferPoolOptions options = {})
+      : replacer_(make_replacer(std::max(bfp_size, options.max_frames))),
+        name_(db), bfp_size_(bfp_size),
+        max_frames_(std::max(bfp_size, options.max_frames)),
+        options_(options) {}
 
-  DefaultBufferPool(std::string_view db, size_t bfp_size)
-      : name_(db), bfp_size_(bfp_size) {}
+  ~DefaultBufferPool() { stop_flusher(); }
 
   std::error_code open() {
     PageId next_id = 1;
@@ -221,41 +466,101 @@ public:
     }
 
     open_ = true;
-    disk_manager_ = std::make_unique<DiskManager>(name_, next_id);
+    if (options_.cow.enabled) {
+      // the copies of a write are published by the root, not logged
+      options_.wal.enabled = false;
+    }
+    disk_manager_ = std::make_unique<DiskManager>(name_, next_id, options_.io);
+    if (auto ec = file_exists ? check_format() : std::error_code()) {
+      // nothing is written to a file which can't be opened, not even the
+      // redo
+      disk_manager_.reset();
+      open_ = false;
+      return ec;
+    }
+    if (options_.wal.enabled) {
+      wal_ = std::make_unique<Wal>(name_ + ".wal", PAGE_SIZE);
+      // the segments before the checkpoint marker are in the data file
+      uint64_t from = 0;
+      std::vector<char> meta(PAGE_SIZE);
+      if (file_exists && disk_manager_->read_page(0, meta.data())) {
+        BfpMetaPage marker(meta.data());
+        marker.deserialize();
+        from = marker.checkpoint;
+      }
+      // redo every committed operation after it, the pages are written in
+      // place
+      size_t records = wal_->recover(from, [&](PageId id, const char *data) {
+        disk_manager_->write_page(id, const_cast<char *>(data));
+      });
+      if (records > 0) {
+        LOG_DEBUG << "redo " << records << " log records";
+        disk_manager_->sync();
+        file_exists = true;
+      }
+      wal_->restart(from);
+    }
 
-    char *meta_data = new char[PAGE_SIZE];
-    std::memset(meta_data, 0, PAGE_SIZE);
+    // | meta page | flusher staging | frames |
+    arena_ = FrameArena(PAGE_SIZE, frame_base() + max_frames_, options_.arena);
+    char *meta_data = arena_.frame(0);
 
     if (file_exists) {
       // Serialize the meta page
       disk_manager_->read_page(0, meta_data);
       meta_page_ = std::make_unique<BfpMetaPage>(meta_data);
       meta_page_->deserialize();
+      if (wal_) {
+        // the marker of a meta page the log redid is older, the segments
+        // before the new one are gone either way
+        meta_page_->checkpoint = wal_->segment();
+      }
 
       disk_manager_->set_pid(meta_page_->page_count + 1);
+      load_free_list();
     } else {
       // Allocate a new meta page
       meta_page_ = std::make_unique<BfpMetaPage>(meta_data);
       meta_page_->id = 0;
       meta_page_->page_count = 1;
+      meta_page_->checkpoint = wal_ ? wal_->segment() : 0;
+      meta_page_->write_buffer =
+          options_.cow.enabled
+              ? 0
+              : std::min<size_t>(options_.write_buffer, PAGE_SIZE / 2);
       meta_page_->serliaze();
 
       disk_manager_->set_pid(1);
     }
+    // the buffers in the pages are read with the file's setting
+    options_.write_buffer = meta_page_->write_buffer;
 
+    page_table_.reserve(max_frames_);
+    if (options_.cache_decoded) {
+      decoded_ = std::make_unique<DecodedSlot[]>(max_frames_);
+    }
+    // never reallocated, the pages don't move when the pool grows
+    pages_.reserve(max_frames_);
     for (size_t i = 0; i < bfp_size_; ++i) {
-      char *buf = new char[PAGE_SIZE];
-      std::memset(buf, 0, PAGE_SIZE);
-      PagePtr page = std::make_unique<Page>(buf);
-      pages_.emplace_back(std::move(page));
+      Page &page = pages_.emplace_back(arena_.frame(frame_base() + i));
+      page.frame = i;
+      // empty frames get keys which no page uses
+      bind_frame(i, INVALID_PAGE_ID - static_cast<PageId>(i));
       replacer_.put(i);
     }
+    register_frames();
 
     LOG_DEBUG << "meta page"
               << "page count " << meta_page_->page_count << "free list size "
               << meta_page_->free_list_size << "next " << meta_page_->next
               << "prev " << meta_page_->prev;
 
+    if (options_.background_flush ||
+        (wal_ && options_.wal.checkpoint_bytes > 0)) {
+      stop_flusher_ = false;
+      flusher_ = std::thread([this] { flusher_loop(); });
+    }
+
     return std::error_code();
   }
 
@@ -265,132 +570,222 @@ public:
     if (pid == INVALID_PAGE_ID) {
       return false;
     }
+    std::unique_lock<std::mutex> lock{latch_};
     return pid < meta_page_->page_count;
   }
 
   Page *new_page() {
     assert(open_);
-    PageId id = disk_manager_->alloc_page();
-
-    Page *page = fetch(id);
+    std::unique_lock<std::mutex> lock{latch_};
+    PageId id = pop_free_locked();
+    bool reused = id != INVALID_PAGE_ID;
+    if (!reused) {
+      id = disk_manager_->alloc_page();
+    }
+    Page *page = fetch_locked(id, lock);
     if (page == nullptr) {
+      if (reused) {
+        push_free_locked(id);
+      }
       return nullptr;
     }
 
     page->id = id;
     page->pin_count = 1;
-    page->dirty = 1;
+    mark_dirty(page);
     page->serliaze();
 
-    meta_page_->page_count++;
-    meta_page_->serliaze();
-    meta_page_->dirty = 1;
-    // disk_manager_->write_page(0, meta_page_->data.get());
+    if (!reused) {
+      meta_page_->page_count++;
+    }
+    meta_changed();
+    // disk_manager_->write_page(0, meta_page_->data);
 
     return page;
   }
 
-  Page *fetch(PageId page_id) {
+  // @brief put a page nothing refers to on the free list, new_page() reuses
+  // it before the file grows
+  void free_page(PageId page_id) {
     assert(open_);
+    std::unique_lock<std::mutex> lock{latch_};
+    push_free_locked(page_id);
+    meta_changed();
+  }
 
-    if (page_id == INVALID_PAGE_ID) {
-      assert(false);
-    }
-
-    // check if the page is in the buffer pool
-    auto it = page_map_.find(page_id);
-    if (it != page_map_.end()) {
-      // if the page is in the buffer pool, return the page
-      assert(it->second->id == page_id);
-      it->second->pin_count++;
-      auto idx = page_index_[page_id];
-      replacer_.remove(idx);
-      return it->second;
-    }
+  Page *fetch(PageId page_id) {
+    assert(open_);
+    std::unique_lock<std::mutex> lock{latch_};
+    return fetch_locked(page_id, lock);
+  }
 
-    // fetch from replacer
-    size_t idx;
-    bool found = replacer_.victim(idx);
-    if (!found) {
-      LOG_DEBUG << "replacer is empty";
+  // @brief pin the page if it is in the pool, nullptr if it isn't or is
+  // still being read. never reads or evicts
+  Page *fetch_resident(PageId page_id) {
+    assert(open_);
+    std::unique_lock<std::mutex> lock{latch_};
+    Page *page = lookup(page_id);
+    if (!page || page->loading) {
       return nullptr;
     }
-
-    Page *new_page = pages_[idx].get();
-    if (new_page->dirty == 1) {
-      flush(new_page->id);
-      new_page->dirty = false;
-    }
-
-    change_page(new_page, page_id);
-    page_index_[page_id] = idx;
-    page_map_[page_id] = new_page;
-
-    auto ok = disk_manager_->read_page(page_id, new_page->data.get());
-    new_page->pin_count = 1;
-    new_page->deserialize();
-    new_page->id = page_id;
-    // TODO need to handle the error ?
-    return new_page;
+    page->pin_count++;
+    replacer_.remove(page->frame);
+    count_hit(page);
+    return page;
   }
 
   void pin(PageId page_id) {
     assert(open_);
-    auto it = page_map_.find(page_id);
-    if (it != page_map_.end()) {
-      assert(it->second->id == page_id);
-      it->second->pin_count++;
-      replacer_.remove(page_index_[page_id]);
+    std::unique_lock<std::mutex> lock{latch_};
+    if (Page *page = lookup(page_id)) {
+      assert(page->id == page_id);
+      page->pin_count++;
+      replacer_.remove(page->frame);
     }
   }
 
   void unpin(PageId page_id, bool is_dirty = false) {
     assert(open_);
-    auto it = page_map_.find(page_id);
-    if (it != page_map_.end()) {
-      assert(it->second->id == page_id);
-      it->second->pin_count--;
+    std::unique_lock<std::mutex> lock{latch_};
+    if (Page *page = lookup(page_id)) {
+      assert(page->id == page_id);
+      page->pin_count--;
+      if (is_dirty && in_txn_) {
+        txn_image_locked(page);
+      }
       if (is_dirty) {
-        it->second->dirty = 1;
+        mark_dirty(page);
+        page->version++;
+        drop_decoded(page);
       }
-      if (it->second->pin_count == 0) {
-        assert(page_index_.find(page_id) != page_index_.end());
-        replacer_.put(page_index_[page_id]);
+      if (page->pin_count == 0) {
+        unpinned_locked(page);
       }
     } else {
       assert(false);
     }
   }
 
-  void flush(PageId page_id) {
+  // @brief start reading the pages without pinning them, a later fetch()
+  // finds them resident or waits for the read in flight. Pages which are
+  // resident or not in the file are skipped, and prefetching stops at a
+  // victim which would have to be written first. return the reads issued
+  size_t prefetch(const std::vector<PageId> &page_ids) {
     assert(open_);
+    std::vector<IoRequest> reqs;
+    {
+      std::unique_lock<std::mutex> lock{latch_};
+      for (auto page_id : page_ids) {
+        if (page_id <= 0 ||
+            page_id >= static_cast<PageId>(meta_page_->page_count) ||
+            lookup(page_id) || is_writing(page_id) ||
+            txn_images_.count(page_id)) {
+          continue;
+        }
+        size_t idx;
+        if (!replacer_.victim(idx)) {
+          break;
+        }
+        Page *page = &pages_[idx];
+        if (page->dirty == 1) {
+          replacer_.put(idx);
+          break;
+        }
+
+        change_page(page, page_id);
+        // the read holds the pin, the frame can't be a victim until it is
+        // filled
+        page->pin_count = 1;
+        page->loading = true;
+        page->prefetched = true;
+        stats_.prefetches++;
+        prefetching_++;
+        reqs.push_back(DiskManager::page_request(
+            IoRequest::Op::kRead, page_id, page->data,
+            [this, page, page_id](bool ok) {
+              finish_load(page, page_id, ok, true);
+            }));
+      }
+    }
+    size_t n = reqs.size();
+    if (n > 0) {
+      disk_manager_->submit(std::move(reqs));
+    }
+    return n;
+  }
+
+  bool prefetch(PageId page_id) {
+    return prefetch(std::vector<PageId>{page_id}) == 1;
+  }
 
-    auto it = page_map_.find(page_id);
-    if (it != page_map_.end()) {
-      assert(page_id == it->second->id);
-      LOG_DEBUG << "flush page " << page_id;
-      it->second->serliaze();
-      bool ok = disk_manager_->write_page(page_id, it->second->data.get());
-      if (ok) {
-        it->second->clear_dirty();
+  class FetchAwaiter;
+
+  // @brief fetch and pin the page, on a miss the coroutine is suspended until
+  // the read completes instead of blocking the thread. It is resumed on its
+  // scheduler, a caller which is not on a scheduler's worker falls back to
+  // fetch().
+  Task<Page *> co_fetch(PageId page_id) {
+    while (true) {
+      Page *page = co_await FetchAwaiter(*this, page_id);
+      if (page) {
+        co_return page;
       }
     }
   }
 
+  void flush(PageId page_id) {
+    assert(open_);
+    std::unique_lock<std::mutex> lock{latch_};
+
+    if (Page *page = lookup(page_id)) {
+      assert(page_id == page->id);
+      wait_writing(page_id, lock);
+      write_locked(page);
+    }
+  }
+
+  // @brief write every dirty page and sync the file once. The pages are
+  // written in PageId order, a run of adjacent pages with one pwritev
   void flush_all() {
     assert(open_);
-    for (auto &page : pages_) {
-      if (page->dirty == 1) {
-        page->serliaze();
-        bool ok = disk_manager_->write_page(page->id, page->data.get());
-        LOG_DEBUG << "flush page " << page->id;
-        if (!ok) {
-          LOG_DEBUG << page->id << " flush failed";
-        } else {
-          page->clear_dirty();
-        }
+    std::unique_lock<std::mutex> lock{latch_};
+    io_cv_.wait(lock, [&] { return writing_.empty(); });
+    write_dirty_locked();
+    disk_manager_->sync();
+  }
+
+  // @brief flush_all() and the meta page, they are synced together. With
+  // the log on, the meta page moves the checkpoint marker past the whole log
+  // and the log is dropped
+  void checkpoint() {
+    assert(open_);
+    std::unique_lock<std::mutex> lock{latch_};
+    io_cv_.wait(lock, [&] { return writing_.empty(); });
+    // a page of an operation in progress may hold the only copy of a change
+    // logged before it, the log is kept until a checkpoint without one
+    bool marker = wal_ && !in_txn_;
+    if (marker) {
+      // an operation in progress commits to the new segment
+      wal_->rotate();
+      meta_page_->checkpoint = wal_->segment();
+      meta_changed();
+    }
+    write_dirty_locked();
+    if (marker || options_.cow.enabled) {
+      // the root in the meta page may only refer to pages on the disk, and a
+      // marker past the log only to pages holding what the log had
+      disk_manager_->sync();
+    }
+    if (meta_page_ && meta_page_->dirty == 1 && !txn_meta_) {
+      log_before_write(meta_lsn_);
+      if (write_meta()) {
+        meta_page_->dirty = 0;
       }
     }
+    disk_manager_->sync();
+    if (marker) {
+      wal_->drop_before(meta_page_->checkpoint);
+    }
   }
 
   bool write_meta() {
@@ -398,15 +793,22 @@ public:
     if (meta_page_ == nullptr) {
       return false;
     }
-    return disk_manager_->write_page(0, meta_page_->data.get());
+    return disk_manager_->write_page(0, meta_page_->data);
   }
 
   void close() {
     assert(open_);
-    if (meta_page_ && meta_page_->dirty == 1) {
-      write_meta();
+    for (auto [pressure, id] : pressure_subscriptions_) {
+      pressure->unsubscribe(id);
     }
-    flush_all();
+    pressure_subscriptions_.clear();
+    stop_flusher();
+    // prefetches in flight
+    disk_manager_->io().drain();
+    checkpoint();
+    // after the dirty frames, a frame of a freed page is written back too
+    save_free_list();
+    wal_.reset();
     disk_manager_->close();
   }
 
@@ -416,91 +818,1100 @@ public:
   }
   size_t free_page_count() const {
     assert(open_);
-    return meta_page_->free_list_size;
+    return meta_page_->free_list_size + free_overflow_.size();
   }
-  size_t buffer_size() const {
+  size_t buffer_size() {
     assert(open_);
+    std::unique_lock<std::mutex> lock{latch_};
     return pages_.size();
   }
 
+  // @brief grow or shrink the pool to new_frames while it is used. The frames
+  // dropped by a shrink are waited for until they are unpinned, and written
+  // back if they are dirty. return false if new_frames is 0 or above
+  // max_frames, or a dirty frame can't be written
+  bool resize(size_t new_frames) {
+    assert(open_);
+    std::unique_lock<std::mutex> resize_lock{resize_mutex_};
+    std::unique_lock<std::mutex> lock{latch_};
+    if (new_frames == 0 || new_frames > max_frames_) {
+      return false;
+    }
+
+    size_t old_frames = pages_.size();
+    if (new_frames >= old_frames) {
+      for (size_t i = old_frames; i < new_frames; ++i) {
+        Page &page = pages_.emplace_back(arena_.frame(frame_base() + i));
+        page.frame = i;
+        bind_frame(i, INVALID_PAGE_ID - static_cast<PageId>(i));
+        replacer_.put(i);
+      }
+      bfp_size_ = new_frames;
+      // coroutines waiting for a victim try again
+      while (!frame_waiters_.empty()) {
+        frame_waiters_.front()->resume();
+        frame_waiters_.pop_front();
+      }
+      LOG_DEBUG << "buffer pool grows to " << new_frames;
+      return true;
+    }
+
+    // the frames from new_frames on are no victims and are not put back
+    bfp_size_ = new_frames;
+    for (size_t i = new_frames; i < old_frames; ++i) {
+      replacer_.remove(i);
+    }
+
+    size_t keep = old_frames;
+    while (keep > new_frames) {
+      Page &page = pages_[keep - 1];
+      io_cv_.wait(lock, [&] { return page.pin_count == 0 && !page.loading; });
+      if (is_writing(page.id)) {
+        wait_writing(page.id, lock);
+        continue;
+      }
+      if (page.dirty == 1) {
+        write_locked(&page);
+        if (page.dirty == 1) {
+          break;
+        }
+      }
+      if (lookup(page.id) == &page) {
+        page_table_.erase(page.id);
+      }
+      --keep;
+    }
+
+    while (pages_.size() > keep) {
+      pages_.pop_back();
+    }
+    // the registered frames keep their memory, a fixed read would go to the
+    // pages the registration pinned and not to the ones the frames map now
+    size_t first = std::max(frame_base() + keep, registered_);
+    if (frame_base() + old_frames > first) {
+      arena_.release(first, frame_base() + old_frames - first);
+    }
+    if (keep != new_frames) {
+      // the frames which are left go back to the replacer
+      bfp_size_ = keep;
+      for (size_t i = new_frames; i < keep; ++i) {
+        if (pages_[i].pin_count == 0) {
+          replacer_.put(i);
+        }
+      }
+      return false;
+    }
+    LOG_DEBUG << "buffer pool shrinks to " << new_frames;
+    return true;
+  }
+
+  // @brief shrink the pool when pressure is reported. Moderate pressure gives
+  // back a quarter of the frames, critical pressure goes down to min_frames.
+  // The pool unsubscribes when it is closed
+  void subscribe(MemoryPressure &pressure) {
+    size_t id = pressure.subscribe(
+        [this](PressureLevel level) { on_memory_pressure(level); });
+    std::unique_lock<std::mutex> lock{latch_};
+    pressure_subscriptions_.emplace_back(&pressure, id);
+  }
+
+  void on_memory_pressure(PressureLevel level) {
+    if (level == PressureLevel::kNone) {
+      return;
+    }
+    size_t frames = buffer_size();
+    size_t min = min_frames();
+    size_t target = level == PressureLevel::kCritical ? min : frames - frames / 4;
+    target = std::max(target, min);
+    if (target < frames) {
+      resize(target);
+    }
+  }
+  // @brief the decoded node kept for the pinned page, or nullptr. Readers of
+  // the page share it, a dirty unpin drops it
+  std::shared_ptr<const DecodedNode> decoded(const Page *page) const {
+    if (!decoded_) {
+      return nullptr;
+    }
+    return decoded_[page->frame].load(std::memory_order_acquire);
+  }
+  void set_decoded(const Page *page, std::shared_ptr<const DecodedNode> node) {
+    if (decoded_) {
+      decoded_[page->frame].store(std::move(node), std::memory_order_release);
+    }
+  }
+
+  size_t dirty_page_count() {
+    std::unique_lock<std::mutex> lock{latch_};
+    return dirty_count_;
+  }
+  BufferPoolStats stats() {
+    std::unique_lock<std::mutex> lock{latch_};
+    BufferPoolStats stats = stats_;
+    if (wal_) {
+      auto wal = wal_->stats();
+      stats.wal_commits = wal.commits;
+      stats.wal_syncs = wal.syncs;
+      stats.wal_bytes = wal.bytes;
+    }
+    return stats;
+  }
+
+  // An operation of the tree with the log on. Between begin_txn() and
+  // commit_txn() every dirty unpin copies the page's image aside, and none of
+  // the pages reaches the data file: a victim among them is dropped and read
+  // back from its copy. commit_txn() appends the images as one record. The
+  // caller waits for wait_durable() after it released its own locks, so the
+  // operations of other writers join the same log sync. Without the log
+  // these do nothing. One operation runs at a time.
+  void begin_txn() {
+    if (!wal_) {
+      return;
+    }
+    std::unique_lock<std::mutex> lock{latch_};
+    assert(!in_txn_);
+    in_txn_ = true;
+  }
+
+  // @brief return the lsn of the operation's record, 0 if nothing changed
+  Wal::Lsn commit_txn() {
+    if (!wal_) {
+      return 0;
+    }
+    std::unique_lock<std::mutex> lock{latch_};
+    in_txn_ = false;
+    std::vector<std::pair<int64_t, const char *>> images;
+    for (auto &[id, image] : txn_images_) {
+      images.emplace_back(id, image.data());
+    }
+    if (txn_meta_) {
+      images.emplace_back(0, meta_page_->data);
+    }
+    Wal::Lsn lsn = images.empty() ? 0 : wal_->append(images);
+    bool logged = false;
+    for (auto &[id, image] : txn_images_) {
+      if (Page *page = lookup(id)) {
+        page->in_txn = false;
+        page->lsn = lsn;
+        mark_dirty(page);
+        continue;
+      }
+      // dropped as a victim, the copy is the only one left. a large split
+      // does this, it is rare enough to sync here
+      if (!logged) {
+        logged = wal_->commit(lsn);
+      }
+      if (!logged || !disk_manager_->write_page(id, image.data())) {
+        LOG_DEBUG << "write page " << id << " failed";
+      }
+    }
+    if (txn_meta_) {
+      meta_lsn_ = lsn;
+      // a checkpoint may wait to write the meta page
+      io_cv_.notify_all();
+    }
+    txn_images_.clear();
+    txn_meta_ = false;
+    return lsn;
+  }
+
+  bool wait_durable(Wal::Lsn lsn) {
+    return !wal_ || lsn == 0 || wal_->commit(lsn);
+  }
+
+  // @brief: root page id of the tree saved in the meta page
+  PageId root() const {
+    assert(open_);
+    return meta_page_->root;
+  }
+
+  void set_root(PageId root) {
+    assert(open_);
+    std::unique_lock<std::mutex> lock{latch_};
+    meta_page_->root = root;
+    meta_changed();
+  }
+
 private:
-  // @brief: change the page id and reset the dirty bit
+  // the replacer must hold every frame of the pool
+  static ReplacerType make_replacer(size_t bfp_size) {
+    if constexpr (std::is_constructible_v<ReplacerType, size_t>) {
+      return ReplacerType(bfp_size);
+    } else {
+      return ReplacerType();
+    }
+  }
+
+  Page *fetch_locked(PageId page_id, std::unique_lock<std::mutex> &lock) {
+    assert(open_);
+
+    if (page_id == INVALID_PAGE_ID) {
+      assert(false);
+    }
+
+    while (true) {
+      // check if the page is in the buffer pool
+      if (Page *page = lookup(page_id)) {
+        // if the page is in the buffer pool, return the page
+        assert(page->id == page_id);
+        page->pin_count++;
+        replacer_.remove(page->frame);
+        count_hit(page);
+        // a coroutine's read or a prefetch is still filling the frame
+        io_cv_.wait(lock, [&] { return !page->loading; });
+        return page;
+      }
+
+      // the flusher is still writing the page which was evicted
+      if (is_writing(page_id)) {
+        io_cv_.wait(lock);
+        continue;
+      }
+
+      // fetch from replacer
+      size_t idx;
+      bool found = replacer_.victim(idx);
+      if (!found && prefetching_ > 0) {
+        // the frames of prefetches become victims when the reads complete
+        io_cv_.wait(lock);
+        continue;
+      }
+      if (!found) {
+        LOG_DEBUG << "replacer is empty";
+        return nullptr;
+      }
+
+      Page *new_page = &pages_[idx];
+      if (new_page->dirty == 1 && is_writing(new_page->id)) {
+        // the victim was modified again after the flusher copied it, the newer
+        // data must reach the disk after the older one
+        wait_writing(new_page->id, lock);
+        // the latch was released, another thread may have read page_id into
+        // another frame or fetched the victim. look again
+        if (new_page->pin_count == 0) {
+          replacer_.put(idx);
+        }
+        continue;
+      }
+
+      stats_.misses++;
+      if (new_page->dirty == 1) {
+        stats_.dirty_evictions++;
+        write_locked(new_page);
+      }
+
+      change_page(new_page, page_id);
+
+      auto ok = load_locked(new_page, page_id);
+      new_page->pin_count = 1;
+      new_page->deserialize();
+      new_page->id = page_id;
+      // TODO need to handle the error ?
+      return new_page;
+    }
+  }
+
+  // return true if the awaiter is suspended, it is resumed with the pinned
+  // page, or with nullptr if it has to try again
+  bool begin_async_fetch(FetchAwaiter &awaiter,
+                         std::unique_lock<std::mutex> &lock) {
+    PageId page_id = awaiter.page_id_;
+    while (true) {
+      if (Page *page = lookup(page_id)) {
+        page->pin_count++;
+        replacer_.remove(page->frame);
+        count_hit(page);
+        awaiter.page_ = page;
+        if (page->loading) {
+          page->waiters.push_back([&awaiter] { awaiter.resume(); });
+          return true;
+        }
+        return false;
+      }
+
+      if (is_writing(page_id)) {
+        io_cv_.wait(lock);
+        continue;
+      }
+
+      size_t idx;
+      if (!replacer_.victim(idx)) {
+        // every frame is pinned, wait for an unpin
+        frame_waiters_.push_back(&awaiter);
+        return true;
+      }
+
+      Page *page = &pages_[idx];
+      if (page->dirty == 1 && is_writing(page->id)) {
+        wait_writing(page->id, lock);
+        // look again, as in fetch_locked()
+        if (page->pin_count == 0) {
+          replacer_.put(idx);
+        }
+        continue;
+      }
+
+      stats_.misses++;
+      if (page->dirty == 1) {
+        stats_.dirty_evictions++;
+        write_locked(page);
+      }
+
+      change_page(page, page_id);
+      page->pin_count = 1;
+      awaiter.page_ = page;
+      if (txn_images_.count(page_id)) {
+        load_locked(page, page_id);
+        page->deserialize();
+        page->id = page_id;
+        return false;
+      }
+      page->loading = true;
+      page->waiters.push_back([&awaiter] { awaiter.resume(); });
+
+      disk_manager_->async_read_page(
+          page_id, page->data, [this, page, page_id](bool ok) {
+            finish_load(page, page_id, ok, false);
+          });
+      return true;
+    }
+  }
+
+  // called on an io thread when the read of a frame completes, a prefetch
+  // drops the pin of the read
+  void finish_load(Page *page, PageId page_id, bool ok, bool prefetched) {
+    if (!ok) {
+      LOG_DEBUG << "read page " << page_id << " failed";
+    }
+    std::vector<std::function<void()>> waiters;
+    {
+      std::unique_lock<std::mutex> lock{latch_};
+      page->deserialize();
+      page->id = page_id;
+      page->loading = false;
+      waiters.swap(page->waiters);
+      if (prefetched) {
+        prefetching_--;
+        if (--page->pin_count == 0) {
+          unpinned_locked(page);
+        }
+      }
+      io_cv_.notify_all();
+    }
+    for (auto &w : waiters) {
+      w();
+    }
+  }
+
+  void write_dirty_locked() {
+    std::vector<Page *> dirty;
+    Wal::Lsn lsn = 0;
+    for (auto &page : pages_) {
+      // the operation in progress hasn't logged its pages
+      if (page.dirty == 1 && !page.in_txn) {
+        dirty.push_back(&page);
+        lsn = std::max(lsn, page.lsn);
+      }
+    }
+    std::sort(dirty.begin(), dirty.end(),
+              [](Page *a, Page *b) { return a->id < b->id; });
+    log_before_write(lsn);
+
+    std::vector<char *> run;
+    for (size_t i = 0, j = 0; i < dirty.size(); i = j) {
+      run.clear();
+      do {
+        dirty[j]->serliaze();
+        run.push_back(dirty[j]->data);
+        ++j;
+      } while (j < dirty.size() && dirty[j]->id == dirty[j - 1]->id + 1);
+
+      if (!disk_manager_->write_pages(dirty[i]->id, run)) {
+        LOG_DEBUG << "write pages from " << dirty[i]->id << " failed";
+        continue;
+      }
+      for (size_t k = i; k < j; ++k) {
+        mark_clean(dirty[k]);
+      }
+    }
+  }
+
+  void write_locked(Page *page) {
+    if (page->in_txn) {
+      // the copy in txn_images_ stands in for the page until the commit
+      mark_clean(page);
+      return;
+    }
+    LOG_DEBUG << "flush page " << page->id;
+    log_before_write(page->lsn);
+    page->serliaze();
+    bool ok = disk_manager_->write_page(page->id, page->data);
+    if (ok) {
+      mark_clean(page);
+    } else {
+      LOG_DEBUG << page->id << " flush failed";
+    }
+  }
+
+  void mark_dirty(Page *page) {
+    if (page->dirty == 0) {
+      page->dirty = 1;
+      page->dirty_since = ++dirty_seq_;
+      ++dirty_count_;
+      if (flusher_.joinable() &&
+          dirty_count_ > options_.dirty_high_watermark * pages_.size()) {
+        flush_cv_.notify_one();
+      }
+    }
+  }
+
+  void mark_clean(Page *page) {
+    if (page->dirty == 1) {
+      page->dirty = 0;
+      --dirty_count_;
+    }
+  }
+
+  bool is_writing(PageId page_id) const {
+    return std::find(writing_.begin(), writing_.end(), page_id) !=
+           writing_.end();
+  }
+
+  void wait_writing(PageId page_id, std::unique_lock<std::mutex> &lock) {
+    io_cv_.wait(lock, [&] { return !is_writing(page_id); });
+  }
+
+  void flusher_loop() {
+    std::unique_lock<std::mutex> lock{latch_};
+    auto over_high = [&] {
+      return options_.background_flush &&
+             dirty_count_ > options_.dirty_high_watermark * pages_.size();
+    };
+    auto checkpoint_due = [&] {
+      return wal_ && options_.wal.checkpoint_bytes > 0 &&
+             wal_->bytes() > options_.wal.checkpoint_bytes;
+    };
+    // every dirty frame was pinned or being written, waiting on over_high()
+    // would spin without ever releasing the latch
+    bool stalled = false;
+    while (!stop_flusher_) {
+      flush_cv_.wait_for(lock, options_.flush_interval, [&] {
+        return stop_flusher_ || (!stalled && over_high()) || checkpoint_due();
+      });
+      stalled = false;
+      if (!stop_flusher_ && checkpoint_due()) {
+        fuzzy_checkpoint(lock);
+      }
+      if (stop_flusher_ || !over_high()) {
+        continue;
+      }
+      size_t low = options_.dirty_low_watermark * pages_.size();
+      while (!stop_flusher_ && dirty_count_ > low) {
+        if (!flush_round(low, lock)) {
+          stalled = true;
+          break;
+        }
+      }
+    }
+  }
+
+  // Checkpoint while the tree is in use. The log is rotated, the pages
+  // dirty with a change in the old segments are the dirty page table, and
+  // they are written in rounds of flush_batch like the flusher writes, so
+  // no foreground operation waits for more than a round's copy. A page
+  // which is pinned or changed by the operation in progress is retried, one
+  // changed again is logged in the new segment and leaves the table. Then
+  // the data file is synced, the meta page moves the marker to the new
+  // segment and the old ones are dropped. Called on the flusher thread.
+  void fuzzy_checkpoint(std::unique_lock<std::mutex> &lock) {
+    lock.unlock();
+    Wal::Lsn end = wal_->rotate();
+    uint64_t seq = wal_->segment();
+    lock.lock();
+
+    std::vector<PageId> table;
+    for (auto &page : pages_) {
+      if (page.dirty == 1 && page.lsn <= end) {
+        table.push_back(page.id);
+      }
+    }
+    std::sort(table.begin(), table.end());
+    while (!table.empty()) {
+      if (stop_flusher_) {
+        // close() checkpoints everything
+        return;
+      }
+      std::vector<Page *> batch;
+      std::vector<PageId> retry;
+      for (PageId id : table) {
+        Page *page = lookup(id);
+        if (!page || page->dirty == 0 || page->lsn > end) {
+          // written back, or changed again
+          continue;
+        }
+        if (page->pin_count > 0 || page->in_txn || is_writing(id) ||
+            batch.size() == options_.flush_batch) {
+          retry.push_back(id);
+          continue;
+        }
+        batch.push_back(page);
+      }
+      table.swap(retry);
+      if (batch.empty()) {
+        if (!table.empty()) {
+          io_cv_.wait_for(lock, options_.flush_interval);
+        }
+        continue;
+      }
+      write_batch(batch, lock);
+    }
+
+    // the meta page of an operation in progress waits for its commit
+    io_cv_.wait(lock, [&] {
+      return stop_flusher_ || (!txn_meta_ && !is_writing(0));
+    });
+    if (stop_flusher_) {
+      return;
+    }
+    meta_page_->checkpoint = std::max(meta_page_->checkpoint, seq);
+    meta_page_->serliaze();
+    std::memcpy(staging(0), meta_page_->data, PAGE_SIZE);
+    Wal::Lsn lsn = meta_lsn_;
+    writing_.push_back(0);
+    lock.unlock();
+    log_before_write(lsn);
+    bool ok = disk_manager_->sync() &&
+              disk_manager_->write_page(0, staging(0)) &&
+              disk_manager_->sync();
+    if (ok) {
+      wal_->drop_before(seq);
+    }
+    lock.lock();
+    writing_.erase(std::find(writing_.begin(), writing_.end(), 0));
+    stats_.checkpoints += ok;
+    io_cv_.notify_all();
+  }
+
+  // write the oldest unpinned dirty frames, the data is copied under the latch
+  // and written without it, so fetch() is never blocked by the write. return
+  // false if there is nothing to write.
+  bool flush_round(size_t low, std::unique_lock<std::mutex> &lock) {
+    std::vector<Page *> dirty;
+    for (auto &page : pages_) {
+      if (page.dirty == 1 && page.pin_count == 0 && !is_writing(page.id) &&
+          !page.in_txn) {
+        dirty.push_back(&page);
+      }
+    }
+    if (dirty.empty()) {
+      return false;
+    }
+    std::sort(dirty.begin(), dirty.end(), [](Page *l, Page *r) {
+      return l->dirty_since < r->dirty_since;
+    });
+
+    size_t n = std::min({dirty_count_ - low, options_.flush_batch,
+                         dirty.size()});
+    dirty.resize(n);
+    write_batch(dirty, lock);
+    return true;
+  }
+
+  // copy the pages to the staging buffer and write them without the latch
+  void write_batch(const std::vector<Page *> &pages,
+                   std::unique_lock<std::mutex> &lock) {
+    size_t n = pages.size();
+    std::vector<std::pair<PageId, uint64_t>> batch;
+    Wal::Lsn lsn = 0;
+    for (size_t i = 0; i < n; ++i) {
+      Page *page = pages[i];
+      lsn = std::max(lsn, page->lsn);
+      page->serliaze();
+      std::memcpy(staging(i), page->data, PAGE_SIZE);
+      batch.emplace_back(page->id, page->version);
+      writing_.push_back(page->id);
+    }
+
+    lock.unlock();
+    log_before_write(lsn);
+    // the whole batch is in flight together
+    std::vector<char> ok(n);
+    std::latch done(n);
+    std::vector<IoRequest> reqs;
+    for (size_t i = 0; i < n; ++i) {
+      reqs.push_back(DiskManager::page_request(
+          IoRequest::Op::kWrite, batch[i].first,
+          staging(i), [&ok, &done, i](bool res) {
+            ok[i] = res;
+            done.count_down();
+          }));
+    }
+    disk_manager_->submit(std::move(reqs));
+    done.wait();
+    lock.lock();
+
+    for (size_t i = 0; i < n; ++i) {
+      auto [page_id, version] = batch[i];
+      writing_.erase(std::find(writing_.begin(), writing_.end(), page_id));
+      Page *page = lookup(page_id);
+      // clean only if it was not modified during the write
+      if (ok[i] && page && page->version == version) {
+        mark_clean(page);
+      }
+      stats_.background_writes += ok[i];
+    }
+    io_cv_.notify_all();
+  }
+
+  void stop_flusher() {
+    if (!flusher_.joinable()) {
+      return;
+    }
+    {
+      std::unique_lock<std::mutex> lock{latch_};
+      stop_flusher_ = true;
+    }
+    flush_cv_.notify_one();
+    // a checkpoint may be waiting for a page
+    io_cv_.notify_all();
+    flusher_.join();
+  }
+
+  // the last pin of the page was dropped
+  void unpinned_locked(Page *page) {
+    if (page->frame >= bfp_size_) {
+      // resize() is waiting to drop the frame
+      io_cv_.notify_all();
+      return;
+    }
+    replacer_.put(page->frame);
+    if (!frame_waiters_.empty()) {
+      // a coroutine is waiting for a victim
+      frame_waiters_.front()->resume();
+      frame_waiters_.pop_front();
+    }
+  }
+
+  void count_hit(Page *page) {
+    stats_.hits++;
+    if (page->prefetched) {
+      page->prefetched = false;
+      stats_.prefetch_hits++;
+    }
+  }
+
+  // tell a replacer which keeps a history of pages what the frame holds now
+  void bind_frame(size_t idx, PageId page_id) {
+    if constexpr (requires { replacer_.bind(idx, page_id); }) {
+      replacer_.bind(idx, page_id);
+    }
+  }
+
+  // the frame holding page_id, or nullptr
+  Page *lookup(PageId page_id) {
+    size_t idx = page_table_.find(page_id);
+    return idx == PageTable::npos ? nullptr : &pages_[idx];
+  }
+
+  // @brief: change the page id, remap the frame and reset the dirty bit
+  void meta_changed() {
+    meta_page_->serliaze();
+    meta_page_->dirty = 1;
+    if (in_txn_) {
+      txn_meta_ = true;
+    }
+  }
+
+  // the meta page holds MAX_FREE_LIST_SIZE free pages, the others are kept
+  // here, used first and written to the free list pages by close()
+  void push_free_locked(PageId page_id) {
+    if (!meta_page_->push_free_page(page_id)) {
+      free_overflow_.push_back(page_id);
+    }
+  }
+
+  PageId pop_free_locked() {
+    if (!free_overflow_.empty()) {
+      PageId page_id = free_overflow_.back();
+      free_overflow_.pop_back();
+      return page_id;
+    }
+    return meta_page_->pop_free_page();
+  }
+
+  // copy the image of a page the operation in progress changed
+  void txn_image_locked(Page *page) {
+    page->serliaze();
+    page->in_txn = true;
+    auto &image = txn_images_[page->id];
+    image.assign(page->data, page->data + PAGE_SIZE);
+  }
+
+  // read the page into the frame, a page of the operation in progress from
+  // its copy
+  bool load_locked(Page *page, PageId page_id) {
+    if (auto it = txn_images_.find(page_id); it != txn_images_.end()) {
+      std::memcpy(page->data, it->second.data(), PAGE_SIZE);
+      page->in_txn = true;
+      return true;
+    }
+    return disk_manager_->read_page(page_id, page->data);
+  }
+
+  // the log is written up to lsn before a page of it is
+  void log_before_write(Wal::Lsn lsn) {
+    if (wal_ && lsn > 0) {
+      wal_->commit(lsn);
+    }
+  }
+
   void change_page(Page *page, PageId page_id) {
-    page_index_.erase(page->id);
-    page_map_.erase(page->id);
+    if (lookup(page->id) == page) {
+      page_table_.erase(page->id);
+    }
+    page_table_.insert(page_id, page->frame);
+    bind_frame(page->frame, page_id);
     page->id = page_id;
-    page->dirty = 0;
+    mark_clean(page);
     page->pin_count = 0;
+    page->prefetched = false;
+    page->lsn = 0;
+    page->in_txn = false;
+    // the frame and its version name what it holds
+    page->version++;
+    drop_decoded(page);
     page->serliaze();
   }
 
-  // new a free list page
-  PageId new_free_list_page() { throw std::runtime_error("unimplemented"); }
+  void drop_decoded(Page *page) {
+    if (decoded_) {
+      decoded_[page->frame].store(nullptr, std::memory_order_release);
+    }
+  }
+
+  // the meta page on the disk is of this layout, and copy-on-write mode
+  // isn't asked to read write buffers. a meta page which was never written
+  // is left to the redo
+  std::error_code check_format() {
+    std::vector<char> data(PAGE_SIZE);
+    if (!disk_manager_->read_page(0, data.data()) ||
+        std::all_of(data.begin(), data.end(), [](char c) { return c == 0; })) {
+      return std::error_code();
+    }
+    BfpMetaPage meta(data.data());
+    meta.deserialize();
+    if (!meta.valid()) {
+      return std::make_error_code(std::errc::not_supported);
+    }
+    if (options_.cow.enabled && meta.write_buffer > 0) {
+      return std::make_error_code(std::errc::invalid_argument);
+    }
+    return std::error_code();
+  }
+
+  // the arena up to min_frames is registered as one fixed buffer of the io
+  // backend. the registration pins the memory, so the frames memory pressure
+  // may drop and the frames added by resize() are left out and use the plain
+  // opcodes
+  void register_frames() {
+    size_t frames = frame_base() + std::min(bfp_size_, min_frames());
+    bool ok = disk_manager_->io().register_buffers(
+        {{arena_.data(), frames * PAGE_SIZE}});
+    registered_ = ok ? frames : 0;
+  }
+
+  size_t min_frames() const {
+    return options_.min_frames ? options_.min_frames
+                               : std::max<size_t>(max_frames_ / 4, 1);
+  }
+
+  // arena index of the first frame
+  size_t frame_base() const { return 1 + options_.flush_batch; }
+
+  // the flusher copies the i-th page of a batch here
+  char *staging(size_t i) const { return arena_.frame(1 + i); }
+
+  // @brief write the free pages the meta page has no room for into pages of
+  // the meta page's layout, chained from its next. the pages of the list are
+  // free pages themselves
+  void save_free_list() {
+    if (free_overflow_.empty()) {
+      return;
+    }
+    std::vector<char> data(PAGE_SIZE);
+    PageId next = 0;
+    while (!free_overflow_.empty()) {
+      std::fill(data.begin(), data.end(), 0);
+      BfpMetaPage list(data.data());
+      list.id = free_overflow_.back();
+      free_overflow_.pop_back();
+      list.next = next;
+      while (!free_overflow_.empty() &&
+             list.push_free_page(free_overflow_.back())) {
+        free_overflow_.pop_back();
+      }
+      list.serliaze();
+      if (!disk_manager_->write_page(list.id, data.data())) {
+        // this page and the ones not written yet are lost
+        LOG_DEBUG << "free list page write fail! page id : " << list.id;
+        break;
+      }
+      next = list.id;
+    }
+    free_overflow_.clear();
+    // the list is on the disk before the meta page refers to it
+    disk_manager_->sync();
+    meta_page_->next = next;
+    meta_page_->serliaze();
+    if (write_meta()) {
+      disk_manager_->sync();
+    }
+  }
+
+  // @brief read the free list pages of save_free_list() back into
+  // free_overflow_. the meta page forgets them right away: the pages are
+  // reused before the next close, a crash loses the list and leaks its pages
+  // instead of handing out a page twice
+  void load_free_list() {
+    free_overflow_.clear();
+    if (meta_page_->next == 0) {
+      return;
+    }
+    std::vector<char> data(PAGE_SIZE);
+    PageId next = meta_page_->next;
+    // a damaged list may loop
+    size_t pages = 0;
+    while (next > 0 && pages++ <= meta_page_->page_count &&
+           disk_manager_->read_page(next, data.data())) {
+      BfpMetaPage list(data.data());
+      list.deserialize();
+      if (list.id != next ||
+          list.free_list_size > BfpMetaPage::MAX_FREE_LIST_SIZE) {
+        LOG_DEBUG << "bad free list page : " << next;
+        break;
+      }
+      free_overflow_.push_back(next);
+      for (size_t i = 0; i < list.free_list_size; ++i) {
+        free_overflow_.push_back(list[i]);
+      }
+      next = list.next;
+    }
+    meta_page_->next = 0;
+    meta_page_->serliaze();
+    if (write_meta()) {
+      disk_manager_->sync();
+    }
+  }
 
   bool open_ = false;
 
   ReplacerType replacer_;
   std::unique_ptr<BfpMetaPage> meta_page_ = nullptr;
-  std::unique_ptr<BfpMetaPage> free_list_page_ =
-      nullptr; // just like a linked list
-  std::vector<std::unique_ptr<Page>> pages_;
+  // the meta page, the staging buffer of the flusher and the frames
+  FrameArena arena_;
+  // meta data of the frames, pages_[i] is frame_base() + i of the arena
+  std::vector<Page> pages_;
 
   std::unique_ptr<DiskManager> disk_manager_;
 
-  std::map<PageId, size_t> page_index_;
-  std::map<PageId, Page *> page_map_;
+  PageTable page_table_;
 
   std::string name_;
+  // frames in use, frames from bfp_size_ on are being dropped by resize()
   size_t bfp_size_;
+  size_t max_frames_;
+  // arena frames registered with the io backend, resize() never releases them
+  size_t registered_ = 0;
+  BufferPoolOptions options_;
+  std::mutex resize_mutex_;
+  std::vector<std::pair<MemoryPressure *, size_t>> pressure_subscriptions_;
+
+  // protects the page table, the replacer and the frames' meta data
+  std::mutex latch_;
+  BufferPoolStats stats_;
+
+  // dirty frames, dirty_seq_ orders them by the time they became dirty
+  size_t dirty_count_ = 0;
+  uint64_t dirty_seq_ = 0;
+  // reads of prefetch() in flight
+  size_t prefetching_ = 0;
+
+  std::unique_ptr<Wal> wal_;
+  std::vector<PageId> free_overflow_;
+  // the operation in progress, see begin_txn()
+  bool in_txn_ = false;
+  std::unordered_map<PageId, std::vector<char>> txn_images_;
+  bool txn_meta_ = false;
+  Wal::Lsn meta_lsn_ = 0;
+
+  // decoded nodes by frame, they are read without the latch
+  using DecodedSlot = std::atomic<std::shared_ptr<const DecodedNode>>;
+  std::unique_ptr<DecodedSlot[]> decoded_;
+
+  // background flusher
+  std::thread flusher_;
+  bool stop_flusher_ = false;
+  std::condition_variable flush_cv_;
+  // pages being written by the flusher without the latch
+  std::vector<PageId> writing_;
+  std::condition_variable io_cv_;
+
+  // coroutines waiting for a frame to become a victim
+  std::deque<FetchAwaiter *> frame_waiters_;
+
+public:
+  class FetchAwaiter {
+  public:
+    FetchAwaiter(DefaultBufferPool &pool, PageId page_id)
+        : pool_(pool), page_id_(page_id) {}
+
+    bool await_ready() const noexcept { return false; }
+
+    bool await_suspend(std::coroutine_handle<> h) {
+      scheduler_ = Scheduler::current();
+      handle_ = h;
+      if (scheduler_ == nullptr) {
+        page_ = pool_.fetch(page_id_);
+        return false;
+      }
+      std::unique_lock<std::mutex> lock{pool_.latch_};
+      return pool_.begin_async_fetch(*this, lock);
+    }
+
+    Page *await_resume() const noexcept { return page_; }
+
+  private:
+    friend class DefaultBufferPool;
+
+    void resume() { scheduler_->schedule(handle_); }
+
+    DefaultBufferPool &pool_;
+    PageId page_id_;
+    Page *page_ = nullptr;
+    Scheduler *scheduler_ = nullptr;
+    std::coroutine_handle<> handle_;
+  };
 };
 
 inline bool DiskManager::read_page(PageId id, char *dst) {
-  std::unique_lock<std::mutex> lock{mutex_};
-  size_t file_size = std::filesystem::file_size(db_filename_);
-  unsigned long offset = id * PAGE_SIZE;
-  if (offset <= file_size) {
-    fseek(db_io_, offset, SEEK_SET);
-    size_t read_size =
-        file_size - offset > PAGE_SIZE ? PAGE_SIZE : file_size - offset;
-    auto count = fread(dst, read_size, 1, db_io_);
-    if (count != 1) {
+  size_t offset = id * PAGE_SIZE;
+  size_t done = 0;
+  while (done < PAGE_SIZE) {
+    ssize_t n = pread(fd_, dst + done, PAGE_SIZE - done, offset + done);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n < 0) {
+      LOG_DEBUG << "pread fail! page id : " << id;
       return false;
     }
-    return true;
+    if (n == 0) {
+      break;
+    }
+    done += n;
+  }
+  if (done == 0) {
+    // past the end of the file
+    return false;
   }
-  return false;
+  std::memset(dst + done, 0, PAGE_SIZE - done);
+  return true;
 }
 
 inline bool DiskManager::write_page(PageId id, char *src) {
-  std::unique_lock<std::mutex> lock{mutex_};
-
   size_t offset = id * PAGE_SIZE;
+  extend(offset + PAGE_SIZE);
+  size_t done = 0;
+  while (done < PAGE_SIZE) {
+    ssize_t n = pwrite(fd_, src + done, PAGE_SIZE - done, offset + done);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      LOG_DEBUG << "pwrite fail! page id : " << id;
+      return false;
+    }
+    done += n;
+  }
+  return true;
+}
 
-  int seek = fseek(db_io_, offset, SEEK_SET);
-  if (seek != 0) {
-    LOG_DEBUG << "fseek fail!"
-              << "Reason maybe is file size is not enough. "
-              << "Page id : " << id << ". Seek offset : " << offset
-              << ". File size : " << std::filesystem::file_size(db_filename_)
-              << ". Write will still continue";
-    // return false;
+inline void DiskManager::extend(size_t end) {
+  size_t size = file_size_;
+  while (end > size && !file_size_.compare_exchange_weak(size, end)) {
   }
 
-  size_t count = fwrite(src, PAGE_SIZE, 1, db_io_);
-  if (count != 1) {
-    LOG_DEBUG << "fwrite fail!";
-    return false;
+#ifdef FALLOC_FL_KEEP_SIZE
+  if (extend_chunk_ == 0 || !preallocate_) {
+    return;
+  }
+  size_t allocated = allocated_;
+  while (end > allocated) {
+    size_t target = (end + extend_chunk_ - 1) / extend_chunk_ * extend_chunk_;
+    if (allocated_.compare_exchange_weak(allocated, target)) {
+      // the file size stays at the written end, only the blocks are reserved
+      if (fallocate(fd_, FALLOC_FL_KEEP_SIZE, allocated, target - allocated) !=
+          0) {
+        LOG_DEBUG << "fallocate is not supported";
+        preallocate_ = false;
+      }
+      break;
+    }
+  }
+#endif
+}
+
+inline bool DiskManager::write_pages(PageId first,
+                                     const std::vector<char *> &pages) {
+#ifdef IOV_MAX
+  constexpr size_t kMaxIov = IOV_MAX;
+#else
+  constexpr size_t kMaxIov = 1024;
+#endif
+  std::vector<iovec> iov(pages.size());
+  for (size_t i = 0; i < pages.size(); ++i) {
+    iov[i].iov_base = pages[i];
+    iov[i].iov_len = PAGE_SIZE;
   }
 
-  return fflush(db_io_) == 0;
+  off_t offset = first * PAGE_SIZE;
+  extend(offset + pages.size() * PAGE_SIZE);
+  size_t idx = 0;
+  while (idx < iov.size()) {
+    int count = std::min(iov.size() - idx, kMaxIov);
+    ssize_t n = pwritev(fd_, &iov[idx], count, offset);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      LOG_DEBUG << "pwritev fail!";
+      return false;
+    }
+    offset += n;
+    // a short write continues inside an iovec
+    for (size_t left = n; left > 0;) {
+      if (left >= iov[idx].iov_len) {
+        left -= iov[idx].iov_len;
+        ++idx;
+      } else {
+        iov[idx].iov_base = static_cast<char *>(iov[idx].iov_base) + left;
+        iov[idx].iov_len -= left;
+        left = 0;
+      }
+    }
+  }
+  return true;
 }
 
 inline void DiskManager::close() {
-  std::unique_lock<std::mutex> lock{mutex_};
-  if (db_io_ && close_ == false) {
-    fclose(db_io_);
+  if (fd_ >= 0 && close_ == false) {
+    io_.reset();
+    if (direct_fd_ >= 0) {
+      ::close(direct_fd_);
+    }
+    ::close(fd_);
     close_ = true;
   }
 }
 
-using BufferPool = DefaultBufferPool<LruReplacer<size_t>>;
\ No newline at end of file
+using BufferPool = DefaultBufferPool<ClockReplacer<size_t>>;
\ No newline at end of file
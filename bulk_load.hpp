@@ -0,0 +1,123 @@
+#pragma once
+#include <chrono>
+#include <cstddef>
+#include <functional>
+#include <system_error>
+
+#include "bplus_tree.hpp"
+#include "external_sort.hpp"
+
+struct BulkLoadProgress {
+  enum class Phase { kSort, kBuild, kDone };
+
+  Phase phase = Phase::kSort;
+  size_t records = 0; // records added or written to leaves
+  size_t bytes = 0;   // key and value bytes of the records
+  size_t runs = 0;    // sorted runs spilled to the temp dir
+  double seconds = 0; // since the loader was created
+
+  double records_per_sec() const { return seconds > 0 ? records / seconds : 0; }
+  double mb_per_sec() const {
+    return seconds > 0 ? bytes / seconds / (1 << 20) : 0;
+  }
+};
+
+struct BulkLoadOptions {
+  ExternalSorter::Options sort;
+  // leaves and internal nodes are filled up to PAGE_SIZE * fill_factor
+  double fill_factor = 0.9;
+  // report every progress_interval records, and once when a phase ends. 0
+  // reports only the ends of the phases
+  size_t progress_interval = 1 << 20;
+  std::function<void(const BulkLoadProgress &)> progress;
+};
+
+// Build the index of an empty tree from unsorted records:
+//
+//   BulkLoader loader{tree};
+//   for (...) loader.add(key, val);
+//   loader.finish();
+//
+// The records are sorted by ExternalSorter, and the sorted stream is written
+// bottom-up by BPlusTree::bulk_build, so no record goes through a tree descent.
+class BulkLoader {
+public:
+  explicit BulkLoader(BPlusTree &tree, BulkLoadOptions options = {})
+      : tree_(tree), options_(std::move(options)), sorter_(options_.sort),
+        start_(std::chrono::steady_clock::now()) {}
+
+  template <typename K, typename V> void add(const K &key, const V &val) {
+    add(bytes(key.begin(), key.end()), bytes(val.begin(), val.end()));
+  }
+
+  void add(key_type key, value_type val) {
+    sorter_.add(std::move(key), std::move(val));
+    if (due(sorter_.records())) {
+      report(BulkLoadProgress::Phase::kSort, sorter_.records(),
+             sorter_.bytes_added());
+    }
+  }
+
+  std::error_code finish() {
+    if (!tree_.empty()) {
+      return std::make_error_code(std::errc::file_exists);
+    }
+
+    try {
+      sorter_.finish();
+      report(BulkLoadProgress::Phase::kSort, sorter_.records(),
+             sorter_.bytes_added());
+
+      auto merger = sorter_.merge();
+      size_t written = 0, written_bytes = 0;
+      bool ok = tree_.bulk_build(
+          [&](key_type &k, value_type &v) {
+            if (!merger.next(k, v)) {
+              return false;
+            }
+            ++written;
+            written_bytes += k.size() + v.size();
+            if (due(written)) {
+              report(BulkLoadProgress::Phase::kBuild, written, written_bytes);
+            }
+            return true;
+          },
+          options_.fill_factor);
+
+      report(BulkLoadProgress::Phase::kDone, written, written_bytes);
+      if (!ok) {
+        return std::make_error_code(std::errc::no_buffer_space);
+      }
+    } catch (const std::exception &e) {
+      LOG_DEBUG << "bulk load failed : " << e.what();
+      return std::make_error_code(std::errc::io_error);
+    }
+    return std::error_code();
+  }
+
+private:
+  bool due(size_t records) const {
+    return options_.progress_interval > 0 &&
+           records % options_.progress_interval == 0;
+  }
+
+  void report(BulkLoadProgress::Phase phase, size_t records, size_t bytes) {
+    if (!options_.progress) {
+      return;
+    }
+    BulkLoadProgress p;
+    p.phase = phase;
+    p.records = records;
+    p.bytes = bytes;
+    p.runs = sorter_.spilled_runs();
+    p.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                              start_)
+                    .count();
+    options_.progress(p);
+  }
+
+  BPlusTree &tree_;
+  BulkLoadOptions options_;
+  ExternalSorter sorter_;
+  std::chrono::steady_clock::time_point start_;
+};
@@ -0,0 +1,249 @@
+#pragma once
+#include <condition_variable>
+#include <coroutine>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <future>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+template <typename T> class Task;
+
+namespace detail {
+
+struct TaskPromiseBase {
+  // resumed when the task completes
+  std::coroutine_handle<> continuation = std::noop_coroutine();
+  std::exception_ptr error;
+
+  struct FinalAwaiter {
+    bool await_ready() noexcept { return false; }
+    template <typename P>
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<P> h) noexcept {
+      return h.promise().continuation;
+    }
+    void await_resume() noexcept {}
+  };
+
+  std::suspend_always initial_suspend() noexcept { return {}; }
+  FinalAwaiter final_suspend() noexcept { return {}; }
+  void unhandled_exception() { error = std::current_exception(); }
+};
+
+template <typename T> struct TaskPromise : TaskPromiseBase {
+  std::optional<T> value;
+
+  Task<T> get_return_object();
+  void return_value(T v) { value = std::move(v); }
+  T result() {
+    if (error) {
+      std::rethrow_exception(error);
+    }
+    return std::move(*value);
+  }
+};
+
+template <> struct TaskPromise<void> : TaskPromiseBase {
+  Task<void> get_return_object();
+  void return_void() {}
+  void result() {
+    if (error) {
+      std::rethrow_exception(error);
+    }
+  }
+};
+
+} // namespace detail
+
+// A lazy coroutine, it starts when it is awaited and resumes the awaiting
+// coroutine when it completes.
+template <typename T = void> class Task {
+public:
+  using promise_type = detail::TaskPromise<T>;
+  using handle_type = std::coroutine_handle<promise_type>;
+
+  explicit Task(handle_type h) : handle_(h) {}
+  Task(Task &&other) noexcept : handle_(std::exchange(other.handle_, {})) {}
+  Task &operator=(Task &&other) noexcept {
+    if (this != &other) {
+      if (handle_) {
+        handle_.destroy();
+      }
+      handle_ = std::exchange(other.handle_, {});
+    }
+    return *this;
+  }
+  Task(const Task &) = delete;
+  Task &operator=(const Task &) = delete;
+  ~Task() {
+    if (handle_) {
+      handle_.destroy();
+    }
+  }
+
+  bool await_ready() const noexcept { return false; }
+  std::coroutine_handle<> await_suspend(std::coroutine_handle<> h) noexcept {
+    handle_.promise().continuation = h;
+    return handle_;
+  }
+  T await_resume() { return handle_.promise().result(); }
+
+private:
+  handle_type handle_;
+};
+
+namespace detail {
+
+template <typename T> Task<T> TaskPromise<T>::get_return_object() {
+  return Task<T>(std::coroutine_handle<TaskPromise<T>>::from_promise(*this));
+}
+
+inline Task<void> TaskPromise<void>::get_return_object() {
+  return Task<void>(
+      std::coroutine_handle<TaskPromise<void>>::from_promise(*this));
+}
+
+// starts at once and destroys itself when it completes
+struct Detached {
+  struct promise_type {
+    Detached get_return_object() { return {}; }
+    std::suspend_never initial_suspend() noexcept { return {}; }
+    std::suspend_never final_suspend() noexcept { return {}; }
+    void return_void() {}
+    void unhandled_exception() { std::terminate(); }
+  };
+};
+
+} // namespace detail
+
+// Runs coroutines on a few worker threads. A coroutine which waits for io is
+// scheduled again by the io completion, so thousands of them can be
+// outstanding while only the workers are threads.
+class Scheduler {
+public:
+  explicit Scheduler(size_t threads = 1) {
+    if (threads == 0) {
+      threads = 1;
+    }
+    for (size_t i = 0; i < threads; ++i) {
+      workers_.emplace_back([this] { work(); });
+    }
+  }
+
+  ~Scheduler() {
+    wait();
+    {
+      std::unique_lock<std::mutex> lock{mutex_};
+      stop_ = true;
+    }
+    cv_.notify_all();
+    for (auto &w : workers_) {
+      w.join();
+    }
+  }
+
+  Scheduler(const Scheduler &) = delete;
+  Scheduler &operator=(const Scheduler &) = delete;
+
+  // @brief resume h on a worker
+  void schedule(std::coroutine_handle<> h) {
+    {
+      std::unique_lock<std::mutex> lock{mutex_};
+      queue_.push_back(h);
+    }
+    cv_.notify_one();
+  }
+
+  // @brief run the task on the workers without waiting for it
+  void spawn(Task<void> task) {
+    {
+      std::unique_lock<std::mutex> lock{mutex_};
+      ++outstanding_;
+    }
+    run(std::move(task));
+  }
+
+  // @brief run the task on the workers and wait for its result
+  template <typename T> T block_on(Task<T> task) {
+    std::promise<T> result;
+    auto future = result.get_future();
+    spawn(complete(std::move(task), result));
+    return future.get();
+  }
+
+  // @brief wait until every spawned task completed
+  void wait() {
+    std::unique_lock<std::mutex> lock{mutex_};
+    idle_cv_.wait(lock, [&] { return outstanding_ == 0; });
+  }
+
+  // @brief the scheduler of the calling worker thread, or nullptr
+  static Scheduler *current() { return current_; }
+
+  // @brief awaitable which moves the coroutine to a worker
+  auto resume_on() {
+    struct Awaiter {
+      Scheduler *scheduler;
+      bool await_ready() const noexcept { return false; }
+      void await_suspend(std::coroutine_handle<> h) { scheduler->schedule(h); }
+      void await_resume() const noexcept {}
+    };
+    return Awaiter{this};
+  }
+
+private:
+  detail::Detached run(Task<void> task) {
+    co_await resume_on();
+    co_await task;
+    std::unique_lock<std::mutex> lock{mutex_};
+    if (--outstanding_ == 0) {
+      idle_cv_.notify_all();
+    }
+  }
+
+  template <typename T>
+  static Task<void> complete(Task<T> task, std::promise<T> &result) {
+    try {
+      if constexpr (std::is_void_v<T>) {
+        co_await task;
+        result.set_value();
+      } else {
+        result.set_value(co_await task);
+      }
+    } catch (...) {
+      result.set_exception(std::current_exception());
+    }
+  }
+
+  void work() {
+    current_ = this;
+    while (true) {
+      std::coroutine_handle<> h;
+      {
+        std::unique_lock<std::mutex> lock{mutex_};
+        cv_.wait(lock, [&] { return stop_ || !queue_.empty(); });
+        if (queue_.empty()) {
+          return;
+        }
+        h = queue_.front();
+        queue_.pop_front();
+      }
+      h.resume();
+    }
+  }
+
+  inline static thread_local Scheduler *current_ = nullptr;
+
+  std::vector<std::thread> workers_;
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  std::condition_variable idle_cv_;
+  std::deque<std::coroutine_handle<>> queue_;
+  size_t outstanding_ = 0;
+  bool stop_ = false;
+};
@@ -0,0 +1,316 @@
+#pragma once
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <filesystem>
+#include <fstream>
+#include <future>
+#include <memory>
+#include <queue>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <unistd.h>
+
+#include "logger.hpp"
+
+// Sort key value records which may not fit in memory. Records are collected
+// into chunks, every full chunk is sorted by a worker thread and spilled to a
+// temporary run file, then the runs are merged by a k-way merge.
+//
+// run file: | key size | val size | key | val | key size | ...
+class ExternalSorter {
+public:
+  using bytes = std::vector<char>;
+  using Record = std::pair<bytes, bytes>;
+
+  struct Options {
+    // memory used by the chunks being filled and sorted
+    size_t memory_budget = 64 << 20;
+    size_t threads = std::max(1u, std::thread::hardware_concurrency());
+    std::filesystem::path temp_dir = std::filesystem::temp_directory_path();
+  };
+
+  ExternalSorter() : ExternalSorter(Options()) {}
+
+  explicit ExternalSorter(Options options) : options_(std::move(options)) {
+    if (options_.threads == 0) {
+      options_.threads = 1;
+    }
+    chunk_limit_ = std::max<size_t>(options_.memory_budget /
+                                        (options_.threads + 1),
+                                    PER_RECORD_OVERHEAD);
+  }
+
+  ~ExternalSorter() {
+    for (auto &f : pending_) {
+      f.wait();
+    }
+    for (auto &run : runs_) {
+      if (!run->file.empty()) {
+        std::error_code ec;
+        std::filesystem::remove(run->file, ec);
+      }
+    }
+  }
+
+  ExternalSorter(const ExternalSorter &) = delete;
+  ExternalSorter &operator=(const ExternalSorter &) = delete;
+
+  // @brief add a record, a later record wins over an earlier one with the same
+  // key
+  void add(bytes key, bytes val) {
+    assert(!finished_);
+    chunk_bytes_ += key.size() + val.size() + PER_RECORD_OVERHEAD;
+    bytes_ += key.size() + val.size();
+    chunk_.emplace_back(std::move(key), std::move(val));
+    ++records_;
+    if (chunk_bytes_ >= chunk_limit_) {
+      spill();
+    }
+  }
+
+  // @brief sort the records left in memory and wait for the spilling runs
+  void finish() {
+    assert(!finished_);
+    finished_ = true;
+    if (runs_.empty()) {
+      // everything fits in memory, sort slices of the chunk in parallel
+      sort_in_memory();
+    } else if (!chunk_.empty()) {
+      // the last chunk is merged from memory
+      auto run = std::make_unique<Run>();
+      run->records = std::move(chunk_);
+      sort_run(*run);
+      runs_.push_back(std::move(run));
+    }
+    chunk_.clear();
+    while (!pending_.empty()) {
+      pending_.front().get();
+      pending_.pop_front();
+    }
+  }
+
+  class Merger;
+
+  // @brief merge the runs, the merger yields every distinct key in ascending
+  // order
+  Merger merge();
+
+  size_t records() const { return records_; }
+  size_t bytes_added() const { return bytes_; }
+  size_t run_count() const { return runs_.size(); }
+  size_t spilled_runs() const { return spilled_; }
+
+private:
+  constexpr static size_t PER_RECORD_OVERHEAD = sizeof(Record);
+  constexpr static size_t IO_BUFFER_SIZE = 1 << 20;
+
+  struct Run {
+    std::vector<Record> records; // in memory run
+    std::filesystem::path file;  // spilled run
+  };
+
+  class Cursor {
+  public:
+    Cursor(Run &run) : run_(run) {
+      if (!run_.file.empty()) {
+        buf_ = std::make_unique<char[]>(IO_BUFFER_SIZE);
+        in_.rdbuf()->pubsetbuf(buf_.get(), IO_BUFFER_SIZE);
+        in_.open(run_.file, std::ios::binary);
+        if (!in_) {
+          throw std::runtime_error("open run file failed");
+        }
+      }
+    }
+
+    bool next() {
+      if (run_.file.empty()) {
+        if (pos_ >= run_.records.size()) {
+          return false;
+        }
+        cur_ = &run_.records[pos_++];
+        return true;
+      }
+      uint32_t sizes[2];
+      if (!in_.read(reinterpret_cast<char *>(sizes), sizeof sizes)) {
+        return false;
+      }
+      record_.first.resize(sizes[0]);
+      record_.second.resize(sizes[1]);
+      in_.read(record_.first.data(), sizes[0]);
+      in_.read(record_.second.data(), sizes[1]);
+      if (!in_) {
+        throw std::runtime_error("read run file failed");
+      }
+      cur_ = &record_;
+      return true;
+    }
+
+    const bytes &key() const { return cur_->first; }
+    const bytes &val() const { return cur_->second; }
+
+    size_t run_idx = 0;
+
+  private:
+    Run &run_;
+    size_t pos_ = 0;
+    std::unique_ptr<char[]> buf_;
+    std::ifstream in_;
+    Record record_;
+    const Record *cur_ = nullptr;
+  };
+
+  static void sort_run(Run &run) {
+    std::stable_sort(
+        run.records.begin(), run.records.end(),
+        [](const Record &l, const Record &r) { return l.first < r.first; });
+  }
+
+  static void write_run(Run &run) {
+    auto buf = std::make_unique<char[]>(IO_BUFFER_SIZE);
+    std::ofstream out;
+    out.rdbuf()->pubsetbuf(buf.get(), IO_BUFFER_SIZE);
+    out.open(run.file, std::ios::binary | std::ios::trunc);
+    for (auto &[k, v] : run.records) {
+      uint32_t sizes[2] = {static_cast<uint32_t>(k.size()),
+                           static_cast<uint32_t>(v.size())};
+      out.write(reinterpret_cast<const char *>(sizes), sizeof sizes);
+      out.write(k.data(), k.size());
+      out.write(v.data(), v.size());
+    }
+    out.flush();
+    if (!out) {
+      throw std::runtime_error("write run file failed");
+    }
+    run.records.clear();
+    run.records.shrink_to_fit();
+  }
+
+  // hand the full chunk to a worker, which sorts it and writes it to a run file
+  void spill() {
+    while (pending_.size() >= options_.threads) {
+      pending_.front().get();
+      pending_.pop_front();
+    }
+
+    auto run = std::make_unique<Run>();
+    run->records = std::move(chunk_);
+    run->file = options_.temp_dir /
+                ("bplus_run_" + std::to_string(::getpid()) + "_" +
+                 std::to_string(reinterpret_cast<uintptr_t>(this)) + "_" +
+                 std::to_string(runs_.size()));
+    Run *r = run.get();
+    runs_.push_back(std::move(run));
+    ++spilled_;
+
+    LOG_DEBUG << "spill run " << r->file << " records " << r->records.size();
+    pending_.push_back(std::async(std::launch::async, [r] {
+      sort_run(*r);
+      write_run(*r);
+    }));
+
+    chunk_ = std::vector<Record>();
+    chunk_bytes_ = 0;
+  }
+
+  void sort_in_memory() {
+    size_t slices = std::min(options_.threads, chunk_.size());
+    if (slices == 0) {
+      return;
+    }
+    size_t per_slice = (chunk_.size() + slices - 1) / slices;
+    for (size_t begin = 0; begin < chunk_.size(); begin += per_slice) {
+      size_t end = std::min(chunk_.size(), begin + per_slice);
+      auto run = std::make_unique<Run>();
+      run->records.assign(std::make_move_iterator(chunk_.begin() + begin),
+                          std::make_move_iterator(chunk_.begin() + end));
+      Run *r = run.get();
+      runs_.push_back(std::move(run));
+      pending_.push_back(
+          std::async(std::launch::async, [r] { sort_run(*r); }));
+    }
+  }
+
+  Options options_;
+  size_t chunk_limit_;
+
+  std::vector<Record> chunk_;
+  size_t chunk_bytes_ = 0;
+
+  std::vector<std::unique_ptr<Run>> runs_;
+  std::deque<std::future<void>> pending_;
+
+  size_t records_ = 0;
+  size_t bytes_ = 0;
+  size_t spilled_ = 0;
+  bool finished_ = false;
+};
+
+// k-way merge of the sorted runs, ties are broken by the run index so the
+// latest record of a key comes last and wins
+class ExternalSorter::Merger {
+public:
+  explicit Merger(std::vector<std::unique_ptr<Run>> &runs) : heap_(greater) {
+    for (auto &run : runs) {
+      auto cursor = std::make_unique<Cursor>(*run);
+      if (cursor->next()) {
+        cursor->run_idx = cursors_.size();
+        heap_.push(cursor.get());
+        cursors_.push_back(std::move(cursor));
+      }
+    }
+  }
+
+  // @brief get the next record, return false at the end
+  bool next(bytes &key, bytes &val) {
+    if (heap_.empty()) {
+      return false;
+    }
+    Cursor *c = pop();
+    key = c->key();
+    val = c->val();
+    advance(c);
+    while (!heap_.empty() && heap_.top()->key() == key) {
+      c = pop();
+      val = c->val();
+      advance(c);
+    }
+    return true;
+  }
+
+private:
+  static bool greater(const Cursor *l, const Cursor *r) {
+    if (l->key() != r->key()) {
+      return l->key() > r->key();
+    }
+    return l->run_idx > r->run_idx;
+  }
+
+  Cursor *pop() {
+    Cursor *c = heap_.top();
+    heap_.pop();
+    return c;
+  }
+
+  void advance(Cursor *c) {
+    if (c->next()) {
+      heap_.push(c);
+    }
+  }
+
+  std::vector<std::unique_ptr<Cursor>> cursors_;
+  std::priority_queue<Cursor *, std::vector<Cursor *>,
+                      bool (*)(const Cursor *, const Cursor *)>
+      heap_;
+};
+
+inline ExternalSorter::Merger ExternalSorter::merge() {
+  assert(finished_);
+  return Merger(runs_);
+}
@@ -0,0 +1,127 @@
+#pragma once
+#include <cassert>
+#include <cstddef>
+#include <stdexcept>
+#include <utility>
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+struct ArenaOptions {
+  // map the arena with MAP_HUGETLB, it falls back to normal pages when the
+  // system has no huge pages reserved
+  bool huge_pages = false;
+  // ask for transparent huge pages with madvise(MADV_HUGEPAGE)
+  bool transparent_huge_pages = true;
+};
+
+// One anonymous mapping which holds every frame of the buffer pool. The
+// frames are contiguous and aligned to their size, so they can be read and
+// written with O_DIRECT and registered with the io backend as one buffer.
+// The kernel zero-fills the pages when they are first touched, nothing is
+// written to open a large pool, and the address space may be reserved for
+// more frames than are used.
+class FrameArena {
+public:
+  static constexpr size_t kHugePageSize = 2 << 20;
+
+  FrameArena() = default;
+
+  FrameArena(size_t frame_size, size_t frames, const ArenaOptions &options = {})
+      : frame_size_(frame_size), frames_(frames) {
+    assert(frame_size > 0 && (frame_size & (frame_size - 1)) == 0);
+    bytes_ = frame_size * frames;
+    if (bytes_ == 0) {
+      return;
+    }
+
+    void *p = MAP_FAILED;
+#ifdef MAP_HUGETLB
+    if (options.huge_pages) {
+      // the huge pages are reserved by mmap, without the reservation a fault
+      // would raise SIGBUS when they run out
+      size_t len = round_up(bytes_, kHugePageSize);
+      p = mmap(nullptr, len, PROT_READ | PROT_WRITE,
+               MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+      if (p != MAP_FAILED) {
+        mapped_ = len;
+        huge_pages_ = true;
+      }
+    }
+#endif
+    if (p == MAP_FAILED) {
+      mapped_ = bytes_;
+      p = mmap(nullptr, mapped_, PROT_READ | PROT_WRITE,
+               MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+      if (p == MAP_FAILED) {
+        throw std::runtime_error("mmap frame arena failed");
+      }
+#ifdef MADV_HUGEPAGE
+      if (options.transparent_huge_pages && mapped_ >= kHugePageSize) {
+        madvise(p, mapped_, MADV_HUGEPAGE);
+      }
+#endif
+    }
+    base_ = static_cast<char *>(p);
+  }
+
+  FrameArena(FrameArena &&other) noexcept { swap(other); }
+  FrameArena &operator=(FrameArena &&other) noexcept {
+    FrameArena tmp{std::move(other)};
+    swap(tmp);
+    return *this;
+  }
+  FrameArena(const FrameArena &) = delete;
+  FrameArena &operator=(const FrameArena &) = delete;
+
+  ~FrameArena() {
+    if (base_) {
+      munmap(base_, mapped_);
+    }
+  }
+
+  char *frame(size_t idx) const {
+    assert(idx < frames_);
+    return base_ + idx * frame_size_;
+  }
+
+  // @brief give the memory of frames [first, first + count) back to the
+  // kernel, they read as zero when touched again. only whole pages of the
+  // mapping are released
+  void release(size_t first, size_t count) {
+    assert(first + count <= frames_);
+    size_t page = huge_pages_ ? kHugePageSize : sysconf(_SC_PAGESIZE);
+    size_t begin = round_up(first * frame_size_, page);
+    size_t end = (first + count) * frame_size_ / page * page;
+    if (end > begin) {
+      madvise(base_ + begin, end - begin, MADV_DONTNEED);
+    }
+  }
+
+  char *data() const { return base_; }
+  size_t frames() const { return frames_; }
+  size_t bytes() const { return bytes_; }
+  // @brief the arena is backed by MAP_HUGETLB pages
+  bool huge_pages() const { return huge_pages_; }
+
+private:
+  static size_t round_up(size_t n, size_t align) {
+    return (n + align - 1) / align * align;
+  }
+
+  void swap(FrameArena &other) noexcept {
+    std::swap(base_, other.base_);
+    std::swap(frame_size_, other.frame_size_);
+    std::swap(frames_, other.frames_);
+    std::swap(bytes_, other.bytes_);
+    std::swap(mapped_, other.mapped_);
+    std::swap(huge_pages_, other.huge_pages_);
+  }
+
+  char *base_ = nullptr;
+  size_t frame_size_ = 0;
+  size_t frames_ = 0;
+  size_t bytes_ = 0;
+  size_t mapped_ = 0;
+  bool huge_pages_ = false;
+};
@@ -1,10 +1,24 @@
 #pragma once
 // #include "../bplus_tree.hpp"
+#include <algorithm>
 #include <cassert>
+#include <cmath>
+#include <type_traits>
 
 // find the first key that is greater than or equal to the argument key
-inline int InternalNode::find_idx(const key_type &key) {
+inline int InternalNode::find_idx(const key_type &key) const {
   int l = -1, r = num_keys_;
+  if (modeled() && key.size() >= model_prefix_ &&
+      std::equal(keys_[0].begin(), keys_[0].begin() + model_prefix_,
+                 key.begin())) {
+    // the model is monotonic, the slot is within the error of the
+    // prediction. one more slot on each side covers the rounding
+    uint64_t v = model_key(key);
+    double pred = v <= model_lo_ ? 0 : (v - model_lo_) * model_slope_;
+    pred = std::min(pred, static_cast<double>(num_keys_ - 1));
+    l = std::max(static_cast<int>(pred) - model_err_ - 2, -1);
+    r = std::min(static_cast<int>(pred) + model_err_ + 2, num_keys_);
+  }
   while (l + 1 != r) {
     int mid = (l + r) / 2;
     int cmp = key_cmp(key, keys_[mid]);
@@ -18,26 +32,56 @@ inline int InternalNode::find_idx(const key_type &key) {
 }
 
 // find the first key that is greater than or equal to the argument key
-inline auto InternalNode::find(const key_type &key) -> std::pair<bool, int> {
-  bool exist = false;
-  int l = -1, r = num_keys_;
+inline auto InternalNode::find(const key_type &key) const
+    -> std::pair<bool, int> {
+  int r = find_idx(key);
+  return {r < num_keys_ && keys_[r] == key, r};
+}
 
-  while (l + 1 != r) {
-    int mid = (l + r) / 2;
-    int cmp = key_cmp(key, keys_[mid]);
-    if (cmp > 0) {
-      l = mid;
-    } else {
-      r = mid;
+inline uint64_t InternalNode::model_key(const key_type &key) const {
+  uint64_t v = 0;
+  for (size_t i = model_prefix_; i < model_prefix_ + 8; ++i) {
+    // keys compare as chars, a signed char sorts 0x80 first
+    uint8_t byte = i < key.size() ? static_cast<uint8_t>(key[i]) : 0;
+    if (i < key.size() && std::is_signed_v<char>) {
+      byte ^= 0x80;
     }
+    v = v << 8 | byte;
+  }
+  return v;
+}
+
+inline void InternalNode::refit() {
+  model_err_ = -1;
+  // the search around the prediction covers 2 * err + 4 slots
+  int max_err = (num_keys_ / 2 - 4) / 2;
+  if (max_err < 0) {
+    return;
+  }
+  auto &first = keys_.front(), &last = keys_.back();
+  model_prefix_ =
+      std::mismatch(first.begin(), first.end(), last.begin(), last.end())
+          .first -
+      first.begin();
+  model_lo_ = model_key(first);
+  uint64_t hi = model_key(last);
+  if (hi == model_lo_) {
+    return;
+  }
+  model_slope_ = static_cast<double>(num_keys_ - 1) / (hi - model_lo_);
+
+  int err = 0;
+  for (int i = 0; i < num_keys_ && err <= max_err; ++i) {
+    double pred = static_cast<double>(model_key(keys_[i]) - model_lo_) *
+                  model_slope_;
+    err = std::max(err, static_cast<int>(std::abs(pred - i)) + 1);
   }
-  if (r < num_keys_ && r >= 0 && keys_[r] == key) {
-    exist = true;
+  if (err <= max_err) {
+    model_err_ = err;
   }
-  return {exist, r};
 }
 
-inline PageId InternalNode::child(const key_type &key) {
+inline int InternalNode::child_idx(const key_type &key) const {
   assert(num_keys_);
   // return greater than or equal to key
   int idx = find_idx(key);
@@ -46,7 +90,19 @@ inline PageId InternalNode::child(const key_type &key) {
   // keys_[idx] is greater than the argument key
   if (idx == num_keys_ || key_cmp(key, keys_[idx]) != 0)
     idx--;
-  return items_[idx].child;
+  return idx;
+}
+
+inline PageId InternalNode::child(const key_type &key) const {
+  return items_[child_idx(key)].child;
+}
+
+inline void InternalNode::set_key(size_t idx, key_type key) {
+  assert(idx == 0 || keys_[idx - 1] < key);
+  assert(idx + 1 == keys_.size() || key < keys_[idx + 1]);
+  items_[idx].key_size = key.size();
+  keys_[idx] = std::move(key);
+  refit();
 }
 
 inline void InternalNode::insert(key_type key, PageId child) {
@@ -64,6 +120,7 @@ inline void InternalNode::insert(key_type key, PageId child) {
     keys_.insert(keys_.begin() + idx, std::move(key));
   }
   ++num_keys_;
+  refit();
 }
 
 inline bool InternalNode::remove(const key_type &key) {
@@ -80,6 +137,7 @@ inline void InternalNode::remove(int idx) {
   items_.erase(items_.begin() + idx);
   keys_.erase(keys_.begin() + idx);
   --num_keys_;
+  refit();
 }
 
 inline void InternalNode::read(Page *p) {
@@ -116,6 +174,28 @@ inline void InternalNode::read(Page *p) {
     data += items_[i].key_size;
     keys_.push_back(std::move(key));
   }
+  refit();
+
+  // read buffered messages
+  int num_msgs;
+  std::memcpy(&num_msgs, data, sizeof(int));
+  data += sizeof(int);
+  for (int i = 0; i < num_msgs; ++i) {
+    Message msg;
+    int key_size, val_size;
+    std::memcpy(&msg.type, data, sizeof(uint8_t));
+    data += sizeof(uint8_t);
+    std::memcpy(&key_size, data, sizeof(int));
+    data += sizeof(int);
+    std::memcpy(&val_size, data, sizeof(int));
+    data += sizeof(int);
+    msg.key.assign(data, data + key_size);
+    data += key_size;
+    msg.val.assign(data, data + val_size);
+    data += val_size;
+    buffer_bytes_ += msg.bytes();
+    msgs_.push_back(std::move(msg));
+  }
 }
 
 inline void InternalNode::write(Page *p) const {
@@ -139,6 +219,23 @@ inline void InternalNode::write(Page *p) const {
     std::memcpy(data, keys_[i].data(), keys_[i].size());
     data += keys_[i].size();
   }
+
+  int num_msgs = msgs_.size();
+  std::memcpy(data, &num_msgs, sizeof(int));
+  data += sizeof(int);
+  for (auto &msg : msgs_) {
+    int key_size = msg.key.size(), val_size = msg.val.size();
+    std::memcpy(data, &msg.type, sizeof(uint8_t));
+    data += sizeof(uint8_t);
+    std::memcpy(data, &key_size, sizeof(int));
+    data += sizeof(int);
+    std::memcpy(data, &val_size, sizeof(int));
+    data += sizeof(int);
+    std::memcpy(data, msg.key.data(), key_size);
+    data += key_size;
+    std::memcpy(data, msg.val.data(), val_size);
+    data += val_size;
+  }
 }
 
 // inline const key_type &InternalNode::split(InternalNode &new_node) {
@@ -168,4 +265,89 @@ inline void InternalNode::move_half_to(InternalNode &new_node) {
   items_.erase(items_.begin() + mid, items_.end());
   keys_.erase(keys_.begin() + mid, keys_.end());
   num_keys_ = mid;
+  refit();
+  new_node.refit();
+
+  // the messages go with the children of their keys
+  auto it = std::lower_bound(
+      msgs_.begin(), msgs_.end(), new_node.keys_[0],
+      [](const Message &msg, const key_type &key) { return msg.key < key; });
+  for (auto moved = it; moved != msgs_.end(); ++moved) {
+    buffer_bytes_ -= moved->bytes();
+    new_node.buffer_bytes_ += moved->bytes();
+    new_node.msgs_.push_back(std::move(*moved));
+  }
+  msgs_.erase(it, msgs_.end());
+}
+
+inline void InternalNode::buffer(Message msg) {
+  // after the writes of the same key, they are older
+  auto it = std::upper_bound(
+      msgs_.begin(), msgs_.end(), msg.key,
+      [](const key_type &key, const Message &msg) { return key < msg.key; });
+  buffer_bytes_ += msg.bytes();
+  msgs_.insert(it, std::move(msg));
+}
+
+inline const Message *InternalNode::buffered(const key_type &key) const {
+  auto it = std::upper_bound(
+      msgs_.begin(), msgs_.end(), key,
+      [](const key_type &key, const Message &msg) { return key < msg.key; });
+  if (it == msgs_.begin() || std::prev(it)->key != key) {
+    return nullptr;
+  }
+  return &*std::prev(it);
+}
+
+inline std::vector<Message> InternalNode::take_buffered(size_t idx) {
+  auto less = [](const Message &msg, const key_type &key) {
+    return msg.key < key;
+  };
+  // the child at idx holds the keys in [key(idx), key(idx + 1))
+  auto first = idx == 0 ? msgs_.begin()
+                        : std::lower_bound(msgs_.begin(), msgs_.end(),
+                                           keys_[idx], less);
+  auto last = idx + 1 == keys_.size()
+                  ? msgs_.end()
+                  : std::lower_bound(first, msgs_.end(), keys_[idx + 1], less);
+  std::vector<Message> taken{std::make_move_iterator(first),
+                             std::make_move_iterator(last)};
+  msgs_.erase(first, last);
+  for (auto &msg : taken) {
+    buffer_bytes_ -= msg.bytes();
+  }
+  return taken;
+}
+
+inline void InternalNode::remove_buffered(const key_type &lo,
+                                          const key_type &hi) {
+  auto less = [](const Message &msg, const key_type &key) {
+    return msg.key < key;
+  };
+  auto first = std::lower_bound(msgs_.begin(), msgs_.end(), lo, less);
+  auto last = hi.empty() ? msgs_.end()
+                         : std::lower_bound(first, msgs_.end(), hi, less);
+  for (auto it = first; it != last; ++it) {
+    buffer_bytes_ -= it->bytes();
+  }
+  msgs_.erase(first, last);
+}
+
+inline size_t InternalNode::heaviest_child() const {
+  size_t heaviest = 0, heaviest_bytes = 0;
+  size_t idx = 0, bytes = 0;
+  for (auto &msg : msgs_) {
+    // the messages are ordered, so are the children they go to
+    size_t child = std::max(child_idx(msg.key), 0);
+    if (child != idx) {
+      idx = child;
+      bytes = 0;
+    }
+    bytes += msg.bytes();
+    if (bytes > heaviest_bytes) {
+      heaviest = idx;
+      heaviest_bytes = bytes;
+    }
+  }
+  return heaviest;
 }
\ No newline at end of file
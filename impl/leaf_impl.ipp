@@ -2,8 +2,11 @@
 
 // #include "../bplus_tree.hpp"
 #include <cassert>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
-inline bool LeafNode::get(const key_type &key, value_type &val) {
+inline bool LeafNode::get(const key_type &key, value_type &val) const {
   auto [exist, idx] = find(key);
   if (exist) {
     val = kvs_[idx].second;
@@ -11,8 +14,12 @@ inline bool LeafNode::get(const key_type &key, value_type &val) {
   return exist;
 }
 
-inline int LeafNode::find_idx(const key_type &key) {
-  int l = -1, r = num_keys_;
+inline int LeafNode::find_idx(const key_type &key) const {
+  return find_idx(key, -1, num_keys_);
+}
+
+// @brief find_idx() of a key above the slot l and not above the slot r
+inline int LeafNode::find_idx(const key_type &key, int l, int r) const {
   while (l + 1 != r) {
     int mid = (l + r) / 2;
     int cmp = key_cmp(key, kvs_[mid].first);
@@ -25,24 +32,54 @@ inline int LeafNode::find_idx(const key_type &key) {
   return r;
 }
 
-inline auto LeafNode::find(const key_type &key) -> std::pair<bool, int> {
+inline auto LeafNode::find(const key_type &key) const
+    -> std::pair<bool, int> {
+  // equal keys are next to each other, the first match is the first record.
+  // the keys of the other matches bound the search of a miss, a larger one
+  // ends the scan
+  uint8_t fp = fingerprint(key);
   int l = -1, r = num_keys_;
-  bool exist = false;
-  while (l + 1 != r) {
-    int mid = (l + r) / 2;
-    int cmp = key_cmp(key, kvs_[mid].first);
-    if (cmp > 0) {
-      l = mid;
-    } else {
-      // r >= key
-      r = mid;
+  for (int i = probe(fp, 0); i < num_keys_; i = probe(fp, i + 1)) {
+    int cmp = key_cmp(key, kvs_[i].first);
+    if (cmp == 0) {
+      return {true, i};
+    }
+    if (cmp < 0) {
+      r = i;
+      break;
     }
+    l = i;
   }
+  return {false, find_idx(key, l, r)};
+}
+
+inline uint8_t LeafNode::fingerprint(const key_type &key) {
+  uint64_t h = std::hash<std::string_view>{}({key.data(), key.size()});
+  h ^= h >> 32;
+  h ^= h >> 16;
+  return static_cast<uint8_t>(h ^ (h >> 8));
+}
 
-  if (r < num_keys_ && r >= 0 && key_cmp(key, kvs_[r].first) == 0) {
-    exist = true;
+// @brief the first slot from from on with fingerprint fp, num_keys_ if none
+inline int LeafNode::probe(uint8_t fp, int from) const {
+  int i = from;
+#if defined(__SSE2__)
+  const __m128i needle = _mm_set1_epi8(static_cast<char>(fp));
+  for (; i + 16 <= num_keys_; i += 16) {
+    __m128i chunk =
+        _mm_loadu_si128(reinterpret_cast<const __m128i *>(fps_.data() + i));
+    int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(chunk, needle));
+    if (mask != 0) {
+      return i + __builtin_ctz(mask);
+    }
+  }
+#endif
+  for (; i < num_keys_; ++i) {
+    if (fps_[i] == fp) {
+      return i;
+    }
   }
-  return {exist, r};
+  return num_keys_;
 }
 
 inline void LeafNode::insert(key_type key, value_type val) {
@@ -53,9 +90,11 @@ inline void LeafNode::insert(key_type key, value_type val) {
   item.val_size = val.size();
   if (idx == num_keys_) {
     items_.push_back(item);
+    fps_.push_back(fingerprint(key));
     kvs_.push_back({std::move(key), std::move(val)});
   } else {
     items_.insert(items_.begin() + idx, item);
+    fps_.insert(fps_.begin() + idx, fingerprint(key));
     kvs_.insert(kvs_.begin() + idx, {std::move(key), std::move(val)});
   }
   ++num_keys_;
@@ -72,6 +111,7 @@ inline bool LeafNode::remove(const key_type &key) {
 
 inline void LeafNode::remove(int idx) {
   items_.erase(items_.begin() + idx);
+  fps_.erase(fps_.begin() + idx);
   kvs_.erase(kvs_.begin() + idx);
   --num_keys_;
 }
@@ -103,6 +143,7 @@ inline void LeafNode::read(Page *p) {
     data += items_[i].key_size;
     std::memcpy(kv.second.data(), data, items_[i].val_size);
     data += items_[i].val_size;
+    fps_.push_back(fingerprint(kv.first));
     kvs_.push_back(std::move(kv));
   }
 }
@@ -148,10 +189,12 @@ inline void LeafNode::move_half_to(LeafNode &new_node) {
 
   for (auto i = 0; i < new_node.num_keys_; ++i) {
     new_node.items_.push_back(items_[mid + i]);
+    new_node.fps_.push_back(fps_[mid + i]);
     new_node.kvs_.push_back(std::move(kvs_[mid + i]));
   }
 
   items_.erase(items_.begin() + mid, items_.end());
+  fps_.erase(fps_.begin() + mid, fps_.end());
   kvs_.erase(kvs_.begin() + mid, kvs_.end());
   num_keys_ = mid;
 }
\ No newline at end of file
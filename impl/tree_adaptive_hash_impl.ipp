@@ -0,0 +1,56 @@
+#pragma once
+
+//#include "../bplus_tree.hpp"
+
+inline bool BPlusTree::search_hashed(const key_type &key, uint64_t h,
+                                     value_type &val) {
+  std::string_view k{key.data(), key.size()};
+  HashSlot slot;
+  if (!adaptive_hash_->find(k, h, slot)) {
+    hash_misses_++;
+    return false;
+  }
+  Page *p = buffer_pool_.fetch_resident(slot.page);
+  bool valid = p && p->frame == slot.frame && p->version == slot.version;
+  if (valid) {
+    auto leaf_node = read_node<LeafNode>(p);
+    // the version says the leaf is as it was, the key is compared anyway
+    valid = slot.slot < leaf_node->size() && leaf_node->key(slot.slot) == key;
+    if (valid) {
+      val = leaf_node->fetch(slot.slot);
+    }
+  }
+  if (p) {
+    buffer_pool_.unpin(p->id, false);
+  }
+  if (!valid) {
+    // the leaf changed or left the pool, the descent indexes the key again
+    adaptive_hash_->erase(k, h);
+    hash_misses_++;
+    return false;
+  }
+  hash_hits_++;
+  return true;
+}
+
+inline void BPlusTree::index_hot(const key_type &key, uint64_t h,
+                                 const Page *p, const LeafNode &leaf_node) {
+  if (!adaptive_hash_->touch(h)) {
+    return;
+  }
+  auto [exist, idx] = leaf_node.find(key);
+  if (exist) {
+    adaptive_hash_->insert({key.data(), key.size()}, h,
+                           HashSlot{p->id, p->frame, p->version, idx});
+  }
+}
+
+inline AdaptiveHashStats BPlusTree::adaptive_hash_stats() const {
+  AdaptiveHashStats stats;
+  if (adaptive_hash_) {
+    stats.hits = hash_hits_.load();
+    stats.misses = hash_misses_.load();
+    stats.entries = adaptive_hash_->size();
+  }
+  return stats;
+}
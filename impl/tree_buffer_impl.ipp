@@ -0,0 +1,241 @@
+#pragma once
+
+//#include "../bplus_tree.hpp"
+
+inline bool BPlusTree::flush_down(PageId id, std::vector<Message> msgs) {
+  Page *p = buffer_pool_.fetch(id);
+  if (!p) {
+    LOG_DEBUG << "fetch page failed " << id;
+    return false;
+  }
+  if (p->page_type != kInternalPageType) {
+    // the writes which fit are applied to the leaf at once, the one which
+    // splits it and the rest find their leaves one by one
+    auto leaf_node = LeafNode();
+    leaf_node.read(p);
+    size_t applied = 0;
+    while (applied < msgs.size() && apply_to(leaf_node, msgs[applied])) {
+      ++applied;
+    }
+    if (applied > 0) {
+      write_node(leaf_node, p);
+    } else {
+      buffer_pool_.unpin(id, false);
+    }
+    for (size_t i = applied; i < msgs.size(); ++i) {
+      auto type = msgs[i].type;
+      if (!apply(std::move(msgs[i])) && type != Message::kDelete) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  InternalNode node = *read_node<InternalNode>(p);
+  for (auto &msg : msgs) {
+    node.buffer(std::move(msg));
+  }
+  // the node is written before its children change, a split below adds its
+  // key to the node on the page
+  std::vector<std::pair<PageId, std::vector<Message>>> down;
+  while (node.buffer_bytes() > write_buffer_) {
+    size_t idx = node.heaviest_child();
+    down.emplace_back(node.item(idx).child, node.take_buffered(idx));
+  }
+  node.write(p);
+  buffer_pool_.unpin(id, true);
+  // the next write of the node decodes nothing
+  auto decoded = std::make_shared<const InternalNode>(std::move(node));
+  if (auto it = resident_.find(id); it != resident_.end()) {
+    it->second = decoded;
+  }
+  p = buffer_pool_.fetch(id);
+  buffer_pool_.set_decoded(p, std::move(decoded));
+  buffer_pool_.unpin(id, false);
+
+  for (auto &[child, batch] : down) {
+    if (!flush_down(child, std::move(batch))) {
+      return false;
+    }
+  }
+  return true;
+}
+
+inline bool BPlusTree::apply_to(LeafNode &leaf_node, const Message &msg) {
+  if (msg.type == Message::kDelete) {
+    while (leaf_node.remove(msg.key)) {
+    }
+    return true;
+  }
+  auto [exist, idx] = leaf_node.find(msg.key);
+  value_type old;
+  if (exist && msg.type == Message::kUpsert) {
+    old = leaf_node.fetch(idx);
+    leaf_node.remove(idx);
+  }
+  leaf_node.insert(msg.key, msg.val);
+  if (leaf_node.less_than(PAGE_SIZE)) {
+    return true;
+  }
+  // the newest record of the key is the one just inserted
+  leaf_node.remove(msg.key);
+  if (exist && msg.type == Message::kUpsert) {
+    leaf_node.insert(msg.key, std::move(old));
+  }
+  return false;
+}
+
+inline size_t BPlusTree::scan_buffered(const key_type &lo, const key_type &hi,
+                                       const scan_fn &fn) {
+  // the internal levels, all leaves are as deep
+  size_t levels = 0;
+  {
+    Page view{nullptr};
+    Page *p = read_page(root_, view);
+    while (p && p->page_type == kInternalPageType) {
+      auto node = read_node<InternalNode>(p);
+      release_page(p);
+      ++levels;
+      p = read_page(node->child(lo), view);
+    }
+    if (p) {
+      release_page(p);
+    }
+  }
+
+  // a deeper buffer holds older writes, then the writes of a key are in
+  // order from the oldest
+  std::vector<std::pair<size_t, Message>> buffered;
+  if (levels > 0) {
+    collect_buffered(root_, 0, levels, lo, hi, buffered);
+  }
+  std::stable_sort(buffered.begin(), buffered.end(),
+                   [](const auto &a, const auto &b) {
+                     if (a.second.key != b.second.key) {
+                       return a.second.key < b.second.key;
+                     }
+                     return a.first > b.first;
+                   });
+
+  size_t count = 0;
+  size_t next = 0;
+  bool stop = false;
+  // the records of key from the leaves, newest first, with the buffered
+  // writes of key applied
+  auto emit = [&](const key_type &key, std::vector<value_type> vals) {
+    for (; next < buffered.size() && buffered[next].second.key == key;
+         ++next) {
+      auto &msg = buffered[next].second;
+      if (msg.type == Message::kInsert) {
+        vals.insert(vals.begin(), msg.val);
+      } else if (msg.type == Message::kUpsert && !vals.empty()) {
+        vals.front() = msg.val;
+      } else if (msg.type == Message::kUpsert) {
+        vals.push_back(msg.val);
+      } else {
+        vals.clear();
+      }
+    }
+    for (auto &val : vals) {
+      ++count;
+      if (!fn(key, val)) {
+        stop = true;
+        return;
+      }
+    }
+  };
+  // the buffered keys before key, no leaf has them
+  auto emit_before = [&](const key_type *key) {
+    while (!stop && next < buffered.size() &&
+           (!key || buffered[next].second.key < *key)) {
+      key_type k = buffered[next].second.key;
+      emit(k, {});
+    }
+  };
+
+  key_type key;
+  std::vector<value_type> vals;
+  ReadAhead read_ahead{*this};
+  Page view{nullptr};
+  Page *p = find_leaf(lo, view);
+  while (p && !stop) {
+    auto leaf_node = read_node<LeafNode>(p);
+    read_ahead.advance(p->id, *leaf_node);
+    release_page(p);
+
+    for (auto i = 0; i < leaf_node->size() && !stop; ++i) {
+      auto k = leaf_node->key(i);
+      if (k < lo) {
+        continue;
+      }
+      if (!hi.empty() && !(k < hi)) {
+        p = nullptr;
+        break;
+      }
+      if (!vals.empty() && k != key) {
+        emit_before(&key);
+        if (!stop) {
+          emit(key, std::move(vals));
+        }
+        vals.clear();
+      }
+      key = std::move(k);
+      vals.push_back(leaf_node->fetch(i));
+    }
+    if (!p || stop) {
+      break;
+    }
+
+    PageId page_id = leaf_node->next();
+    if (page_id == 0 || page_id == INVALID_PAGE_ID) {
+      break;
+    }
+    p = read_page(page_id, view);
+  }
+  if (!vals.empty() && !stop) {
+    emit_before(&key);
+    if (!stop) {
+      emit(key, std::move(vals));
+    }
+  }
+  emit_before(nullptr);
+  return count;
+}
+
+inline void BPlusTree::collect_buffered(
+    PageId id, size_t depth, size_t levels, const key_type &lo,
+    const key_type &hi, std::vector<std::pair<size_t, Message>> &out) {
+  std::shared_ptr<const InternalNode> node;
+  if (auto it = resident_.find(id); it != resident_.end()) {
+    node = it->second;
+  } else {
+    Page view{nullptr};
+    Page *p = read_page(id, view);
+    if (!p) {
+      return;
+    }
+    node = read_node<InternalNode>(p);
+    release_page(p);
+  }
+
+  for (auto &msg : node->messages()) {
+    if (msg.key < lo) {
+      continue;
+    }
+    if (!hi.empty() && !(msg.key < hi)) {
+      break;
+    }
+    out.emplace_back(depth, msg);
+  }
+  // the children of the last internal level are leaves
+  if (depth + 1 == levels) {
+    return;
+  }
+  size_t first = std::max(node->child_idx(lo), 0);
+  for (size_t i = first; i < node->size(); ++i) {
+    if (i > first && !hi.empty() && !(node->key(i) < hi)) {
+      break;
+    }
+    collect_buffered(node->item(i).child, depth + 1, levels, lo, hi, out);
+  }
+}
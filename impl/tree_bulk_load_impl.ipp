@@ -0,0 +1,198 @@
+#pragma once
+
+// #include "../bplus_tree.hpp"
+
+// append child to the right most node of levels[level], if the node is full
+// a new node is started with key as its first key, and it is appended to the
+// level above. return the page id of the node which holds the child now.
+// the new pages are added to built, a failure leaves pinned only the pages
+// of levels
+inline PageId BPlusTree::bulk_append(std::vector<BulkLevel> &levels,
+                                     size_t level, const key_type &key,
+                                     PageId child, size_t limit,
+                                     std::vector<PageId> &built) {
+  levels[level].node.insert(key, child);
+  if (levels[level].node.size() == 1 || levels[level].node.less_than(limit)) {
+    return levels[level].page->id;
+  }
+  levels[level].node.remove(static_cast<int>(levels[level].node.size() - 1));
+
+  auto page = buffer_pool_.new_page();
+  if (!page) {
+    LOG_DEBUG << "new page failed";
+    return INVALID_PAGE_ID;
+  }
+  page->page_type = kInternalPageType;
+  built.push_back(page->id);
+
+  if (level + 1 == levels.size()) {
+    // the old node is the left most child of the new level
+    auto up = buffer_pool_.new_page();
+    if (!up) {
+      LOG_DEBUG << "new page failed";
+      buffer_pool_.unpin(page->id, false);
+      return INVALID_PAGE_ID;
+    }
+    up->page_type = kInternalPageType;
+    built.push_back(up->id);
+    BulkLevel top;
+    top.page = up;
+    top.node.set_parent(INVALID_PAGE_ID);
+    top.node.insert(key_type{}, levels[level].page->id);
+    levels[level].node.set_parent(up->id);
+    levels.push_back(std::move(top));
+  }
+
+  PageId parent = bulk_append(levels, level + 1, key, page->id, limit, built);
+  if (parent == INVALID_PAGE_ID) {
+    buffer_pool_.unpin(page->id, false);
+    return INVALID_PAGE_ID;
+  }
+
+  write_node(levels[level].node, levels[level].page);
+
+  levels[level] = BulkLevel();
+  levels[level].page = page;
+  levels[level].node.set_parent(parent);
+  levels[level].node.insert(key, child);
+  return page->id;
+}
+
+// fill leaves from left to right, every leaf registers its first key in the
+// level above when it is started, so the parent of a node is known before the
+// node is written and no page is written twice. a failed build frees its
+// pages and leaves the tree empty.
+inline bool BPlusTree::bulk_build(
+    const std::function<bool(key_type &, value_type &)> &next,
+    double fill_factor) {
+  if (readonly_) {
+    return false;
+  }
+  std::unique_lock<std::shared_mutex> lock{latch_};
+  version_++;
+  if (root_ != INVALID_PAGE_ID) {
+    LOG_DEBUG << "bulk build needs an empty tree";
+    return false;
+  }
+
+  size_t limit = static_cast<size_t>(PAGE_SIZE * fill_factor);
+  if (limit > PAGE_SIZE) {
+    limit = PAGE_SIZE;
+  }
+
+  key_type k;
+  value_type v;
+  if (!next(k, v)) {
+    return true;
+  }
+
+  auto leaf_page = buffer_pool_.new_page();
+  if (!leaf_page) {
+    LOG_DEBUG << "new page failed";
+    return false;
+  }
+  leaf_page->page_type = kLeafPageType;
+  auto leaf = LeafNode();
+  leaf.set_parent(INVALID_PAGE_ID);
+  leaf.insert(std::move(k), std::move(v));
+
+  std::vector<BulkLevel> levels;
+  // every page of the build, the pinned ones are the current leaf and the
+  // right most node of each level
+  std::vector<PageId> built{leaf_page->id};
+  bool ok = leaf.less_than(PAGE_SIZE);
+
+  while (ok && next(k, v)) {
+    leaf.insert(k, v);
+    if (leaf.less_than(limit)) {
+      continue;
+    }
+    leaf.remove(static_cast<int>(leaf.size() - 1));
+
+    auto new_leaf_page = buffer_pool_.new_page();
+    if (!new_leaf_page) {
+      LOG_DEBUG << "new page failed";
+      ok = false;
+      break;
+    }
+    new_leaf_page->page_type = kLeafPageType;
+    built.push_back(new_leaf_page->id);
+
+    if (levels.empty()) {
+      auto up = buffer_pool_.new_page();
+      if (!up) {
+        LOG_DEBUG << "new page failed";
+        buffer_pool_.unpin(new_leaf_page->id, false);
+        ok = false;
+        break;
+      }
+      up->page_type = kInternalPageType;
+      built.push_back(up->id);
+      BulkLevel top;
+      top.page = up;
+      top.node.set_parent(INVALID_PAGE_ID);
+      top.node.insert(key_type{}, leaf_page->id);
+      leaf.set_parent(up->id);
+      levels.push_back(std::move(top));
+    }
+
+    // internal nodes leave the room of their write buffer
+    PageId parent =
+        bulk_append(levels, 0, k, new_leaf_page->id,
+                    std::min(limit, PAGE_SIZE - write_buffer_), built);
+    if (parent == INVALID_PAGE_ID) {
+      buffer_pool_.unpin(new_leaf_page->id, false);
+      ok = false;
+      break;
+    }
+
+    leaf.set_next(new_leaf_page->id);
+    write_node(leaf, leaf_page);
+
+    leaf_page = new_leaf_page;
+    leaf = LeafNode();
+    leaf.set_parent(parent);
+    leaf.insert(std::move(k), std::move(v));
+    ok = leaf.less_than(PAGE_SIZE);
+  }
+
+  if (!leaf.less_than(PAGE_SIZE)) {
+    LOG_DEBUG << "record is larger than a page";
+    ok = false;
+  }
+  if (!ok) {
+    buffer_pool_.unpin(leaf_page->id, false);
+    for (auto &level : levels) {
+      buffer_pool_.unpin(level.page->id, false);
+    }
+    for (auto id : built) {
+      buffer_pool_.free_page(id);
+    }
+    return false;
+  }
+
+  // close the right most nodes from bottom to top
+  leaf.set_next(INVALID_PAGE_ID);
+  write_node(leaf, leaf_page);
+  PageId root = leaf_page->id;
+  for (auto &level : levels) {
+    root = level.page->id;
+    write_node(level.node, level.page);
+  }
+
+  root_ = root;
+  buffer_pool_.set_root(root_);
+  if (cow_) {
+    publish_cow(root_, {});
+  } else if (buffer_pool_.options_.wal.enabled) {
+    // the pages of a bulk build aren't logged, they are made durable at once
+    buffer_pool_.checkpoint();
+  }
+  rebuild_resident();
+  if (filter_.load()) {
+    rebuild_filter();
+  }
+  LOG_DEBUG << "bulk build root : " << root_ << " height "
+            << levels.size() + 1;
+  return true;
+}
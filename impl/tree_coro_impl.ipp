@@ -0,0 +1,156 @@
+#pragma once
+
+//#include "../bplus_tree.hpp"
+
+inline Task<Page *> BPlusTree::co_find_leaf(const key_type &key,
+                                            uint64_t &version, bool first) {
+  while (true) {
+    PageId page_id;
+    {
+      std::shared_lock<std::shared_mutex> lock{latch_};
+      if (root_ == INVALID_PAGE_ID) {
+        co_return nullptr;
+      }
+      version = version_;
+      page_id = descend_resident(root_, key, first);
+    }
+
+    bool restart = false;
+    while (!restart) {
+      Page *p = co_await buffer_pool_.co_fetch(page_id);
+      if (!p) {
+        LOG_DEBUG << "fetch page failed " << page_id;
+        co_return nullptr;
+      }
+      std::shared_lock<std::shared_mutex> lock{latch_};
+      if (version_ != version) {
+        // a writer changed the tree while the page was read
+        restart = true;
+      } else if (p->page_type == kInternalPageType) {
+        auto node = read_node<InternalNode>(p);
+        page_id = first ? node->item(node->first_child_idx(key)).child
+                        : node->child(key);
+      } else {
+        co_return p;
+      }
+      lock.unlock();
+      buffer_pool_.unpin(p->id, false);
+    }
+  }
+}
+
+inline Task<bool> BPlusTree::co_search(key_type key, value_type &val) {
+  if (filter_rejects(key)) {
+    co_return false;
+  }
+  if (readonly_ || write_buffer_ > 0) {
+    // a fault on the mapping blocks the worker, there is nothing to await.
+    // the buffers on the path are checked by search
+    co_return search(key, val);
+  }
+  while (true) {
+    uint64_t version;
+    Page *p = co_await co_find_leaf(key, version);
+    if (!p) {
+      co_return false;
+    }
+
+    std::shared_lock<std::shared_mutex> lock{latch_};
+    if (version_ != version) {
+      lock.unlock();
+      buffer_pool_.unpin(p->id, false);
+      continue;
+    }
+    auto leaf_node = read_node<LeafNode>(p);
+    lock.unlock();
+    buffer_pool_.unpin(p->id, false);
+    bool found = leaf_node->get(key, val);
+    if (!found && filter_.load()) {
+      filter_false_positives_++;
+    }
+    co_return found;
+  }
+}
+
+inline Task<bool> BPlusTree::co_insert(key_type key, value_type val) {
+  if (readonly_) {
+    co_return false;
+  }
+  // bring the path into the pool without blocking the worker, the insert
+  // itself then runs on resident pages
+  uint64_t version;
+  Page *p = co_await co_find_leaf(key, version);
+  bool ok = insert(std::move(key), std::move(val));
+  if (p) {
+    buffer_pool_.unpin(p->id, false);
+  }
+  co_return ok;
+}
+
+inline Task<size_t> BPlusTree::co_scan(key_type lo, key_type hi, scan_fn fn) {
+  if (readonly_ || cow_ || write_buffer_ > 0) {
+    co_return scan(lo, hi, fn);
+  }
+  size_t count = 0;
+  // a restart continues after the records of from it visited, a key may
+  // have many records
+  key_type from = std::move(lo);
+  size_t visited = 0;
+  ReadAhead read_ahead{*this};
+
+  while (true) {
+    uint64_t version;
+    Page *p = co_await co_find_leaf(from, version, true);
+    if (!p) {
+      co_return count;
+    }
+    size_t skip = visited;
+
+    while (true) {
+      std::shared_lock<std::shared_mutex> lock{latch_};
+      if (version_ != version) {
+        lock.unlock();
+        buffer_pool_.unpin(p->id, false);
+        break;
+      }
+      auto leaf_node = read_node<LeafNode>(p);
+      read_ahead.advance(p->id, *leaf_node);
+      lock.unlock();
+      buffer_pool_.unpin(p->id, false);
+
+      for (auto i = 0; i < leaf_node->size(); ++i) {
+        auto k = leaf_node->key(i);
+        if (k < from) {
+          continue;
+        }
+        if (k == from && skip > 0) {
+          --skip;
+          continue;
+        }
+        if (!hi.empty() && !(k < hi)) {
+          co_return count;
+        }
+        ++count;
+        if (!fn(k, leaf_node->fetch(i))) {
+          co_return count;
+        }
+        if (k == from) {
+          ++visited;
+        } else {
+          from = std::move(k);
+          visited = 1;
+        }
+      }
+
+      PageId page_id = leaf_node->next();
+      if (page_id == 0 || page_id == INVALID_PAGE_ID) {
+        co_return count;
+      }
+      p = co_await buffer_pool_.co_fetch(page_id);
+      if (!p) {
+        LOG_DEBUG << "fetch page failed " << page_id;
+        co_return count;
+      }
+    }
+  }
+}
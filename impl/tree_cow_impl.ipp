@@ -0,0 +1,252 @@
+#pragma once
+
+//#include "../bplus_tree.hpp"
+
+inline BPlusTree::CowReader::CowReader(BPlusTree &tree) {
+  for (auto &slot : tree.cow_readers_) {
+    uint64_t free = 0;
+    // claimed with a version no write waits for
+    if (slot.compare_exchange_strong(free, UINT64_MAX)) {
+      slot_ = &slot;
+      break;
+    }
+  }
+  if (!slot_) {
+    lock_ = std::shared_lock<std::shared_mutex>{tree.latch_};
+    root_ = tree.root_;
+    return;
+  }
+  // a write which published a newer version before the slot was set may
+  // have missed it, then the slot is set again
+  uint64_t version;
+  do {
+    version = tree.cow_version_.load();
+    slot_->store(version);
+    root_ = tree.cow_root_.load();
+  } while (tree.cow_version_.load() != version);
+}
+
+inline BPlusTree::CowReader::~CowReader() {
+  if (slot_) {
+    slot_->store(0);
+  }
+}
+
+template <typename NodeType>
+inline bool BPlusTree::write_cow(NodeType &node, PageId &left, PageId &right,
+                                 key_type &sep) {
+  constexpr int type = std::is_same_v<NodeType, LeafNode> ? kLeafPageType
+                                                          : kInternalPageType;
+  // readers find the pages from the root, parents and next pointers of
+  // copies are not kept
+  node.set_parent(INVALID_PAGE_ID);
+  right = INVALID_PAGE_ID;
+  NodeType half;
+  if (!node.less_than(PAGE_SIZE)) {
+    node.move_half_to(half);
+    sep = half.key(0);
+  }
+
+  auto page = buffer_pool_.new_page();
+  if (!page) {
+    LOG_DEBUG << "new page failed";
+    return false;
+  }
+  page->page_type = type;
+  left = page->id;
+  write_node(node, page);
+  if (half.size() == 0) {
+    return true;
+  }
+
+  page = buffer_pool_.new_page();
+  if (!page) {
+    LOG_DEBUG << "new page failed";
+    return false;
+  }
+  page->page_type = type;
+  right = page->id;
+  write_node(half, page);
+  return true;
+}
+
+inline bool BPlusTree::insert_cow(key_type key, value_type val) {
+  std::vector<PageId> freed;
+  // the internal nodes from the root down and the child taken in each
+  std::vector<std::pair<std::shared_ptr<const InternalNode>, int>> path;
+  auto leaf = LeafNode();
+  if (root_ != INVALID_PAGE_ID) {
+    PageId page_id = root_;
+    Page *p = buffer_pool_.fetch(page_id);
+    while (p->page_type == kInternalPageType) {
+      auto node = read_node<InternalNode>(p);
+      buffer_pool_.unpin(page_id);
+      freed.push_back(page_id);
+      int idx = node->child_idx(key);
+      page_id = node->item(idx).child;
+      path.emplace_back(std::move(node), idx);
+      p = buffer_pool_.fetch(page_id);
+    }
+    leaf.read(p);
+    buffer_pool_.unpin(page_id);
+    freed.push_back(page_id);
+  }
+  leaf.insert(std::move(key), std::move(val));
+  leaf.set_next(INVALID_PAGE_ID);
+
+  // a failed write publishes nothing, the tree stays as it was
+  PageId left, right;
+  key_type sep;
+  if (!write_cow(leaf, left, right, sep)) {
+    return false;
+  }
+  for (auto it = path.rbegin(); it != path.rend(); ++it) {
+    InternalNode node = *it->first;
+    node.set_child(it->second, left);
+    if (right != INVALID_PAGE_ID) {
+      node.insert(std::move(sep), right);
+    }
+    if (!write_cow(node, left, right, sep)) {
+      return false;
+    }
+  }
+  if (right != INVALID_PAGE_ID) {
+    auto root = InternalNode();
+    root.insert(key_type{}, left);
+    root.insert(std::move(sep), right);
+    if (!write_cow(root, left, right, sep)) {
+      return false;
+    }
+  }
+
+  publish_cow(left, std::move(freed));
+  return true;
+}
+
+inline void BPlusTree::publish_cow(PageId root, std::vector<PageId> freed) {
+  root_ = root;
+  buffer_pool_.set_root(root);
+  cow_root_.store(root);
+  uint64_t version = cow_version_.load() + 1;
+  cow_version_.store(version);
+  if (!freed.empty()) {
+    cow_freed_.emplace_back(version, std::move(freed));
+  }
+  if (buffer_pool_.options_.cow.sync) {
+    buffer_pool_.checkpoint();
+    durable_version_ = version;
+  }
+  recycle_cow();
+}
+
+inline void BPlusTree::recycle_cow() {
+  uint64_t oldest = durable_version_;
+  for (auto &slot : cow_readers_) {
+    uint64_t version = slot.load();
+    if (version != 0) {
+      oldest = std::min(oldest, version);
+    }
+  }
+  {
+    std::unique_lock<std::mutex> lock{snapshots_mutex_};
+    if (!snapshots_.empty()) {
+      oldest = std::min(oldest, *snapshots_.begin());
+    }
+  }
+  // the pages replaced by version v are used by the versions before it
+  while (!cow_freed_.empty() && cow_freed_.front().first <= oldest) {
+    for (auto id : cow_freed_.front().second) {
+      buffer_pool_.free_page(id);
+    }
+    cow_freed_.pop_front();
+  }
+}
+
+inline void BPlusTree::checkpoint() {
+  if (readonly_) {
+    return;
+  }
+  std::unique_lock<std::shared_mutex> lock{latch_};
+  buffer_pool_.checkpoint();
+  if (cow_) {
+    durable_version_ = cow_version_.load();
+    recycle_cow();
+  }
+}
+
+inline bool BPlusTree::search_cow(const key_type &key, value_type &val) {
+  CowReader reader{*this};
+  return search_from(reader.root(), key, val);
+}
+
+inline bool BPlusTree::search_from(PageId root, const key_type &key,
+                                   value_type &val) {
+  if (root == INVALID_PAGE_ID) {
+    return false;
+  }
+  PageId page_id = root;
+  Page *p = buffer_pool_.fetch(page_id);
+  while (p && p->page_type == kInternalPageType) {
+    auto node = read_node<InternalNode>(p);
+    buffer_pool_.unpin(page_id);
+    page_id = node->child(key);
+    p = buffer_pool_.fetch(page_id);
+  }
+  if (!p) {
+    return false;
+  }
+  auto leaf_node = read_node<LeafNode>(p);
+  buffer_pool_.unpin(page_id);
+  return leaf_node->get(key, val);
+}
+
+template <typename NodeType>
+inline std::shared_ptr<const NodeType> BPlusTree::load_node(PageId id) {
+  Page *p = buffer_pool_.fetch(id);
+  if (!p) {
+    return nullptr;
+  }
+  auto node = read_node<NodeType>(p);
+  buffer_pool_.unpin(id);
+  return node;
+}
+
+inline bool BPlusTree::scan_cow(PageId id, const key_type &lo,
+                                const key_type &hi, const scan_fn &fn,
+                                size_t &count) {
+  Page *p = buffer_pool_.fetch(id);
+  if (!p) {
+    return false;
+  }
+  if (p->page_type == kInternalPageType) {
+    auto node = read_node<InternalNode>(p);
+    buffer_pool_.unpin(id);
+    size_t first = std::max(node->child_idx(lo), 0);
+    for (size_t i = first; i < node->size(); ++i) {
+      if (i > first && !hi.empty() && !(node->key(i) < hi)) {
+        return false;
+      }
+      if (!scan_cow(node->item(i).child, lo, hi, fn, count)) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  auto leaf_node = read_node<LeafNode>(p);
+  buffer_pool_.unpin(id);
+  for (auto i = 0; i < leaf_node->size(); ++i) {
+    auto k = leaf_node->key(i);
+    if (k < lo) {
+      continue;
+    }
+    if (!hi.empty() && !(k < hi)) {
+      return false;
+    }
+    ++count;
+    if (!fn(k, leaf_node->fetch(i))) {
+      return false;
+    }
+  }
+  return true;
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+//#include "../bplus_tree.hpp"
+
+inline void BPlusTree::rebuild_filter() {
+  std::vector<uint64_t> hashes;
+  auto add = [&](const key_type &key, const value_type &) {
+    hashes.push_back(BloomFilter::hash({key.data(), key.size()}));
+    return true;
+  };
+  if (cow_) {
+    size_t count = 0;
+    if (root_ != INVALID_PAGE_ID) {
+      scan_cow(root_, {}, {}, add, count);
+    }
+  } else {
+    scan_locked({}, {}, add);
+  }
+
+  // room to double before the next build
+  filter_capacity_ = std::max(hashes.size() * 2, kMinFilterKeys);
+  auto filter = std::make_shared<BloomFilter>(
+      filter_capacity_, buffer_pool_.options_.filter.bits_per_key);
+  for (auto h : hashes) {
+    filter->add(h);
+  }
+  filter_removed_ = 0;
+  filter_stats_.keys = hashes.size();
+  filter_stats_.bytes = filter->bytes();
+  filter_stats_.rebuilds++;
+  filter_.store(std::move(filter));
+}
+
+inline void BPlusTree::filter_write(const Message &msg) {
+  auto filter = filter_.load();
+  if (!filter) {
+    return;
+  }
+  // a removed key stays in the filter until it is built again
+  if (msg.type == Message::kDelete) {
+    filter_removed_++;
+  }
+  if (filter_stats_.keys >= filter_capacity_ ||
+      filter_removed_ > filter_capacity_ / 4) {
+    rebuild_filter();
+    filter = filter_.load();
+  }
+  if (msg.type != Message::kDelete) {
+    filter->add(BloomFilter::hash({msg.key.data(), msg.key.size()}));
+    filter_stats_.keys++;
+  }
+}
+
+inline bool BPlusTree::filter_rejects(const key_type &key) {
+  auto filter = filter_.load();
+  if (!filter ||
+      filter->may_contain(BloomFilter::hash({key.data(), key.size()}))) {
+    return false;
+  }
+  filter_negatives_++;
+  return true;
+}
+
+inline FilterStats BPlusTree::filter_stats() {
+  auto lock = read_latch();
+  FilterStats stats = filter_stats_;
+  stats.negatives = filter_negatives_.load();
+  stats.false_positives = filter_false_positives_.load();
+  return stats;
+}
@@ -22,6 +22,7 @@ inline bool BPlusTree::make_tree(key_type k, value_type v) {
   leaf_node.insert(std::move(k), std::move(v));
   leaf_node.write(root);
   root_ = root->id;
+  buffer_pool_.set_root(root_);
   buffer_pool_.unpin(root->id, true);
 
   LOG_DEBUG << "make tree : " << root->id;
@@ -53,6 +54,8 @@ inline bool BPlusTree::make_root(key_type k, PageId left, PageId right) {
 
   internal_node.write(root);
   root_ = root->id;
+  resident_stale_ = true;
+  buffer_pool_.set_root(root_);
   buffer_pool_.unpin(root->id, true);
 
   set_parent(left, root->id);
@@ -64,6 +67,67 @@ inline bool BPlusTree::make_root(key_type k, PageId left, PageId right) {
 }
 
 inline bool BPlusTree::insert(key_type key, value_type val) {
+  return write({Message::kInsert, std::move(key), std::move(val)});
+}
+
+inline bool BPlusTree::upsert(key_type key, value_type val) {
+  return write({Message::kUpsert, std::move(key), std::move(val)});
+}
+
+inline bool BPlusTree::write(Message msg) {
+  if (readonly_) {
+    return false;
+  }
+  std::unique_lock<std::shared_mutex> lock{latch_};
+  version_++;
+  if (cow_ && msg.type != Message::kInsert) {
+    LOG_DEBUG << "copy-on-write mode only inserts";
+    return false;
+  }
+  filter_write(msg);
+  if (cow_) {
+    return insert_cow(std::move(msg.key), std::move(msg.val));
+  }
+  buffer_pool_.begin_txn();
+  bool ok = write_buffer_ > 0 && root_ != INVALID_PAGE_ID
+                ? flush_down(root_, {std::move(msg)})
+                : apply(std::move(msg));
+  auto lsn = buffer_pool_.commit_txn();
+  lock.unlock();
+  // other writers may join the log sync while this one waits
+  return buffer_pool_.wait_durable(lsn) && ok;
+}
+
+inline bool BPlusTree::apply(Message msg) {
+  switch (msg.type) {
+  case Message::kInsert:
+    return insert_locked(std::move(msg.key), std::move(msg.val));
+  case Message::kUpsert:
+    return upsert_locked(std::move(msg.key), std::move(msg.val));
+  case Message::kDelete:
+    return remove_locked(msg.key);
+  }
+  return false;
+}
+
+inline bool BPlusTree::upsert_locked(key_type key, value_type val) {
+  if (root_ != INVALID_PAGE_ID) {
+    auto p = find_leaf(key);
+    auto leaf_node = LeafNode();
+    leaf_node.read(p);
+    auto [exist, idx] = leaf_node.find(key);
+    if (!exist) {
+      buffer_pool_.unpin(p->id, false);
+    } else {
+      // the insert below puts the new value where the old one was
+      leaf_node.remove(idx);
+      write_node(leaf_node, p);
+    }
+  }
+  return insert_locked(std::move(key), std::move(val));
+}
+
+inline bool BPlusTree::insert_locked(key_type key, value_type val) {
   if (root_ == INVALID_PAGE_ID) {
     return make_tree(std::move(key), std::move(val));
   }
@@ -113,8 +177,12 @@ inline bool BPlusTree::insert(key_type key, value_type val) {
   LOG_DEBUG << "insert parent " << leaf_node.parent() << " left " << left_id
             << " right " << right_id;
 
-  return insert_parent(leaf_node.parent(), p->id, new_page->id,
-                       new_leaf_node.key(0));
+  bool ok = insert_parent(leaf_node.parent(), p->id, new_page->id,
+                          new_leaf_node.key(0));
+  if (resident_stale_) {
+    rebuild_resident();
+  }
+  return ok;
 }
 
 inline bool BPlusTree::insert_parent(PageId parent, PageId left, PageId right,
@@ -131,8 +199,9 @@ inline bool BPlusTree::insert_parent(PageId parent, PageId left, PageId right,
   node.read(page);
   node.insert(std::move(key), right);
 
-  if (node.less_than(PAGE_SIZE)) {
+  if (fits(node)) {
     node.write(page);
+    update_resident(page->id, node);
     buffer_pool_.unpin(page->id, true);
     return true;
   }
@@ -171,6 +240,10 @@ inline bool BPlusTree::insert_parent(PageId parent, PageId left, PageId right,
 
   node.write(page);
   new_node.write(new_page);
+  if (resident_.count(page->id)) {
+    update_resident(page->id, node);
+    resident_stale_ = true;
+  }
 
   buffer_pool_.unpin(page->id, true);
   buffer_pool_.unpin(new_page->id, true);
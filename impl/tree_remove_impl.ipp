@@ -1,29 +1,182 @@
 #pragma once
 
-#include "../bplus_tree.hpp"
+// #include "../bplus_tree.hpp"
 
 inline bool BPlusTree::remove(const key_type &key) {
-    auto page = find_leaf(key);
-    if (page == nullptr) {
-        return false;
+  return write({Message::kDelete, key, {}});
+}
+
+// the records of key are removed from their leaf, a leaf which gets small
+// isn't merged with its siblings
+inline bool BPlusTree::remove_locked(const key_type &key) {
+  if (root_ == INVALID_PAGE_ID) {
+    return false;
+  }
+  auto p = find_leaf(key);
+  auto leaf_node = LeafNode();
+  leaf_node.read(p);
+  bool removed = false;
+  while (leaf_node.remove(key)) {
+    removed = true;
+  }
+  if (!removed) {
+    buffer_pool_.unpin(p->id, false);
+    return false;
+  }
+  write_node(leaf_node, p);
+  return true;
+}
+
+inline bool BPlusTree::remove_range(const key_type &lo, const key_type &hi) {
+  if (readonly_) {
+    return false;
+  }
+  std::unique_lock<std::shared_mutex> lock{latch_};
+  version_++;
+  if (cow_) {
+    LOG_DEBUG << "copy-on-write mode only inserts";
+    return false;
+  }
+  if (root_ == INVALID_PAGE_ID || (!hi.empty() && !(lo < hi))) {
+    return true;
+  }
+
+  buffer_pool_.begin_txn();
+  RangeRemoval rm{lo, hi, INVALID_PAGE_ID, INVALID_PAGE_ID, {}};
+  // the internal levels on the way to the leaf of lo, all leaves are as deep
+  size_t levels = 0;
+  for (PageId id = root_;;) {
+    Page *p = buffer_pool_.fetch(id);
+    assert(p);
+    if (p->page_type != kInternalPageType) {
+      buffer_pool_.unpin(id);
+      rm.left = id;
+      break;
     }
+    auto node = read_node<InternalNode>(p);
+    buffer_pool_.unpin(id);
+    ++levels;
+    id = node->child(lo);
+  }
+  if (!hi.empty()) {
+    Page *p = find_leaf(hi);
+    rm.right = p->id;
+    buffer_pool_.unpin(p->id);
+  }
 
-    auto leaf = LeafNode();
-    leaf.read(page);
-    bool leaf_remove_ok = leaf.remove(key);
+  key_type first;
+  bool ok = remove_range_in(root_, levels, {}, rm, first);
+  for (auto id : rm.freed) {
+    buffer_pool_.free_page(id);
+  }
+  // a root left with one child hands the tree to it, unless it buffers
+  // writes for it
+  bool shrunk = false;
+  while (ok && levels > 0) {
+    auto root = load_node<InternalNode>(root_);
+    if (!root || root->size() != 1 || !root->messages().empty()) {
+      break;
+    }
+    buffer_pool_.free_page(root_);
+    root_ = root->item(0).child;
+    buffer_pool_.set_root(root_);
+    ok = set_parent(root_, INVALID_PAGE_ID);
+    --levels;
+    shrunk = true;
+  }
+  if (!rm.freed.empty() || shrunk) {
+    rebuild_resident();
+  }
+  if (adaptive_hash_) {
+    // a freed leaf keeps its frame and version until the page is reused
+    adaptive_hash_->clear();
+  }
+  auto lsn = buffer_pool_.commit_txn();
+  lock.unlock();
+  return buffer_pool_.wait_durable(lsn) && ok;
+}
 
-    if (!leaf_remove_ok) {
-        buffer_pool_.unpin(page->id);
-        return false;
+inline bool BPlusTree::remove_range_in(PageId id, size_t levels,
+                                       const key_type &upper,
+                                       RangeRemoval &rm, key_type &first) {
+  Page *p = buffer_pool_.fetch(id);
+  if (!p) {
+    LOG_DEBUG << "fetch page failed " << id;
+    return false;
+  }
+  if (levels == 0) {
+    auto leaf_node = LeafNode();
+    leaf_node.read(p);
+    int idx = leaf_node.find_idx(rm.lo);
+    while (idx < leaf_node.size() &&
+           (rm.hi.empty() || leaf_node.key(idx) < rm.hi)) {
+      leaf_node.remove(idx);
     }
+    if (id == rm.left && rm.right != rm.left) {
+      leaf_node.set_next(rm.right);
+    }
+    write_node(leaf_node, p);
+    return true;
+  }
 
-    bool need_coalesce = leaf.less_than(coalesce_size());
-    if (!need_coalesce) {
-        write_node(leaf, page);
-        return true;
+  // the child at i holds the keys in [key(i), key(i + 1)), the last one
+  // those below upper. the children inside the range are next to each other
+  InternalNode node = *read_node<InternalNode>(p);
+  key_type old_first = node.key(0);
+  size_t drop_begin = node.size(), drop_end = node.size();
+  bool ok = true;
+  for (size_t i = 0; i < node.size() && ok; ++i) {
+    const key_type &lower = node.key(i);
+    const key_type &child_upper = i + 1 < node.size() ? node.key(i + 1) : upper;
+    if ((!child_upper.empty() && !(rm.lo < child_upper)) ||
+        (!rm.hi.empty() && !(lower < rm.hi))) {
+      continue;
+    }
+    // the leaf of lo is kept, the range starts above the child
+    if (rm.lo < lower &&
+        (rm.hi.empty() || (!child_upper.empty() && !(rm.hi < child_upper)))) {
+      drop_begin = std::min(drop_begin, i);
+      drop_end = i + 1;
+      ok = drop_subtree(node.item(i).child, levels - 1, rm.freed);
+      continue;
+    }
+    key_type child_first;
+    ok = remove_range_in(node.item(i).child, levels - 1, child_upper, rm,
+                         child_first);
+    if (!child_first.empty()) {
+      node.set_key(i, std::move(child_first));
     }
+  }
 
-    // coalesce
-    
+  // the first key of a node is the key of it in its parent, a node whose
+  // first children are gone starts at the next one
+  assert(drop_end - drop_begin < node.size() || drop_begin == node.size());
+  for (size_t i = drop_begin; i < drop_end; ++i) {
+    node.remove(static_cast<int>(drop_begin));
+  }
+  node.remove_buffered(rm.lo, rm.hi);
+  if (node.key(0) != old_first) {
+    first = node.key(0);
+  }
+  node.write(p);
+  update_resident(id, node);
+  buffer_pool_.unpin(id, true);
+  return ok;
+}
 
-}
\ No newline at end of file
+inline bool BPlusTree::drop_subtree(PageId id, size_t levels,
+                                    std::vector<PageId> &freed) {
+  if (levels > 0) {
+    auto node = load_node<InternalNode>(id);
+    if (!node) {
+      return false;
+    }
+    for (size_t i = 0; i < node->size(); ++i) {
+      if (!drop_subtree(node->item(i).child, levels - 1, freed)) {
+        return false;
+      }
+    }
+  }
+  freed.push_back(id);
+  return true;
+}
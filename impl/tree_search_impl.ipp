@@ -2,14 +2,174 @@
 
 //#include "../bplus_tree.hpp"
 
+inline BPlusTree::BPlusTree(std::string_view db_name, MmapFile file,
+                            MmapOptions options)
+    : buffer_pool_(db_name, 1), readonly_(true), mapped_(std::move(file)) {
+  const char *meta_data = mapped_.page(0);
+  if (!meta_data) {
+    throw std::runtime_error("not a tree file");
+  }
+  BfpMetaPage meta{const_cast<char *>(meta_data)};
+  meta.deserialize();
+  if (!meta.valid()) {
+    throw std::runtime_error("not a tree file");
+  }
+  root_ = meta.root;
+  write_buffer_ = meta.write_buffer;
+
+  if (options.random) {
+    mapped_.random();
+  }
+  // only the levels above the last hinted one are read here
+  std::vector<PageId> level;
+  if (root_ != INVALID_PAGE_ID) {
+    level.push_back(root_);
+  }
+  for (size_t depth = 0; depth < options.will_need_levels && !level.empty();
+       ++depth) {
+    std::vector<PageId> below;
+    for (auto id : level) {
+      mapped_.will_need(id, 1);
+      if (depth + 1 == options.will_need_levels) {
+        continue;
+      }
+      Page view{nullptr};
+      Page *p = read_page(id, view);
+      if (p && p->page_type == kInternalPageType) {
+        auto internal_node = InternalNode();
+        internal_node.read(p);
+        for (size_t i = 0; i < internal_node.size(); ++i) {
+          below.push_back(internal_node.item(i).child);
+        }
+      }
+    }
+    level = std::move(below);
+  }
+}
+
+inline std::unique_ptr<BPlusTree>
+BPlusTree::open_readonly_mmap(std::string_view db_name, MmapOptions options) {
+  MmapFile file{std::string(db_name), PAGE_SIZE};
+  return std::unique_ptr<BPlusTree>(
+      new BPlusTree(db_name, std::move(file), options));
+}
+
+inline Page *BPlusTree::read_page(PageId id, Page &view) {
+  if (!readonly_) {
+    return buffer_pool_.fetch(id);
+  }
+  if (id <= 0) {
+    return nullptr;
+  }
+  // the mapping is PROT_READ, a write through the view faults
+  view.data = const_cast<char *>(mapped_.page(id));
+  if (!view.data) {
+    return nullptr;
+  }
+  view.deserialize();
+  return &view;
+}
+
+inline void BPlusTree::release_page(Page *p) {
+  if (!readonly_) {
+    buffer_pool_.unpin(p->id, false);
+  }
+}
+
+inline PageId BPlusTree::descend_resident(PageId page_id, const key_type &key,
+                                          bool first) const {
+  for (auto it = resident_.find(page_id); it != resident_.end();
+       it = resident_.find(page_id)) {
+    auto &node = *it->second;
+    page_id = first ? node.item(node.first_child_idx(key)).child
+                    : node.child(key);
+  }
+  return page_id;
+}
+
+inline void BPlusTree::rebuild_resident() {
+  resident_.clear();
+  resident_stale_ = false;
+  // the pages of copy-on-write mode move with every write
+  if (readonly_ || cow_ || root_ == INVALID_PAGE_ID) {
+    return;
+  }
+  const auto &options = buffer_pool_.options_;
+  size_t budget = options.resident_budget / PAGE_SIZE;
+  std::vector<PageId> level{root_};
+  for (size_t depth = 0; depth < options.resident_levels && !level.empty();
+       ++depth) {
+    std::vector<PageId> below;
+    for (auto id : level) {
+      if (resident_.size() >= budget) {
+        return;
+      }
+      Page *p = buffer_pool_.fetch(id);
+      if (!p) {
+        return;
+      }
+      if (p->page_type != kInternalPageType) {
+        // leaves stay in the pool
+        buffer_pool_.unpin(id, false);
+        return;
+      }
+      auto node = read_node<InternalNode>(p);
+      buffer_pool_.unpin(id, false);
+      for (size_t i = 0; i < node->size(); ++i) {
+        below.push_back(node->item(i).child);
+      }
+      resident_.emplace(id, std::move(node));
+    }
+    level = std::move(below);
+  }
+}
+
+inline void BPlusTree::update_resident(PageId id, const InternalNode &node) {
+  if (auto it = resident_.find(id); it != resident_.end()) {
+    it->second = std::make_shared<InternalNode>(node);
+  }
+}
+
+inline Page *BPlusTree::find_leaf(const key_type &key, Page &view) {
+  Page *p = read_page(descend_resident(root_, key), view);
+  while (p && p->page_type == kInternalPageType) {
+    auto internal_node = read_node<InternalNode>(p);
+    release_page(p);
+    p = read_page(internal_node->child(key), view);
+  }
+  return p;
+}
+
+template <typename NodeType>
+inline std::shared_ptr<const NodeType> BPlusTree::read_node(Page *p) {
+  if (!readonly_) {
+    if (auto cached = buffer_pool_.decoded(p)) {
+      assert(dynamic_cast<const NodeType *>(cached.get()));
+      return std::static_pointer_cast<const NodeType>(std::move(cached));
+    }
+  }
+  auto node = std::make_shared<NodeType>();
+  node->read(p);
+  if (!readonly_) {
+    buffer_pool_.set_decoded(p, node);
+  }
+  return node;
+}
+
+inline std::shared_lock<std::shared_mutex> BPlusTree::read_latch() {
+  if (readonly_) {
+    return std::shared_lock<std::shared_mutex>{latch_, std::defer_lock};
+  }
+  return std::shared_lock<std::shared_mutex>{latch_};
+}
+
 inline Page *BPlusTree::find_leaf(const key_type &key) {
-  PageId page_id = root_;
+  PageId page_id = descend_resident(root_, key);
   Page *p = buffer_pool_.fetch(page_id);
   while (p->page_type == kInternalPageType) {
-    auto internal_node = InternalNode();
-    internal_node.read(p);
+    auto internal_node = read_node<InternalNode>(p);
     buffer_pool_.unpin(p->id);
-    page_id = internal_node.child(key);
+    page_id = internal_node->child(key);
     // internal_node.print();
     p = buffer_pool_.fetch(page_id);
   }
@@ -17,18 +177,209 @@ inline Page *BPlusTree::find_leaf(const key_type &key) {
 }
 
 inline bool BPlusTree::search(const key_type &key, value_type &val) {
-  auto p = find_leaf(key);
-  auto leaf_node = LeafNode();
-  leaf_node.read(p);
-  buffer_pool_.unpin(p->id, false);
-  // leaf_node.print();
-  return leaf_node.get(key, val);
+  if (filter_rejects(key)) {
+    return false;
+  }
+  bool found = search_tree(key, val);
+  if (!found && filter_.load()) {
+    filter_false_positives_++;
+  }
+  return found;
+}
+
+inline bool BPlusTree::search_tree(const key_type &key, value_type &val) {
+  if (cow_) {
+    return search_cow(key, val);
+  }
+  auto lock = read_latch();
+  if (root_ == INVALID_PAGE_ID) {
+    return false;
+  }
+  uint64_t h = 0;
+  if (adaptive_hash_) {
+    h = AdaptiveHashIndex<HashSlot>::hash({key.data(), key.size()});
+    if (search_hashed(key, h, val)) {
+      return true;
+    }
+  }
+  // the newest buffered write of key on the path is its value
+  Page view{nullptr};
+  PageId page_id = root_;
+  while (true) {
+    std::shared_ptr<const InternalNode> internal_node;
+    if (auto it = resident_.find(page_id); it != resident_.end()) {
+      internal_node = it->second;
+    } else {
+      Page *p = read_page(page_id, view);
+      if (!p) {
+        return false;
+      }
+      if (p->page_type != kInternalPageType) {
+        auto leaf_node = read_node<LeafNode>(p);
+        if (adaptive_hash_) {
+          index_hot(key, h, p, *leaf_node);
+        }
+        release_page(p);
+        // leaf_node->print();
+        return leaf_node->get(key, val);
+      }
+      internal_node = read_node<InternalNode>(p);
+      release_page(p);
+    }
+    if (auto msg = internal_node->buffered(key)) {
+      if (msg->type == Message::kDelete) {
+        return false;
+      }
+      val = msg->val;
+      return true;
+    }
+    page_id = internal_node->child(key);
+  }
+}
+
+inline BPlusTree::ReadAhead::ReadAhead(BPlusTree &tree) : tree_(tree) {
+  max_window_ = tree.buffer_pool_.options_.read_ahead;
+  if (!tree.readonly_) {
+    // prefetched leaves must stay until the scan gets there
+    max_window_ = std::min(max_window_, tree.buffer_pool_.buffer_size() / 4);
+  }
+}
+
+inline void BPlusTree::ReadAhead::advance(PageId id, const LeafNode &leaf) {
+  if (max_window_ == 0) {
+    return;
+  }
+  if (!ahead_.empty() && ahead_.front() == id) {
+    ahead_.pop_front();
+    issued_ = issued_ > 0 ? issued_ - 1 : 0;
+  } else {
+    ahead_.clear();
+    issued_ = 0;
+  }
+  if (ahead_.empty()) {
+    refill(id, leaf);
+  }
+
+  // one leaf is no scan yet
+  if (++steps_ < 2) {
+    return;
+  }
+  window_ = window_ == 0 ? std::min<size_t>(4, max_window_)
+                         : std::min(window_ * 2, max_window_);
+
+  std::vector<PageId> ids;
+  for (; issued_ < std::min(window_, ahead_.size()); ++issued_) {
+    ids.push_back(ahead_[issued_]);
+  }
+  if (tree_.readonly_) {
+    for (auto leaf_id : ids) {
+      tree_.mapped_.will_need(leaf_id, 1);
+    }
+  } else if (!ids.empty()) {
+    tree_.buffer_pool_.prefetch(ids);
+  }
+}
+
+inline void BPlusTree::ReadAhead::refill(PageId id, const LeafNode &leaf) {
+  PageId parent_id = leaf.parent();
+  if (parent_id != INVALID_PAGE_ID) {
+    std::shared_ptr<const InternalNode> parent;
+    Page view{nullptr};
+    Page *p = nullptr;
+    if (auto it = tree_.resident_.find(parent_id); it != tree_.resident_.end()) {
+      parent = it->second;
+    } else {
+      p = tree_.read_page(parent_id, view);
+      if (p && p->page_type == kInternalPageType) {
+        parent = tree_.read_node<InternalNode>(p);
+      }
+    }
+    if (parent) {
+      bool after = false;
+      for (size_t i = 0; i < parent->size(); ++i) {
+        if (after) {
+          ahead_.push_back(parent->item(i).child);
+        }
+        after = after || parent->item(i).child == id;
+      }
+    }
+    if (p) {
+      tree_.release_page(p);
+    }
+  }
+
+  // the last child of the parent
+  PageId next = leaf.next();
+  if (ahead_.empty() && next != 0 && next != INVALID_PAGE_ID) {
+    ahead_.push_back(next);
+  }
+}
+
+inline size_t BPlusTree::scan(const key_type &lo, const key_type &hi,
+                              const scan_fn &fn) {
+  if (cow_) {
+    // the leaves of copies have no next pointers, the scan walks the tree
+    CowReader reader{*this};
+    size_t count = 0;
+    if (reader.root() != INVALID_PAGE_ID) {
+      scan_cow(reader.root(), lo, hi, fn, count);
+    }
+    return count;
+  }
+  auto lock = read_latch();
+  return scan_locked(lo, hi, fn);
+}
+
+inline size_t BPlusTree::scan_locked(const key_type &lo, const key_type &hi,
+                                     const scan_fn &fn) {
+  if (root_ == INVALID_PAGE_ID) {
+    return 0;
+  }
+  if (write_buffer_ > 0) {
+    return scan_buffered(lo, hi, fn);
+  }
+
+  size_t count = 0;
+  ReadAhead read_ahead{*this};
+  Page view{nullptr};
+  Page *p = find_leaf(lo, view);
+  while (p) {
+    auto leaf_node = read_node<LeafNode>(p);
+    read_ahead.advance(p->id, *leaf_node);
+    release_page(p);
+
+    for (auto i = 0; i < leaf_node->size(); ++i) {
+      auto k = leaf_node->key(i);
+      if (k < lo) {
+        continue;
+      }
+      if (!hi.empty() && !(k < hi)) {
+        return count;
+      }
+      ++count;
+      if (!fn(k, leaf_node->fetch(i))) {
+        return count;
+      }
+    }
+
+    PageId page_id = leaf_node->next();
+    if (page_id == 0 || page_id == INVALID_PAGE_ID) {
+      break;
+    }
+    p = read_page(page_id, view);
+  }
+  return count;
 }
 
 inline void BPlusTree::print() {
+  auto lock = read_latch();
+  if (root_ == INVALID_PAGE_ID) {
+    return;
+  }
   PageId page_id = root_;
   key_type k;
-  Page *p = find_leaf(k);
+  Page view{nullptr};
+  Page *p = find_leaf(k, view);
   while (p) {
     auto leaf_node = LeafNode();
     leaf_node.read(p);
@@ -43,10 +394,10 @@ inline void BPlusTree::print() {
     std::cout << std::endl;
 
     page_id = leaf_node.next();
-    buffer_pool_.unpin(p->id, false);
+    release_page(p);
     if (page_id == 0 || page_id == INVALID_PAGE_ID) {
       break;
     }
-    p = buffer_pool_.fetch(page_id);
+    p = read_page(page_id, view);
   }
 }
\ No newline at end of file
@@ -0,0 +1,106 @@
+#pragma once
+
+//#include "../bplus_tree.hpp"
+
+inline std::shared_ptr<const BPlusTree::Snapshot> BPlusTree::snapshot() {
+  if (!cow_) {
+    LOG_DEBUG << "snapshots need copy-on-write mode";
+    return nullptr;
+  }
+  // a write publishes the root before the version and frees pages under
+  // the mutex, so the version read here is registered before its pages can
+  // be reused
+  std::unique_lock<std::mutex> lock{snapshots_mutex_};
+  uint64_t version = cow_version_.load();
+  PageId root = cow_root_.load();
+  snapshots_.insert(version);
+  return std::shared_ptr<const Snapshot>(new Snapshot(*this, version, root));
+}
+
+inline BPlusTree::Snapshot::~Snapshot() {
+  {
+    std::unique_lock<std::mutex> lock{tree_.snapshots_mutex_};
+    tree_.snapshots_.erase(tree_.snapshots_.find(version_));
+  }
+  // free what the version kept now, unless a write is running, it frees
+  // them when it publishes
+  std::unique_lock<std::shared_mutex> lock{tree_.latch_, std::try_to_lock};
+  if (lock) {
+    tree_.recycle_cow();
+  }
+}
+
+inline bool BPlusTree::Snapshot::search(const key_type &key,
+                                        value_type &val) const {
+  return tree_.search_from(root_, key, val);
+}
+
+inline size_t BPlusTree::Snapshot::scan(const key_type &lo, const key_type &hi,
+                                        const scan_fn &fn) const {
+  size_t count = 0;
+  if (root_ != INVALID_PAGE_ID) {
+    tree_.scan_cow(root_, lo, hi, fn, count);
+  }
+  return count;
+}
+
+inline BPlusTree::Cursor BPlusTree::Snapshot::cursor(const key_type &lo) const {
+  return Cursor(shared_from_this(), lo);
+}
+
+inline BPlusTree::Cursor::Cursor(std::shared_ptr<const Snapshot> snapshot,
+                                 const key_type &lo)
+    : snapshot_(std::move(snapshot)) {
+  if (snapshot_->root_ != INVALID_PAGE_ID) {
+    descend(snapshot_->root_, lo);
+    settle();
+  }
+}
+
+inline void BPlusTree::Cursor::descend(PageId id, const key_type &lo) {
+  BPlusTree &tree = snapshot_->tree_;
+  while (true) {
+    Page *p = tree.buffer_pool_.fetch(id);
+    if (!p) {
+      leaf_ = nullptr;
+      return;
+    }
+    if (p->page_type != kInternalPageType) {
+      leaf_ = tree.read_node<LeafNode>(p);
+      tree.buffer_pool_.unpin(id);
+      idx_ = leaf_->find_idx(lo);
+      return;
+    }
+    auto node = tree.read_node<InternalNode>(p);
+    tree.buffer_pool_.unpin(id);
+    size_t idx = std::max(node->child_idx(lo), 0);
+    id = node->item(idx).child;
+    path_.emplace_back(std::move(node), idx);
+  }
+}
+
+inline void BPlusTree::Cursor::settle() {
+  while (leaf_ && idx_ >= leaf_->size()) {
+    // the first ancestor with a child right of the path
+    while (!path_.empty() && path_.back().second + 1 >= path_.back().first->size()) {
+      path_.pop_back();
+    }
+    if (path_.empty()) {
+      leaf_ = nullptr;
+      return;
+    }
+    auto &[node, idx] = path_.back();
+    ++idx;
+    descend(node->item(idx).child, {});
+  }
+  if (leaf_) {
+    key_ = leaf_->key(idx_);
+    value_ = leaf_->fetch(idx_);
+  }
+}
+
+inline void BPlusTree::Cursor::next() {
+  assert(valid());
+  ++idx_;
+  settle();
+}
@@ -0,0 +1,510 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <cerrno>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include "logger.hpp"
+
+struct IoRequest {
+  enum class Op { kRead, kWrite };
+
+  Op op = Op::kRead;
+  uint64_t offset = 0;
+  char *buf = nullptr;
+  size_t len = 0;
+  // called on an io thread when the request completes, a short read at the
+  // end of the file is zero filled and counts as success
+  std::function<void(bool)> done;
+};
+
+struct IoOptions {
+  // use io_uring if the kernel supports it, else the thread pool
+  bool use_io_uring = true;
+  // open the file with O_DIRECT for requests whose buffers are aligned
+  bool direct_io = false;
+  // max requests in flight of the io_uring backend
+  unsigned queue_depth = 64;
+  // workers of the thread pool backend
+  size_t io_threads = 4;
+  // the file grows in chunks of this many bytes, which are preallocated with
+  // fallocate. 0 turns preallocation off
+  size_t extend_chunk = 4 << 20;
+};
+
+// Asynchronous page io. submit() takes a batch of requests and returns at
+// once, every request's done callback is called when it completes.
+class IoBackend {
+public:
+  virtual ~IoBackend() = default;
+
+  virtual void submit(std::vector<IoRequest> reqs) = 0;
+  // @brief buffers which are reused by many requests, such as the frames.
+  // must be called when no request is in flight
+  virtual bool register_buffers(const std::vector<iovec> &buffers) {
+    return false;
+  }
+  // @brief wait until every submitted request completed
+  void drain() {
+    std::unique_lock<std::mutex> lock{drain_mutex_};
+    drain_cv_.wait(lock, [&] { return in_flight_ == 0; });
+  }
+  size_t in_flight() const { return in_flight_; }
+  virtual const char *name() const = 0;
+
+protected:
+  void started(size_t n) { in_flight_ += n; }
+
+  void finished(IoRequest &req, bool ok) {
+    if (req.done) {
+      req.done(ok);
+    }
+    std::unique_lock<std::mutex> lock{drain_mutex_};
+    if (--in_flight_ == 0) {
+      drain_cv_.notify_all();
+    }
+  }
+
+  // zero the tail of a short read, return false on error
+  static bool complete_read(IoRequest &req, ssize_t n) {
+    if (n < 0) {
+      return false;
+    }
+    if (static_cast<size_t>(n) < req.len) {
+      std::memset(req.buf + n, 0, req.len - n);
+    }
+    return true;
+  }
+
+private:
+  std::atomic<size_t> in_flight_{0};
+  std::mutex drain_mutex_;
+  std::condition_variable drain_cv_;
+};
+
+// pread/pwrite on a pool of worker threads, for kernels without io_uring
+class ThreadPoolIoBackend : public IoBackend {
+public:
+  ThreadPoolIoBackend(int fd, size_t threads) : fd_(fd) {
+    if (threads == 0) {
+      threads = 1;
+    }
+    for (size_t i = 0; i < threads; ++i) {
+      workers_.emplace_back([this] { work(); });
+    }
+  }
+
+  ~ThreadPoolIoBackend() override {
+    drain();
+    {
+      std::unique_lock<std::mutex> lock{mutex_};
+      stop_ = true;
+    }
+    cv_.notify_all();
+    for (auto &w : workers_) {
+      w.join();
+    }
+  }
+
+  void submit(std::vector<IoRequest> reqs) override {
+    started(reqs.size());
+    {
+      std::unique_lock<std::mutex> lock{mutex_};
+      for (auto &req : reqs) {
+        queue_.push_back(std::move(req));
+      }
+    }
+    cv_.notify_all();
+  }
+
+  const char *name() const override { return "thread pool"; }
+
+private:
+  void work() {
+    while (true) {
+      IoRequest req;
+      {
+        std::unique_lock<std::mutex> lock{mutex_};
+        cv_.wait(lock, [&] { return stop_ || !queue_.empty(); });
+        if (queue_.empty()) {
+          return;
+        }
+        req = std::move(queue_.front());
+        queue_.pop_front();
+      }
+
+      bool ok;
+      if (req.op == IoRequest::Op::kRead) {
+        ok = complete_read(req, ::pread(fd_, req.buf, req.len, req.offset));
+      } else {
+        ok = ::pwrite(fd_, req.buf, req.len, req.offset) ==
+             static_cast<ssize_t>(req.len);
+      }
+      finished(req, ok);
+    }
+  }
+
+  int fd_;
+  std::vector<std::thread> workers_;
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  std::deque<IoRequest> queue_;
+  bool stop_ = false;
+};
+
+// io_uring through the raw system calls. A batch is placed in the submission
+// queue and submitted with one io_uring_enter, a reaper thread waits for the
+// completions. Requests on registered buffers use the fixed buffer opcodes,
+// and aligned requests go to the O_DIRECT fd.
+class UringIoBackend : public IoBackend {
+public:
+  // @brief return nullptr if io_uring is not available
+  static std::unique_ptr<UringIoBackend> create(int fd, int direct_fd,
+                                                unsigned depth) {
+    auto backend =
+        std::unique_ptr<UringIoBackend>(new UringIoBackend(fd, direct_fd));
+    if (!backend->setup(depth)) {
+      return nullptr;
+    }
+    return backend;
+  }
+
+  ~UringIoBackend() override {
+    if (ring_fd_ < 0) {
+      return;
+    }
+    if (reaper_.joinable()) {
+      drain();
+      // wake up the reaper by a nop
+      std::vector<IoRequest> stop(1);
+      stop_ = true;
+      // the ring is idle, a nop the kernel didn't take goes again
+      while (!push(stop, true)) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+      }
+      reaper_.join();
+    }
+    if (sqes_ != MAP_FAILED) {
+      ::munmap(sqes_, sqes_size_);
+    }
+    if (cq_ring_ != MAP_FAILED && cq_ring_ != sq_ring_) {
+      ::munmap(cq_ring_, cq_ring_size_);
+    }
+    if (sq_ring_ != MAP_FAILED) {
+      ::munmap(sq_ring_, sq_ring_size_);
+    }
+    ::close(ring_fd_);
+  }
+
+  void submit(std::vector<IoRequest> reqs) override {
+    started(reqs.size());
+    push(reqs, false);
+  }
+
+  bool register_buffers(const std::vector<iovec> &buffers) override {
+    std::unique_lock<std::mutex> lock{sq_mutex_};
+    if (!buffers_.empty()) {
+      syscall(__NR_io_uring_register, ring_fd_, IORING_UNREGISTER_BUFFERS,
+              nullptr, 0);
+      buffers_.clear();
+      regions_.clear();
+    }
+    if (syscall(__NR_io_uring_register, ring_fd_, IORING_REGISTER_BUFFERS,
+                buffers.data(), buffers.size()) < 0) {
+      LOG_DEBUG << "io_uring register buffers failed " << errno;
+      return false;
+    }
+    buffers_ = buffers;
+    regions_.clear();
+    for (size_t i = 0; i < buffers.size(); ++i) {
+      regions_.push_back({static_cast<const char *>(buffers[i].iov_base),
+                          buffers[i].iov_len, static_cast<int>(i)});
+    }
+    std::sort(regions_.begin(), regions_.end(),
+              [](const Region &l, const Region &r) { return l.base < r.base; });
+    return true;
+  }
+
+  const char *name() const override { return "io_uring"; }
+
+private:
+  UringIoBackend(int fd, int direct_fd) : fd_(fd), direct_fd_(direct_fd) {}
+
+  bool setup(unsigned depth) {
+    io_uring_params p;
+    std::memset(&p, 0, sizeof p);
+    ring_fd_ = syscall(__NR_io_uring_setup, depth, &p);
+    if (ring_fd_ < 0) {
+      LOG_DEBUG << "io_uring setup failed " << errno;
+      return false;
+    }
+
+    sq_ring_size_ = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    cq_ring_size_ = p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe);
+    bool single_mmap = p.features & IORING_FEAT_SINGLE_MMAP;
+    if (single_mmap) {
+      sq_ring_size_ = cq_ring_size_ = std::max(sq_ring_size_, cq_ring_size_);
+    }
+
+    sq_ring_ = ::mmap(nullptr, sq_ring_size_, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_SQ_RING);
+    if (sq_ring_ == MAP_FAILED) {
+      return false;
+    }
+    cq_ring_ = single_mmap
+                   ? sq_ring_
+                   : ::mmap(nullptr, cq_ring_size_, PROT_READ | PROT_WRITE,
+                            MAP_SHARED | MAP_POPULATE, ring_fd_,
+                            IORING_OFF_CQ_RING);
+    if (cq_ring_ == MAP_FAILED) {
+      return false;
+    }
+    sqes_size_ = p.sq_entries * sizeof(io_uring_sqe);
+    sqes_ = ::mmap(nullptr, sqes_size_, PROT_READ | PROT_WRITE,
+                   MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_SQES);
+    if (sqes_ == MAP_FAILED) {
+      return false;
+    }
+
+    auto sq = static_cast<char *>(sq_ring_);
+    sq_head_ = reinterpret_cast<unsigned *>(sq + p.sq_off.head);
+    sq_tail_ = reinterpret_cast<unsigned *>(sq + p.sq_off.tail);
+    sq_mask_ = *reinterpret_cast<unsigned *>(sq + p.sq_off.ring_mask);
+    sq_array_ = reinterpret_cast<unsigned *>(sq + p.sq_off.array);
+    sq_entries_ = p.sq_entries;
+
+    auto cq = static_cast<char *>(cq_ring_);
+    cq_head_ = reinterpret_cast<unsigned *>(cq + p.cq_off.head);
+    cq_tail_ = reinterpret_cast<unsigned *>(cq + p.cq_off.tail);
+    cq_mask_ = *reinterpret_cast<unsigned *>(cq + p.cq_off.ring_mask);
+    cqes_ = reinterpret_cast<io_uring_cqe *>(cq + p.cq_off.cqes);
+    cq_entries_ = p.cq_entries;
+
+    reaper_ = std::thread([this] { reap(); });
+    return true;
+  }
+
+  int buffer_index(const char *buf, size_t len) const {
+    // the regions are sorted by their base address
+    auto it = std::upper_bound(
+        regions_.begin(), regions_.end(), buf,
+        [](const char *b, const Region &r) { return b < r.base; });
+    if (it == regions_.begin()) {
+      return -1;
+    }
+    --it;
+    return buf + len <= it->base + it->len ? it->index : -1;
+  }
+
+  bool aligned(const IoRequest &req) const {
+    constexpr uintptr_t kAlign = 512;
+    return direct_fd_ >= 0 && reinterpret_cast<uintptr_t>(req.buf) % kAlign == 0 &&
+           req.len % kAlign == 0 && req.offset % kAlign == 0;
+  }
+
+  // place the requests in the submission queue, and submit them together.
+  // return false if the kernel didn't take some, they are failed
+  bool push(std::vector<IoRequest> &reqs, bool nop) {
+    std::unique_lock<std::mutex> lock{sq_mutex_};
+    unsigned queued = 0;
+    std::vector<IoRequest *> failed;
+    for (auto &r : reqs) {
+      unsigned tail = *sq_tail_;
+      bool sq_full =
+          tail - __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE) == sq_entries_;
+      // the completion queue must not overflow
+      bool cq_full = queued_ + queued >= cq_entries_;
+      if (sq_full || cq_full) {
+        flush(queued, failed);
+        cq_space_.wait(lock, [&] { return queued_ < cq_entries_; });
+        tail = *sq_tail_;
+      }
+
+      auto req = new IoRequest(std::move(r));
+      unsigned idx = tail & sq_mask_;
+      io_uring_sqe *sqe = static_cast<io_uring_sqe *>(sqes_) + idx;
+      std::memset(sqe, 0, sizeof *sqe);
+      sqe->user_data = reinterpret_cast<uint64_t>(req);
+      if (nop) {
+        sqe->opcode = IORING_OP_NOP;
+      } else {
+        bool read = req->op == IoRequest::Op::kRead;
+        int buf_idx = buffer_index(req->buf, req->len);
+        if (buf_idx >= 0) {
+          sqe->opcode = read ? IORING_OP_READ_FIXED : IORING_OP_WRITE_FIXED;
+          sqe->buf_index = buf_idx;
+        } else {
+          sqe->opcode = read ? IORING_OP_READ : IORING_OP_WRITE;
+        }
+        sqe->fd = aligned(*req) ? direct_fd_ : fd_;
+        sqe->off = req->offset;
+        sqe->addr = reinterpret_cast<uint64_t>(req->buf);
+        sqe->len = req->len;
+      }
+      sq_array_[idx] = idx;
+      __atomic_store_n(sq_tail_, tail + 1, __ATOMIC_RELEASE);
+      ++queued;
+    }
+    flush(queued, failed);
+    lock.unlock();
+
+    // the callbacks may submit again
+    for (auto req : failed) {
+      if (!nop) {
+        finished(*req, false);
+      }
+      delete req;
+    }
+    return failed.empty();
+  }
+
+  // submit the queued entries to the kernel. It may take fewer than asked,
+  // or none while it is short of memory or its completion queue is
+  // overflowing. The rest is submitted again, and the entries it still
+  // hasn't taken are removed from the queue and added to failed.
+  void flush(unsigned &queued, std::vector<IoRequest *> &failed) {
+    if (queued == 0) {
+      return;
+    }
+    queued_ += queued;
+    unsigned left = queued;
+    queued = 0;
+    for (int tries = 0; left > 0 && tries < kEnterTries;) {
+      int ret = enter(left, 0, 0);
+      if (ret > 0) {
+        left -= std::min<unsigned>(ret, left);
+        tries = 0;
+        continue;
+      }
+      if (ret < 0 && errno != EAGAIN && errno != EBUSY && errno != ENOMEM) {
+        LOG_DEBUG << "io_uring enter failed " << errno;
+        break;
+      }
+      ++tries;
+      std::this_thread::yield();
+    }
+    if (left == 0) {
+      return;
+    }
+
+    // the kernel reads the queue only in io_uring_enter, the entries past
+    // its head are still ours
+    unsigned head = __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE);
+    unsigned tail = *sq_tail_;
+    for (unsigned i = head; i != tail; ++i) {
+      io_uring_sqe *sqe =
+          static_cast<io_uring_sqe *>(sqes_) + sq_array_[i & sq_mask_];
+      failed.push_back(reinterpret_cast<IoRequest *>(sqe->user_data));
+    }
+    __atomic_store_n(sq_tail_, head, __ATOMIC_RELEASE);
+    queued_ -= tail - head;
+    cq_space_.notify_all();
+  }
+
+  int enter(unsigned to_submit, unsigned min_complete, unsigned flags) {
+    int ret;
+    do {
+      ret = syscall(__NR_io_uring_enter, ring_fd_, to_submit, min_complete,
+                    flags, nullptr, 0);
+    } while (ret < 0 && errno == EINTR);
+    return ret;
+  }
+
+  void reap() {
+    while (true) {
+      unsigned head = *cq_head_;
+      if (head == __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE)) {
+        if (enter(0, 1, IORING_ENTER_GETEVENTS) < 0) {
+          // the kernel still posts completions, poll for them
+          LOG_DEBUG << "io_uring wait failed " << errno;
+          std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        continue;
+      }
+
+      io_uring_cqe *cqe = &cqes_[head & cq_mask_];
+      auto req = reinterpret_cast<IoRequest *>(cqe->user_data);
+      int res = cqe->res;
+      __atomic_store_n(cq_head_, head + 1, __ATOMIC_RELEASE);
+      {
+        std::unique_lock<std::mutex> lock{sq_mutex_};
+        --queued_;
+      }
+      cq_space_.notify_all();
+
+      if (stop_ && req->buf == nullptr) {
+        delete req;
+        return;
+      }
+      bool ok = req->op == IoRequest::Op::kRead
+                    ? complete_read(*req, res)
+                    : res == static_cast<int>(req->len);
+      finished(*req, ok);
+      delete req;
+    }
+  }
+
+  int fd_;
+  int direct_fd_;
+  int ring_fd_ = -1;
+
+  void *sq_ring_ = MAP_FAILED;
+  void *cq_ring_ = MAP_FAILED;
+  void *sqes_ = MAP_FAILED;
+  size_t sq_ring_size_ = 0, cq_ring_size_ = 0, sqes_size_ = 0;
+
+  unsigned *sq_head_, *sq_tail_, *sq_array_;
+  unsigned sq_mask_, sq_entries_;
+  unsigned *cq_head_, *cq_tail_;
+  unsigned cq_mask_, cq_entries_;
+  io_uring_cqe *cqes_;
+
+  // io_uring_enter calls in a row which submit nothing before the queued
+  // entries are failed
+  static constexpr int kEnterTries = 64;
+
+  std::mutex sq_mutex_;
+  std::condition_variable cq_space_;
+  unsigned queued_ = 0; // submitted but not reaped
+  struct Region {
+    const char *base;
+    size_t len;
+    int index;
+  };
+  std::vector<iovec> buffers_;
+  std::vector<Region> regions_;
+
+  std::thread reaper_;
+  std::atomic<bool> stop_{false};
+};
+
+// @brief io_uring if it is enabled and available, else the thread pool
+inline std::unique_ptr<IoBackend> make_io_backend(int fd, int direct_fd,
+                                                  const IoOptions &options) {
+  if (options.use_io_uring) {
+    auto uring = UringIoBackend::create(fd, direct_fd, options.queue_depth);
+    if (uring) {
+      return uring;
+    }
+    LOG_DEBUG << "io_uring is not available, use the thread pool";
+  }
+  return std::make_unique<ThreadPoolIoBackend>(fd, options.io_threads);
+}
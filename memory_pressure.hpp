@@ -0,0 +1,164 @@
+#pragma once
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <fstream>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+enum class PressureLevel { kNone, kModerate, kCritical };
+
+struct PressureWatchOptions {
+  std::string path = "/proc/pressure/memory";
+  std::chrono::milliseconds interval{1000};
+  // percent of the last 10 seconds in which some task stalled on memory
+  double moderate_avg10 = 10;
+  double critical_avg10 = 40;
+};
+
+// Tells the subscribers when memory gets short. The process calls notify()
+// when its own accounting says so, or watch() polls the kernel's pressure
+// stall information (/proc/pressure/memory) on a thread:
+//
+//   MemoryPressure pressure;
+//   pool.subscribe(pressure);
+//   pressure.watch();
+class MemoryPressure {
+public:
+  using Callback = std::function<void(PressureLevel)>;
+
+  MemoryPressure() = default;
+  ~MemoryPressure() { stop(); }
+
+  MemoryPressure(const MemoryPressure &) = delete;
+  MemoryPressure &operator=(const MemoryPressure &) = delete;
+
+  // @brief the returned id unsubscribes the callback
+  size_t subscribe(Callback callback) {
+    std::unique_lock<std::mutex> lock{mutex_};
+    callbacks_.emplace(++next_id_, std::move(callback));
+    return next_id_;
+  }
+
+  // @brief the callback isn't called after this returns. a call running on
+  // another thread is waited for, a callback may unsubscribe itself
+  void unsubscribe(size_t id) {
+    std::unique_lock<std::mutex> lock{mutex_};
+    callbacks_.erase(id);
+    auto self = std::this_thread::get_id();
+    calls_cv_.wait(lock, [&] {
+      for (auto &[call, thread] : calls_) {
+        if (call == id && thread != self) {
+          return false;
+        }
+      }
+      return true;
+    });
+  }
+
+  // @brief call every subscriber, a level which is not kNone is delivered
+  // each time, kNone only when the pressure went away. the callbacks run
+  // without the lock, they may take long and subscribe or unsubscribe
+  void notify(PressureLevel level) {
+    std::vector<size_t> ids;
+    {
+      std::unique_lock<std::mutex> lock{mutex_};
+      if (level == PressureLevel::kNone && level_ == PressureLevel::kNone) {
+        return;
+      }
+      level_ = level;
+      for (auto &[id, callback] : callbacks_) {
+        ids.push_back(id);
+      }
+    }
+    auto self = std::this_thread::get_id();
+    for (auto id : ids) {
+      Callback callback;
+      {
+        std::unique_lock<std::mutex> lock{mutex_};
+        auto it = callbacks_.find(id);
+        if (it == callbacks_.end()) {
+          continue;
+        }
+        callback = it->second;
+        calls_.emplace_back(id, self);
+      }
+      callback(level);
+      {
+        std::unique_lock<std::mutex> lock{mutex_};
+        calls_.erase(std::find(calls_.begin(), calls_.end(),
+                               std::make_pair(id, self)));
+      }
+      calls_cv_.notify_all();
+    }
+  }
+
+  // @brief start polling the pressure file, return false if it can't be read
+  bool watch(PressureWatchOptions options = {}) {
+    if (watcher_.joinable() || read_avg10(options.path) < 0) {
+      return false;
+    }
+    stop_ = false;
+    watcher_ = std::thread([this, options] {
+      std::unique_lock<std::mutex> lock{watch_mutex_};
+      while (!stop_) {
+        double avg10 = read_avg10(options.path);
+        lock.unlock();
+        if (avg10 >= options.critical_avg10) {
+          notify(PressureLevel::kCritical);
+        } else if (avg10 >= options.moderate_avg10) {
+          notify(PressureLevel::kModerate);
+        } else {
+          notify(PressureLevel::kNone);
+        }
+        lock.lock();
+        watch_cv_.wait_for(lock, options.interval, [&] { return stop_; });
+      }
+    });
+    return true;
+  }
+
+  void stop() {
+    if (!watcher_.joinable()) {
+      return;
+    }
+    {
+      std::unique_lock<std::mutex> lock{watch_mutex_};
+      stop_ = true;
+    }
+    watch_cv_.notify_one();
+    watcher_.join();
+  }
+
+  // @brief avg10 of the "some" line, or -1
+  static double read_avg10(const std::string &path) {
+    std::ifstream in(path);
+    std::string word;
+    while (in >> word) {
+      if (word.rfind("avg10=", 0) == 0) {
+        return std::stod(word.substr(6));
+      }
+    }
+    return -1;
+  }
+
+private:
+  std::mutex mutex_;
+  std::map<size_t, Callback> callbacks_;
+  size_t next_id_ = 0;
+  // the callbacks running and the threads running them
+  std::vector<std::pair<size_t, std::thread::id>> calls_;
+  std::condition_variable calls_cv_;
+  PressureLevel level_ = PressureLevel::kNone;
+
+  std::thread watcher_;
+  std::mutex watch_mutex_;
+  std::condition_variable watch_cv_;
+  bool stop_ = false;
+};
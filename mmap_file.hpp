@@ -0,0 +1,112 @@
+#pragma once
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+struct MmapOptions {
+  // MADV_RANDOM on the whole file, a fault doesn't read the pages around it.
+  // point lookups never use them
+  bool random = true;
+  // MADV_WILLNEED on the nodes of the top levels when the tree is opened, the
+  // levels above the last one are read to find them. 0 turns it off
+  size_t will_need_levels = 2;
+};
+
+// A read-only shared mapping of a file of fixed size pages. The pages live in
+// the page cache of the OS, so every process which maps the same file shares
+// them, and a page is only read when it is first touched.
+class MmapFile {
+public:
+  MmapFile() = default;
+
+  MmapFile(const std::string &path, size_t page_size)
+      : page_size_(page_size) {
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+      throw std::runtime_error("open file failed");
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+      ::close(fd);
+      throw std::runtime_error("stat file failed");
+    }
+    bytes_ = st.st_size;
+    pages_ = bytes_ / page_size;
+    if (bytes_ > 0) {
+      void *p = mmap(nullptr, bytes_, PROT_READ, MAP_SHARED, fd, 0);
+      if (p == MAP_FAILED) {
+        ::close(fd);
+        throw std::runtime_error("mmap file failed");
+      }
+      base_ = static_cast<char *>(p);
+    }
+    // the mapping keeps the file open
+    ::close(fd);
+  }
+
+  MmapFile(MmapFile &&other) noexcept { swap(other); }
+  MmapFile &operator=(MmapFile &&other) noexcept {
+    MmapFile tmp{std::move(other)};
+    swap(tmp);
+    return *this;
+  }
+  MmapFile(const MmapFile &) = delete;
+  MmapFile &operator=(const MmapFile &) = delete;
+
+  ~MmapFile() {
+    if (base_) {
+      munmap(base_, bytes_);
+    }
+  }
+
+  // @brief the page in the mapping, nullptr if it is past the end of the file
+  const char *page(size_t idx) const {
+    if (idx >= pages_) {
+      return nullptr;
+    }
+    return base_ + idx * page_size_;
+  }
+
+  // @brief hint the kernel that pages [first, first + count) are read soon
+  void will_need(size_t first, size_t count) {
+    advise(first, count, MADV_WILLNEED);
+  }
+  // @brief hint the kernel that the pages are read in no order
+  void random() { advise(0, pages_, MADV_RANDOM); }
+
+  bool mapped() const { return base_ != nullptr; }
+  size_t page_count() const { return pages_; }
+
+private:
+  void advise(size_t first, size_t count, int advice) {
+    if (first >= pages_) {
+      return;
+    }
+    count = std::min(count, pages_ - first);
+    // madvise wants the start aligned to a page of the system
+    size_t align = sysconf(_SC_PAGESIZE);
+    size_t begin = first * page_size_ / align * align;
+    size_t end = (first + count) * page_size_;
+    madvise(base_ + begin, end - begin, advice);
+  }
+
+  void swap(MmapFile &other) noexcept {
+    std::swap(base_, other.base_);
+    std::swap(bytes_, other.bytes_);
+    std::swap(pages_, other.pages_);
+    std::swap(page_size_, other.page_size_);
+  }
+
+  char *base_ = nullptr;
+  size_t bytes_ = 0;
+  size_t pages_ = 0;
+  size_t page_size_ = 0;
+};
@@ -0,0 +1,102 @@
+#pragma once
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Maps page ids to frame indexes of the buffer pool. It is a flat open
+// addressing table with linear probing, sized when the pool is opened, so a
+// lookup touches one or two cache lines and nothing is allocated on the
+// fetch path. Erase shifts the following entries back instead of leaving
+// tombstones, the probe sequences stay short however many pages cycle through
+// the pool.
+class PageTable {
+public:
+  static constexpr size_t npos = static_cast<size_t>(-1);
+
+  PageTable() { reserve(0); }
+  explicit PageTable(size_t max_entries) { reserve(max_entries); }
+
+  // @brief size the table for max_entries, the load factor stays below 1/2.
+  // drops every entry
+  void reserve(size_t max_entries) {
+    size_t capacity = 16;
+    while (capacity < max_entries * 2) {
+      capacity <<= 1;
+    }
+    slots_.assign(capacity, Slot{});
+    mask_ = capacity - 1;
+    size_ = 0;
+  }
+
+  // @brief the frame of page_id, or npos
+  size_t find(int64_t page_id) const {
+    for (size_t i = home(page_id);; i = (i + 1) & mask_) {
+      const Slot &slot = slots_[i];
+      if (slot.frame == npos) {
+        return npos;
+      }
+      if (slot.page_id == page_id) {
+        return slot.frame;
+      }
+    }
+  }
+
+  // @brief map page_id to frame, page_id must not be in the table
+  void insert(int64_t page_id, size_t frame) {
+    assert(frame != npos);
+    assert(size_ < slots_.size() / 2);
+    size_t i = home(page_id);
+    while (slots_[i].frame != npos) {
+      assert(slots_[i].page_id != page_id);
+      i = (i + 1) & mask_;
+    }
+    slots_[i] = Slot{page_id, frame};
+    size_++;
+  }
+
+  // @brief return false if page_id is not in the table
+  bool erase(int64_t page_id) {
+    size_t i = home(page_id);
+    while (slots_[i].page_id != page_id) {
+      if (slots_[i].frame == npos) {
+        return false;
+      }
+      i = (i + 1) & mask_;
+    }
+
+    // move back the entries whose probe sequence passes the hole
+    size_t hole = i;
+    for (size_t j = (i + 1) & mask_; slots_[j].frame != npos;
+         j = (j + 1) & mask_) {
+      size_t h = home(slots_[j].page_id);
+      // j's home is cyclically outside (hole, j]
+      if (((j - h) & mask_) >= ((j - hole) & mask_)) {
+        slots_[hole] = slots_[j];
+        hole = j;
+      }
+    }
+    slots_[hole] = Slot{};
+    size_--;
+    return true;
+  }
+
+  size_t size() const { return size_; }
+  size_t capacity() const { return slots_.size(); }
+
+private:
+  struct Slot {
+    int64_t page_id = -1;
+    size_t frame = npos; // npos marks an empty slot
+  };
+
+  size_t home(int64_t page_id) const {
+    // fibonacci hashing, consecutive page ids spread over the table
+    return (static_cast<uint64_t>(page_id) * 0x9E3779B97F4A7C15ull >> 32) &
+           mask_;
+  }
+
+  std::vector<Slot> slots_;
+  size_t mask_ = 0;
+  size_t size_ = 0;
+};
@@ -1,7 +1,14 @@
 #pragma once
+#include <algorithm>
 #include <cstddef>
+#include <cstdint>
 #include <list>
 #include <map>
+#include <optional>
+#include <set>
+#include <tuple>
+#include <unordered_map>
+#include <vector>
 
 constexpr size_t DEFAULT_LRU_CAPACITY = 16;
 
@@ -110,4 +117,512 @@ private:
   std::list<T> fifo_list_;
 };
 
-// TODO lfu replacer
\ No newline at end of file
+// CLOCK keeps a reference bit per frame in flat arrays, the hand clears the
+// bits it passes and evicts the first unpinned frame whose bit is clear. T
+// is a frame index, the arrays are sized by the constructor so put, touch,
+// remove and victim don't allocate; a larger index grows them.
+template <typename T> class ClockReplacer {
+public:
+  ClockReplacer() : ClockReplacer(DEFAULT_LRU_CAPACITY) {}
+
+  explicit ClockReplacer(size_t cap) : frames_(cap) {}
+
+  void put(T t) {
+    size_t i = static_cast<size_t>(t);
+    if (i >= frames_.size()) {
+      frames_.resize(i + 1);
+    }
+    if (!frames_[i].evictable) {
+      frames_[i].evictable = 1;
+      size_++;
+    }
+    frames_[i].referenced = 1;
+  }
+
+  bool touch(const T &t) {
+    size_t i = static_cast<size_t>(t);
+    if (i >= frames_.size() || !frames_[i].evictable) {
+      return false;
+    }
+    frames_[i].referenced = 1;
+    return true;
+  }
+
+  void remove(const T &t) {
+    size_t i = static_cast<size_t>(t);
+    if (i < frames_.size() && frames_[i].evictable) {
+      frames_[i].evictable = 0;
+      size_--;
+    }
+  }
+
+  bool victim(T &t) {
+    if (size_ == 0) {
+      return false;
+    }
+    // the second pass finds a clear bit at the latest
+    while (true) {
+      auto &f = frames_[hand_];
+      size_t i = hand_;
+      hand_ = hand_ + 1 == frames_.size() ? 0 : hand_ + 1;
+      if (!f.evictable) {
+        continue;
+      }
+      if (f.referenced) {
+        f.referenced = 0;
+        continue;
+      }
+      f.evictable = 0;
+      size_--;
+      t = static_cast<T>(i);
+      return true;
+    }
+  }
+
+  size_t size() const { return size_; }
+
+private:
+  struct Frame {
+    std::uint8_t evictable = 0;
+    std::uint8_t referenced = 0;
+  };
+
+  std::vector<Frame> frames_;
+  size_t hand_ = 0;
+  size_t size_ = 0;
+};
+
+// The replacers below remember pages which were evicted, so a page which
+// comes back soon is told apart from one which is touched once by a scan.
+// They keep the history by key, the key of an entry is the entry itself
+// unless bind() says which page a frame holds:
+//
+//   replacer.bind(frame, page_id); // the frame now holds page_id
+//
+// DefaultBufferPool binds a frame whenever it is given to another page.
+
+namespace detail {
+
+// keys of evicted pages, the newest in front
+class GhostList {
+public:
+  explicit GhostList(size_t capacity) : capacity_(capacity) {}
+
+  // @brief return the key which was dropped to make room
+  std::optional<int64_t> push_front(int64_t key) {
+    erase(key);
+    keys_.push_front(key);
+    index_[key] = keys_.begin();
+    if (keys_.size() > capacity_) {
+      return pop_back();
+    }
+    return std::nullopt;
+  }
+
+  bool erase(int64_t key) {
+    auto it = index_.find(key);
+    if (it == index_.end()) {
+      return false;
+    }
+    keys_.erase(it->second);
+    index_.erase(it);
+    return true;
+  }
+
+  bool contains(int64_t key) const { return index_.count(key) > 0; }
+
+  // @brief drop the oldest key, return it
+  int64_t pop_back() {
+    int64_t key = keys_.back();
+    index_.erase(key);
+    keys_.pop_back();
+    return key;
+  }
+
+  size_t size() const { return keys_.size(); }
+  bool empty() const { return keys_.empty(); }
+
+private:
+  size_t capacity_;
+  std::list<int64_t> keys_;
+  std::map<int64_t, std::list<int64_t>::iterator> index_;
+};
+
+} // namespace detail
+
+// LRU-K evicts the entry whose K-th most recent reference is the oldest.
+// Entries with less than K references go first, by their oldest reference,
+// so pages read once by a scan don't push out pages which are used again.
+template <typename T> class LruKReplacer {
+public:
+  LruKReplacer() : LruKReplacer(DEFAULT_LRU_CAPACITY) {}
+
+  explicit LruKReplacer(size_t cap, size_t k = 2)
+      : k_(std::max<size_t>(k, 1)), ghosts_(cap) {}
+
+  void put(T t) {
+    auto &f = frames_[t];
+    if (f.evictable) {
+      evictable_.erase(rank(t, f));
+    }
+    reference(t, f);
+    f.evictable = true;
+    evictable_.insert(rank(t, f));
+  }
+
+  bool touch(const T &t) {
+    auto it = frames_.find(t);
+    if (it == frames_.end() || !it->second.evictable) {
+      return false;
+    }
+    put(t);
+    return true;
+  }
+
+  void remove(const T &t) {
+    auto it = frames_.find(t);
+    if (it != frames_.end() && it->second.evictable) {
+      evictable_.erase(rank(t, it->second));
+      it->second.evictable = false;
+    }
+  }
+
+  bool victim(T &t) {
+    if (evictable_.empty()) {
+      return false;
+    }
+    t = std::get<2>(*evictable_.begin());
+    evictable_.erase(evictable_.begin());
+
+    auto it = frames_.find(t);
+    forget(key_of(t, it->second));
+    if (it->second.bound) {
+      it->second.evictable = false;
+    } else {
+      frames_.erase(it);
+    }
+    return true;
+  }
+
+  void bind(const T &t, int64_t key) {
+    remove(t);
+    auto &f = frames_[t];
+    f.key = key;
+    f.bound = true;
+  }
+
+private:
+  struct Frame {
+    int64_t key = 0;
+    bool bound = false;
+    bool evictable = false;
+  };
+  // less than K references first, then by the oldest kept reference
+  using Rank = std::tuple<bool, uint64_t, T>;
+
+  static int64_t key_of(const T &t, const Frame &f) {
+    return f.bound ? f.key : static_cast<int64_t>(t);
+  }
+
+  Rank rank(const T &t, const Frame &f) const {
+    auto &refs = history_.at(key_of(t, f));
+    return {refs.size() >= k_, refs.front(), t};
+  }
+
+  void reference(const T &t, const Frame &f) {
+    int64_t key = key_of(t, f);
+    ghosts_.erase(key);
+    auto &refs = history_[key];
+    refs.push_back(++clock_);
+    if (refs.size() > k_) {
+      refs.erase(refs.begin());
+    }
+  }
+
+  // the page left the pool, its history is kept while it is a ghost
+  void forget(int64_t key) {
+    if (auto dropped = ghosts_.push_front(key)) {
+      history_.erase(*dropped);
+    }
+  }
+
+  size_t k_;
+  uint64_t clock_ = 0;
+  std::map<T, Frame> frames_;
+  std::set<Rank> evictable_;
+  std::unordered_map<int64_t, std::vector<uint64_t>> history_;
+  detail::GhostList ghosts_;
+};
+
+// 2Q: a page enters a small FIFO queue (A1in) and is evicted from it unless
+// it is referenced again after it left, which the ghost queue A1out
+// remembers. Only those pages reach the LRU queue Am, so a scan cycles
+// through A1in and leaves Am alone.
+template <typename T> class TwoQueueReplacer {
+public:
+  TwoQueueReplacer() : TwoQueueReplacer(DEFAULT_LRU_CAPACITY) {}
+
+  explicit TwoQueueReplacer(size_t cap)
+      : kin_(std::max<size_t>(cap / 4, 1)), a1out_(std::max<size_t>(cap / 2, 1)) {}
+
+  void put(T t) {
+    auto &f = frames_[t];
+    reference(t, f);
+    f.evictable = true;
+  }
+
+  bool touch(const T &t) {
+    auto it = frames_.find(t);
+    if (it == frames_.end() || !it->second.evictable) {
+      return false;
+    }
+    reference(t, it->second);
+    return true;
+  }
+
+  void remove(const T &t) {
+    auto it = frames_.find(t);
+    if (it != frames_.end()) {
+      it->second.evictable = false;
+    }
+  }
+
+  bool victim(T &t) {
+    if (a1in_.size() > kin_ && evict(a1in_, t)) {
+      return true;
+    }
+    return evict(am_, t) || evict(a1in_, t);
+  }
+
+  void bind(const T &t, int64_t key) {
+    auto &f = frames_[t];
+    drop(f);
+    f.evictable = false;
+    f.key = key;
+    f.bound = true;
+  }
+
+private:
+  enum class Queue { kNone, kA1in, kAm };
+
+  struct Frame {
+    int64_t key = 0;
+    bool bound = false;
+    bool evictable = false;
+    Queue queue = Queue::kNone;
+    typename std::list<T>::iterator pos;
+  };
+
+  static int64_t key_of(const T &t, const Frame &f) {
+    return f.bound ? f.key : static_cast<int64_t>(t);
+  }
+
+  void reference(const T &t, Frame &f) {
+    switch (f.queue) {
+    case Queue::kAm:
+      am_.splice(am_.begin(), am_, f.pos);
+      break;
+    case Queue::kA1in:
+      // correlated references don't promote the page
+      break;
+    case Queue::kNone:
+      if (a1out_.erase(key_of(t, f))) {
+        am_.push_front(t);
+        f.pos = am_.begin();
+        f.queue = Queue::kAm;
+      } else {
+        a1in_.push_front(t);
+        f.pos = a1in_.begin();
+        f.queue = Queue::kA1in;
+      }
+      break;
+    }
+  }
+
+  void drop(Frame &f) {
+    if (f.queue == Queue::kA1in) {
+      a1in_.erase(f.pos);
+    } else if (f.queue == Queue::kAm) {
+      am_.erase(f.pos);
+    }
+    f.queue = Queue::kNone;
+  }
+
+  // evict the oldest unpinned entry of the queue
+  bool evict(std::list<T> &queue, T &t) {
+    for (auto it = queue.rbegin(); it != queue.rend(); ++it) {
+      auto fit = frames_.find(*it);
+      if (!fit->second.evictable) {
+        continue;
+      }
+      t = *it;
+      Frame &f = fit->second;
+      if (&queue == &a1in_) {
+        a1out_.push_front(key_of(t, f));
+      }
+      drop(f);
+      f.evictable = false;
+      if (!f.bound) {
+        frames_.erase(fit);
+      }
+      return true;
+    }
+    return false;
+  }
+
+  size_t kin_;
+  std::map<T, Frame> frames_;
+  std::list<T> a1in_;
+  std::list<T> am_;
+  detail::GhostList a1out_;
+};
+
+// ARC keeps pages seen once (T1) apart from pages seen at least twice (T2),
+// and remembers as many evicted pages of each (B1, B2). A hit in a ghost list
+// moves the target size p of T1 towards the list which would have kept the
+// page, so the split adapts to the workload.
+template <typename T> class ArcReplacer {
+public:
+  ArcReplacer() : ArcReplacer(DEFAULT_LRU_CAPACITY) {}
+
+  explicit ArcReplacer(size_t cap)
+      : c_(std::max<size_t>(cap, 1)), b1_(c_), b2_(c_) {}
+
+  void put(T t) {
+    auto &f = frames_[t];
+    reference(t, f);
+    f.evictable = true;
+  }
+
+  bool touch(const T &t) {
+    auto it = frames_.find(t);
+    if (it == frames_.end() || !it->second.evictable) {
+      return false;
+    }
+    reference(t, it->second);
+    return true;
+  }
+
+  void remove(const T &t) {
+    auto it = frames_.find(t);
+    if (it != frames_.end()) {
+      it->second.evictable = false;
+    }
+  }
+
+  bool victim(T &t) {
+    // the incoming page is not known here, so the B2 tie rule of REPLACE is
+    // left out
+    if (!t1_.empty() && (t1_.size() > p_ || t2_.empty())) {
+      return evict(t1_, t) || evict(t2_, t);
+    }
+    return evict(t2_, t) || evict(t1_, t);
+  }
+
+  void bind(const T &t, int64_t key) {
+    auto &f = frames_[t];
+    drop(f);
+    f.evictable = false;
+    f.key = key;
+    f.bound = true;
+  }
+
+  // @brief the target size of T1
+  size_t target() const { return p_; }
+
+private:
+  enum class List { kNone, kT1, kT2 };
+
+  struct Frame {
+    int64_t key = 0;
+    bool bound = false;
+    bool evictable = false;
+    List list = List::kNone;
+    typename std::list<T>::iterator pos;
+  };
+
+  static int64_t key_of(const T &t, const Frame &f) {
+    return f.bound ? f.key : static_cast<int64_t>(t);
+  }
+
+  void reference(const T &t, Frame &f) {
+    if (f.list == List::kT1) {
+      t1_.erase(f.pos);
+      push_t2(t, f);
+      return;
+    }
+    if (f.list == List::kT2) {
+      t2_.splice(t2_.begin(), t2_, f.pos);
+      return;
+    }
+
+    int64_t key = key_of(t, f);
+    if (b1_.contains(key)) {
+      size_t delta = std::max<size_t>(b2_.size() / b1_.size(), 1);
+      p_ = std::min(c_, p_ + delta);
+      b1_.erase(key);
+      push_t2(t, f);
+    } else if (b2_.contains(key)) {
+      size_t delta = std::max<size_t>(b1_.size() / b2_.size(), 1);
+      p_ -= std::min(p_, delta);
+      b2_.erase(key);
+      push_t2(t, f);
+    } else {
+      if (t1_.size() + b1_.size() >= c_) {
+        if (!b1_.empty()) {
+          b1_.pop_back();
+        }
+      } else if (t1_.size() + t2_.size() + b1_.size() + b2_.size() >=
+                     2 * c_ &&
+                 !b2_.empty()) {
+        b2_.pop_back();
+      }
+      t1_.push_front(t);
+      f.pos = t1_.begin();
+      f.list = List::kT1;
+    }
+  }
+
+  void push_t2(const T &t, Frame &f) {
+    t2_.push_front(t);
+    f.pos = t2_.begin();
+    f.list = List::kT2;
+  }
+
+  void drop(Frame &f) {
+    if (f.list == List::kT1) {
+      t1_.erase(f.pos);
+    } else if (f.list == List::kT2) {
+      t2_.erase(f.pos);
+    }
+    f.list = List::kNone;
+  }
+
+  // evict the least recent unpinned entry of the list to its ghost list
+  bool evict(std::list<T> &list, T &t) {
+    for (auto it = list.rbegin(); it != list.rend(); ++it) {
+      auto fit = frames_.find(*it);
+      if (!fit->second.evictable) {
+        continue;
+      }
+      t = *it;
+      Frame &f = fit->second;
+      (&list == &t1_ ? b1_ : b2_).push_front(key_of(t, f));
+      drop(f);
+      f.evictable = false;
+      if (!f.bound) {
+        frames_.erase(fit);
+      }
+      return true;
+    }
+    return false;
+  }
+
+  size_t c_;
+  size_t p_ = 0;
+  std::map<T, Frame> frames_;
+  std::list<T> t1_;
+  std::list<T> t2_;
+  detail::GhostList b1_;
+  detail::GhostList b2_;
+};
\ No newline at end of file
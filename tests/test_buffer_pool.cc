@@ -1,6 +1,8 @@
 #include "../buffer_pool.hpp"
 #include "pure_test.hpp"
+#include <algorithm>
 #include <cstring>
+#include <random>
 
 PURE_TEST_INIT();
 
@@ -47,7 +49,7 @@ public:
     }
 
     for (auto& page : p.pages_) {
-      pure_assert(page->pin_count == 0) << page->pin_count;
+      pure_assert(page.pin_count == 0) << page.pin_count;
     }
 
     p.flush_all();
@@ -78,6 +80,438 @@ public:
 
     remove("hello");
   }
+
+  void arena_test() {
+    BufferPoolOptions options;
+    // both fall back when the system can't provide them
+    options.arena.huge_pages = true;
+    options.io.direct_io = true;
+
+    std::vector<PageId> pids;
+    {
+      BufferPool p{"arena.db", 64, options};
+      p.open();
+      // the frames are contiguous and aligned for O_DIRECT
+      for (size_t i = 0; i < p.pages_.size(); ++i) {
+        auto addr = reinterpret_cast<uintptr_t>(p.pages_[i].data);
+        PURE_TEST_EQ(addr % 512, 0);
+        PURE_TEST_EQ(p.pages_[i].data, p.pages_[0].data + i * PAGE_SIZE);
+      }
+      for (auto i = 0; i < 300; ++i) {
+        auto page = p.new_page();
+        pure_assert(page != nullptr);
+        std::string s = "arena" + std::to_string(i);
+        memcpy(page->get_data(), s.data(), s.size());
+        pids.push_back(page->id);
+        p.unpin(page->id, true);
+      }
+      p.close();
+    }
+
+    BufferPool p{"arena.db", 64, options};
+    p.open();
+    for (auto i = 0; i < 300; ++i) {
+      auto page = p.fetch(pids[i]);
+      pure_assert(page != nullptr);
+      std::string s = "arena" + std::to_string(i);
+      pure_assert(memcmp(page->get_data(), s.data(), s.size()) == 0) << s;
+      p.unpin(page->id, false);
+    }
+    p.close();
+    remove("arena.db");
+  }
+
+  void resize_test() {
+    BufferPoolOptions options;
+    options.max_frames = 64;
+    options.min_frames = 8;
+    BufferPool p{"resize.db", 16, options};
+    p.open();
+    PURE_TEST_FALSE(p.resize(0));
+    PURE_TEST_FALSE(p.resize(65));
+
+    std::vector<PageId> pids;
+    auto write = [&](int i) {
+      auto page = p.new_page();
+      pure_assert(page != nullptr);
+      std::string s = "resize" + std::to_string(i);
+      memcpy(page->get_data(), s.data(), s.size());
+      pids.push_back(page->id);
+      p.unpin(page->id, true);
+    };
+    auto check = [&](int i) {
+      auto page = p.fetch(pids[i]);
+      pure_assert(page != nullptr);
+      std::string s = "resize" + std::to_string(i);
+      pure_assert(memcmp(page->get_data(), s.data(), s.size()) == 0) << s;
+      p.unpin(page->id, false);
+    };
+
+    for (auto i = 0; i < 100; ++i) {
+      write(i);
+    }
+    PURE_TEST_TRUE(p.resize(64));
+    PURE_TEST_EQ(p.buffer_size(), 64);
+    for (auto i = 0; i < 100; ++i) {
+      check(i);
+    }
+    // the tail is dirty and one frame of it is pinned, the shrink waits
+    for (auto i = 100; i < 164; ++i) {
+      write(i);
+    }
+    Page *pinned = p.fetch(pids.back());
+    pure_assert(pinned->frame >= 16);
+    std::thread shrink([&] { PURE_TEST_TRUE(p.resize(16)); });
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    p.unpin(pinned->id, false);
+    shrink.join();
+    PURE_TEST_EQ(p.buffer_size(), 16);
+    for (auto i = 0; i < 164; ++i) {
+      check(i);
+    }
+
+    // critical pressure shrinks to min_frames
+    MemoryPressure pressure;
+    p.subscribe(pressure);
+    pressure.notify(PressureLevel::kModerate);
+    PURE_TEST_EQ(p.buffer_size(), 12);
+    pressure.notify(PressureLevel::kCritical);
+    PURE_TEST_EQ(p.buffer_size(), 8);
+    for (auto i = 0; i < 164; ++i) {
+      check(i);
+    }
+    p.close();
+    remove("resize.db");
+  }
+
+  // prefetch() and co_fetch() read into the registered frames with the fixed
+  // opcodes, a shrink must not drop their memory
+  void resize_fixed_buffers_test() {
+    std::vector<PageId> pids;
+    {
+      BufferPool p{"resize_fixed.db", 16};
+      p.open();
+      for (auto i = 0; i < 200; ++i) {
+        auto page = p.new_page();
+        std::string s = "fixed" + std::to_string(i);
+        memcpy(page->get_data(), s.data(), s.size() + 1);
+        pids.push_back(page->id);
+        p.unpin(page->id, true);
+      }
+      p.close();
+    }
+
+    BufferPoolOptions options;
+    options.max_frames = 64;
+    BufferPool p{"resize_fixed.db", 64, options};
+    p.open();
+    PURE_TEST_TRUE(p.resize(8));
+    PURE_TEST_TRUE(p.resize(64));
+    size_t wrong = 0;
+    for (auto i = 0; i < 200; ++i) {
+      p.prefetch(pids[i]);
+      auto page = p.fetch(pids[i]);
+      pure_assert(page != nullptr);
+      std::string s = "fixed" + std::to_string(i);
+      wrong += strcmp(page->get_data(), s.c_str()) != 0;
+      p.unpin(page->id, false);
+    }
+    PURE_TEST_EQ(wrong, 0);
+
+    PURE_TEST_TRUE(p.resize(8));
+    PURE_TEST_TRUE(p.resize(64));
+    Scheduler scheduler{1};
+    wrong = scheduler.block_on(co_check(p, pids));
+    PURE_TEST_EQ(wrong, 0);
+    p.close();
+    remove("resize_fixed.db");
+  }
+
+  Task<size_t> co_check(BufferPool &p, const std::vector<PageId> &pids) {
+    size_t wrong = 0;
+    for (size_t i = 0; i < pids.size(); ++i) {
+      Page *page = co_await p.co_fetch(pids[i]);
+      std::string s = "fixed" + std::to_string(i);
+      wrong += strcmp(page->get_data(), s.c_str()) != 0;
+      p.unpin(page->id, false);
+    }
+    co_return wrong;
+  }
+
+  void prefetch_test() {
+    std::vector<PageId> pids;
+    {
+      BufferPool p{"prefetch.db", 16};
+      p.open();
+      for (auto i = 0; i < 64; ++i) {
+        auto page = p.new_page();
+        std::string s = "page" + std::to_string(i);
+        memcpy(page->get_data(), s.data(), s.size());
+        pids.push_back(page->id);
+        p.unpin(page->id, true);
+      }
+      p.close();
+    }
+
+    BufferPool p{"prefetch.db", 16};
+    p.open();
+    std::vector<PageId> ids(pids.begin() + 8, pids.begin() + 16);
+    PURE_TEST_EQ(p.prefetch(ids), 8);
+    // resident or already loading pages are skipped
+    PURE_TEST_EQ(p.prefetch(ids), 0);
+    PURE_TEST_FALSE(p.prefetch(PageId{0}));
+
+    for (auto i = 8; i < 16; ++i) {
+      auto page = p.fetch(pids[i]);
+      pure_assert(page != nullptr);
+      std::string s = "page" + std::to_string(i);
+      pure_assert(memcmp(page->get_data(), s.data(), s.size()) == 0) << s;
+      // the read held the only pin
+      PURE_TEST_EQ(page->pin_count, 1);
+      p.unpin(page->id, false);
+    }
+    auto stats = p.stats();
+    PURE_TEST_EQ(stats.prefetches, 8);
+    PURE_TEST_EQ(stats.prefetch_hits, 8);
+    PURE_TEST_EQ(stats.misses, 0);
+
+    // prefetched pages are evictable while nobody uses them
+    for (auto i = 16; i < 64; ++i) {
+      p.prefetch(pids[i]);
+    }
+    for (auto i = 0; i < 64; ++i) {
+      auto page = p.fetch(pids[i]);
+      pure_assert(page != nullptr) << " i " << i;
+      std::string s = "page" + std::to_string(i);
+      pure_assert(memcmp(page->get_data(), s.data(), s.size()) == 0) << s;
+      p.unpin(page->id, false);
+    }
+    p.close();
+    remove("prefetch.db");
+  }
+
+  void checkpoint_test() {
+    BufferPool p{"checkpoint.db", 256};
+    p.open();
+    std::vector<PageId> pids;
+    for (auto i = 0; i < 300; ++i) {
+      auto page = p.new_page();
+      pids.push_back(page->id);
+      p.unpin(page->id, true);
+    }
+    p.flush_all();
+    PURE_TEST_EQ(p.dirty_page_count(), 0);
+
+    // dirty pages in random order with gaps between the runs
+    std::vector<PageId> dirty;
+    for (auto i = 0; i < 300; ++i) {
+      if (i % 7 != 3) {
+        dirty.push_back(pids[i]);
+      }
+    }
+    std::shuffle(dirty.begin(), dirty.end(), std::mt19937(7));
+    for (auto id : dirty) {
+      auto page = p.fetch(id);
+      std::string s = "checkpoint" + std::to_string(id);
+      memcpy(page->get_data(), s.data(), s.size());
+      p.unpin(id, true);
+    }
+    p.set_root(pids[42]);
+    p.checkpoint();
+    PURE_TEST_EQ(p.dirty_page_count(), 0);
+
+    // the file is complete before the pool is closed
+    BufferPool p2{"checkpoint.db", 16};
+    p2.open();
+    PURE_TEST_EQ(p2.root(), pids[42]);
+    for (auto id : dirty) {
+      auto page = p2.fetch(id);
+      pure_assert(page != nullptr);
+      std::string s = "checkpoint" + std::to_string(id);
+      pure_assert(memcmp(page->get_data(), s.data(), s.size()) == 0) << s;
+      p2.unpin(id, false);
+    }
+    p2.close();
+    p.close();
+    remove("checkpoint.db");
+  }
+
+  void wal_checkpoint_test() {
+    BufferPoolOptions options;
+    options.wal.enabled = true;
+    options.wal.checkpoint_bytes = 0;
+    BufferPool p{"wal_checkpoint.db", 64, options};
+    p.open();
+    for (auto i = 0; i < 32; ++i) {
+      p.begin_txn();
+      auto page = p.new_page();
+      std::string s = "wal" + std::to_string(page->id);
+      memcpy(page->get_data(), s.data(), s.size());
+      p.unpin(page->id, true);
+      p.wait_durable(p.commit_txn());
+    }
+
+    // the data pages are synced before the meta page moves the marker
+    // past the log, and the meta page after
+    size_t syncs = p.disk_manager_->syncs();
+    p.checkpoint();
+    PURE_TEST_EQ(p.disk_manager_->syncs(), syncs + 2);
+    PURE_TEST_EQ(p.dirty_page_count(), 0);
+    p.close();
+    remove("wal_checkpoint.db");
+    Wal::remove("wal_checkpoint.db.wal");
+  }
+
+  void decoded_test() {
+    struct Node : DecodedNode {
+      int value = 0;
+    };
+    BufferPool p{"decoded.db", 4};
+    p.open();
+    auto page = p.new_page();
+    PageId id = page->id;
+    PURE_TEST_TRUE(p.decoded(page) == nullptr);
+    auto node = std::make_shared<Node>();
+    p.set_decoded(page, node);
+    p.unpin(id, false);
+
+    // a clean unpin keeps it, a dirty one drops it
+    page = p.fetch(id);
+    PURE_TEST_TRUE(p.decoded(page) == node);
+    p.unpin(id, true);
+    page = p.fetch(id);
+    PURE_TEST_TRUE(p.decoded(page) == nullptr);
+    p.set_decoded(page, node);
+    p.unpin(id, false);
+
+    // the frame is reused by other pages
+    for (auto i = 0; i < 8; ++i) {
+      auto other = p.new_page();
+      PURE_TEST_TRUE(p.decoded(other) == nullptr);
+      p.unpin(other->id, false);
+    }
+    page = p.fetch(id);
+    PURE_TEST_TRUE(p.decoded(page) == nullptr);
+    p.unpin(id, false);
+    p.close();
+    remove("decoded.db");
+  }
+
+  void background_flush_test() {
+    BufferPoolOptions options;
+    options.background_flush = true;
+    options.dirty_high_watermark = 0.5;
+    options.dirty_low_watermark = 0.25;
+    options.flush_interval = std::chrono::milliseconds(1);
+
+    BufferPool p{"flusher.db", 32, options};
+    p.open();
+    std::vector<PageId> pids;
+    for (auto i = 0; i < 1000; ++i) {
+      auto page = p.new_page();
+      pure_assert(page != nullptr);
+      std::string s = "hello world" + std::to_string(i);
+      memcpy(page->get_data(), s.data(), s.size());
+      page->page_type = kLeafPageType;
+      pids.push_back(page->id);
+      p.unpin(page->id, true);
+      if (i % 8 == 0) {
+        // give the flusher a chance to run before the frames are reused
+        std::this_thread::sleep_for(std::chrono::milliseconds(2));
+      }
+    }
+
+    // the flusher keeps the dirty ratio under the high watermark
+    for (auto i = 0; i < 1000 && p.dirty_page_count() > 16; ++i) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    PURE_TEST_LE(p.dirty_page_count(), 16);
+    auto stats = p.stats();
+    PURE_TEST_GT(stats.background_writes, 0);
+    p.close();
+
+    BufferPool p2{"flusher.db", 32};
+    p2.open();
+    for (auto i = 0; i < 1000; ++i) {
+      auto page = p2.fetch(pids[i]);
+      pure_assert(page != nullptr);
+      std::string s = "hello world" + std::to_string(i);
+      pure_assert(memcmp(page->get_data(), s.data(), s.size()) == 0)
+          << "s : " << s << " data : " << page->get_data();
+      PURE_TEST_EQ(page->page_type, kLeafPageType);
+      p2.unpin(page->id, false);
+    }
+    p2.close();
+    remove("flusher.db");
+
+    // the flusher can't write pinned frames and must not hold the latch
+    // while waiting for them
+    BufferPool p3{"flusher.db", 8, options};
+    p3.open();
+    std::vector<PageId> pinned;
+    for (auto i = 0; i < 8; ++i) {
+      auto page = p3.new_page();
+      pure_assert(page != nullptr);
+      pinned.push_back(page->id);
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    for (auto id : pinned) {
+      p3.unpin(id, true);
+    }
+    PURE_TEST_EQ(p3.fetch(pinned[0])->id, pinned[0]);
+    p3.unpin(pinned[0], false);
+    p3.close();
+    remove("flusher.db");
+  }
+
+  // misses wait for the flusher to write their victim, meanwhile the page
+  // they want is read by another thread
+  void concurrent_fetch_test() {
+    BufferPoolOptions options;
+    options.background_flush = true;
+    options.dirty_high_watermark = 0.25;
+    options.dirty_low_watermark = 0;
+    options.flush_interval = std::chrono::milliseconds(1);
+
+    BufferPool p{"concurrent_fetch.db", 8, options};
+    p.open();
+    std::vector<PageId> pids;
+    for (auto i = 0; i < 12; ++i) {
+      auto page = p.new_page();
+      pure_assert(page != nullptr);
+      std::string s = "page" + std::to_string(i);
+      memcpy(page->get_data(), s.data(), s.size() + 1);
+      pids.push_back(page->id);
+      p.unpin(page->id, true);
+    }
+
+    std::vector<std::thread> threads;
+    std::atomic<size_t> wrong = 0;
+    for (auto t = 0; t < 8; ++t) {
+      threads.emplace_back([&, t] {
+        std::mt19937 rng(t);
+        for (auto n = 0; n < 20000; ++n) {
+          size_t i = rng() % pids.size();
+          auto page = p.fetch(pids[i]);
+          if (!page) {
+            // the victims are held by other misses
+            continue;
+          }
+          std::string s = "page" + std::to_string(i);
+          if (page->id != pids[i] || strcmp(page->get_data(), s.c_str())) {
+            wrong++;
+          }
+          p.unpin(pids[i], n % 3 == 0);
+        }
+      });
+    }
+    for (auto &thread : threads) {
+      thread.join();
+    }
+    PURE_TEST_EQ(wrong, 0);
+    p.close();
+    remove("concurrent_fetch.db");
+  }
 };
 
 void store_test() {
@@ -90,9 +524,143 @@ void rand_test() {
   t.rand_test();
 }
 
+void arena_test() {
+  BufferPoolTest t;
+  t.arena_test();
+}
+
+void resize_test() {
+  BufferPoolTest t;
+  t.resize_test();
+}
+
+void resize_fixed_buffers_test() {
+  BufferPoolTest t;
+  t.resize_fixed_buffers_test();
+}
+
+void prefetch_test() {
+  BufferPoolTest t;
+  t.prefetch_test();
+}
+
+void checkpoint_test() {
+  BufferPoolTest t;
+  t.checkpoint_test();
+}
+
+void wal_checkpoint_test() {
+  BufferPoolTest t;
+  t.wal_checkpoint_test();
+}
+
+void decoded_test() {
+  BufferPoolTest t;
+  t.decoded_test();
+}
+
+void background_flush_test() {
+  BufferPoolTest t;
+  t.background_flush_test();
+}
+
+void concurrent_fetch_test() {
+  BufferPoolTest t;
+  t.concurrent_fetch_test();
+}
+
+// the callbacks run without the lock of the subscriptions
+void pressure_test() {
+  MemoryPressure pressure;
+  std::atomic<bool> entered = false, release = false;
+  size_t slow = pressure.subscribe([&](PressureLevel) {
+    entered = true;
+    while (!release) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+  });
+  std::thread notifier([&] { pressure.notify(PressureLevel::kModerate); });
+  while (!entered) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  // a slow callback doesn't hold up the others
+  size_t calls = 0;
+  size_t other = pressure.subscribe([&](PressureLevel) { ++calls; });
+  pressure.unsubscribe(other);
+  release = true;
+  notifier.join();
+  PURE_TEST_EQ(calls, 0);
+  pressure.unsubscribe(slow);
+
+  // a callback may unsubscribe itself
+  size_t once = 0;
+  once = pressure.subscribe([&](PressureLevel) {
+    ++calls;
+    pressure.unsubscribe(once);
+  });
+  pressure.notify(PressureLevel::kCritical);
+  pressure.notify(PressureLevel::kCritical);
+  PURE_TEST_EQ(calls, 1);
+}
+
+// the pool works with every replacer, pages come back after eviction
+template <typename Replacer> void replacer_test() {
+  using Pool = DefaultBufferPool<Replacer>;
+  std::vector<PageId> pids;
+  {
+    Pool p{"replacer.db", 16};
+    p.open();
+    for (auto i = 0; i < 200; ++i) {
+      auto page = p.new_page();
+      pure_assert(page != nullptr);
+      std::string s = "page" + std::to_string(i);
+      memcpy(page->get_data(), s.data(), s.size());
+      pids.push_back(page->id);
+      p.unpin(page->id, true);
+    }
+    // a hot page is fetched between the others
+    for (auto round = 0; round < 2; ++round) {
+      for (auto i = 0; i < 200; ++i) {
+        for (auto id : {pids[i], pids[0]}) {
+          auto page = p.fetch(id);
+          pure_assert(page != nullptr) << " id " << id;
+          p.unpin(id, false);
+        }
+      }
+    }
+    p.close();
+  }
+
+  Pool p{"replacer.db", 16};
+  p.open();
+  for (auto i = 0; i < 200; ++i) {
+    auto page = p.fetch(pids[i]);
+    pure_assert(page != nullptr);
+    std::string s = "page" + std::to_string(i);
+    pure_assert(memcmp(page->get_data(), s.data(), s.size()) == 0) << s;
+    p.unpin(page->id, false);
+  }
+  p.close();
+  remove("replacer.db");
+}
+
 int main(int argc, char *argv[]) {
   PURE_TEST_PREPARE();
   PURE_TEST_CASE(store_test);
   PURE_TEST_CASE(rand_test);
+  PURE_TEST_CASE(arena_test);
+  PURE_TEST_CASE(resize_test);
+  PURE_TEST_CASE(resize_fixed_buffers_test);
+  PURE_TEST_CASE(prefetch_test);
+  PURE_TEST_CASE(checkpoint_test);
+  PURE_TEST_CASE(wal_checkpoint_test);
+  PURE_TEST_CASE(decoded_test);
+  PURE_TEST_CASE(background_flush_test);
+  PURE_TEST_CASE(concurrent_fetch_test);
+  PURE_TEST_CASE(pressure_test);
+  PURE_TEST_CASE(replacer_test<ClockReplacer<size_t>>);
+  PURE_TEST_CASE(replacer_test<LruKReplacer<size_t>>);
+  PURE_TEST_CASE(replacer_test<TwoQueueReplacer<size_t>>);
+  PURE_TEST_CASE(replacer_test<ArcReplacer<size_t>>);
   PURE_TEST_RUN();
 }
\ No newline at end of file
@@ -0,0 +1,250 @@
+#include "../bulk_load.hpp"
+#include "pure_test.hpp"
+
+#include <algorithm>
+#include <random>
+
+PURE_TEST_INIT();
+
+static std::vector<int> shuffled(int n) {
+  std::vector<int> v(n);
+  for (int i = 0; i < n; ++i) {
+    v[i] = i;
+  }
+  std::shuffle(v.begin(), v.end(), std::mt19937(42));
+  return v;
+}
+
+void sorter_test() {
+  ExternalSorter::Options options;
+  options.memory_budget = 64 << 10; // force spilling
+  options.threads = 2;
+  ExternalSorter sorter{options};
+
+  for (auto i : shuffled(20000)) {
+    std::string k = std::to_string(i);
+    sorter.add(bytes(k.begin(), k.end()), bytes(k.begin(), k.end()));
+  }
+  // the later record wins
+  std::string dup = "100";
+  sorter.add(bytes(dup.begin(), dup.end()), bytes{'x'});
+  sorter.finish();
+  PURE_TEST_GT(sorter.spilled_runs(), 1);
+
+  auto merger = sorter.merge();
+  bytes k, v, prev;
+  size_t count = 0;
+  while (merger.next(k, v)) {
+    pure_assert(count == 0 || prev < k) << "not sorted";
+    if (k == bytes(dup.begin(), dup.end())) {
+      pure_assert(v == bytes{'x'});
+    }
+    prev = k;
+    ++count;
+  }
+  PURE_TEST_EQ(count, 20000);
+}
+
+void bulk_load_test() {
+  const char *file = "bulk_load.db";
+  size_t reports = 0;
+  {
+    BPlusTree tree{file, 32};
+    BulkLoadOptions options;
+    options.sort.memory_budget = 256 << 10;
+    options.progress_interval = 5000;
+    options.progress = [&](const BulkLoadProgress &) { ++reports; };
+
+    BulkLoader loader{tree, options};
+    for (auto i : shuffled(30000)) {
+      loader.add(std::to_string(i), std::to_string(i));
+    }
+    pure_assert(!loader.finish());
+
+    for (auto i = 0; i < 30000; ++i) {
+      std::string val;
+      PURE_TEST_TRUE(tree.search(std::to_string(i), val)) << " i " << i;
+      PURE_TEST_EQ(val, std::to_string(i));
+    }
+
+    // the tree still grows by inserts
+    for (auto i = 30000; i < 35000; ++i) {
+      PURE_TEST_TRUE(tree.insert(std::to_string(i), std::to_string(i)));
+    }
+  }
+  PURE_TEST_GT(reports, 2);
+
+  // the root is saved in the meta page
+  BPlusTree tree{file, 32};
+  for (auto i = 0; i < 35000; i += 7) {
+    std::string val;
+    PURE_TEST_TRUE(tree.search(std::to_string(i), val)) << " i " << i;
+    PURE_TEST_EQ(val, std::to_string(i));
+  }
+  remove(file);
+}
+
+void read_ahead_test() {
+  const char *file = "read_ahead.db";
+  {
+    BPlusTree tree{file, 64};
+    BulkLoader loader{tree};
+    for (auto i = 0; i < 30000; ++i) {
+      loader.add(std::to_string(i), std::to_string(i));
+    }
+    pure_assert(!loader.finish());
+  }
+
+  // a cold scan reads the leaves ahead of itself
+  BPlusTree tree{file, 64};
+  size_t count = tree.scan({}, {}, [](const auto &, const auto &) {
+    return true;
+  });
+  PURE_TEST_EQ(count, 30000);
+  auto stats = tree.stats();
+  PURE_TEST_GT(stats.prefetches, 0);
+  PURE_TEST_GT(stats.prefetch_hits, stats.misses);
+  remove(file);
+}
+
+void readonly_mmap_test() {
+  const char *file = "readonly_mmap.db";
+  {
+    BPlusTree tree{file, 32};
+    BulkLoader loader{tree};
+    for (auto i = 0; i < 30000; ++i) {
+      loader.add(std::to_string(i), std::to_string(i));
+    }
+    pure_assert(!loader.finish());
+  }
+
+  auto tree = BPlusTree::open_readonly_mmap(file);
+  // a second reader maps the same pages
+  auto other = BPlusTree::open_readonly_mmap(file, {false, 0});
+  PURE_TEST_TRUE(tree->readonly());
+  for (auto i = 0; i < 30000; i += 3) {
+    std::string val;
+    PURE_TEST_TRUE(tree->search(std::to_string(i), val)) << " i " << i;
+    PURE_TEST_EQ(val, std::to_string(i));
+    PURE_TEST_TRUE(other->search(std::to_string(i), val)) << " i " << i;
+  }
+  std::string val;
+  PURE_TEST_FALSE(tree->search(std::string("x"), val));
+
+  std::string lo = "1000", hi = "2000";
+  size_t count = tree->scan(bytes(lo.begin(), lo.end()),
+                            bytes(hi.begin(), hi.end()),
+                            [](const auto &, const auto &) { return true; });
+  PURE_TEST_EQ(count, 11111);
+
+  // nothing goes through the pool and the file can't be written
+  PURE_TEST_FALSE(tree->insert(std::string("x"), std::string("y")));
+  auto stats = tree->stats();
+  PURE_TEST_EQ(stats.hits + stats.misses, 0);
+
+  bool thrown = false;
+  try {
+    BPlusTree::open_readonly_mmap("no_such_file.db");
+  } catch (const std::runtime_error &) {
+    thrown = true;
+  }
+  PURE_TEST_TRUE(thrown);
+
+  // a meta page of another layout is refused
+  tree.reset();
+  other.reset();
+  std::vector<char> data(PAGE_SIZE);
+  FILE *f = fopen(file, "r+b");
+  pure_assert(fread(data.data(), 1, PAGE_SIZE, f) == PAGE_SIZE);
+  BfpMetaPage meta{data.data()};
+  meta.deserialize();
+  meta.version = 0;
+  meta.serliaze();
+  fseek(f, 0, SEEK_SET);
+  fwrite(data.data(), 1, PAGE_SIZE, f);
+  fclose(f);
+  thrown = false;
+  try {
+    BPlusTree::open_readonly_mmap(file);
+  } catch (const std::runtime_error &) {
+    thrown = true;
+  }
+  PURE_TEST_TRUE(thrown);
+  thrown = false;
+  try {
+    BPlusTree tree{file, 32};
+  } catch (const std::system_error &e) {
+    thrown = e.code() == std::errc::not_supported;
+  }
+  PURE_TEST_TRUE(thrown);
+  remove(file);
+}
+
+void bulk_load_small_test() {
+  const char *file = "bulk_load_small.db";
+  BPlusTree tree{file, 8};
+  // only the ends of the phases are reported
+  BulkLoadOptions options;
+  options.progress_interval = 0;
+  size_t reports = 0;
+  options.progress = [&](const BulkLoadProgress &) { ++reports; };
+  BulkLoader loader{tree, options};
+  loader.add(std::string("b"), std::string("2"));
+  loader.add(std::string("a"), std::string("1"));
+  pure_assert(!loader.finish());
+  PURE_TEST_EQ(reports, 2);
+
+  std::string val;
+  PURE_TEST_TRUE(tree.search(std::string("a"), val));
+  PURE_TEST_EQ(val, "1");
+  PURE_TEST_TRUE(tree.search(std::string("b"), val));
+  PURE_TEST_EQ(val, "2");
+
+  // a tree which is not empty can't be bulk loaded
+  BulkLoader again{tree};
+  again.add(std::string("c"), std::string("3"));
+  pure_assert(again.finish() == std::errc::file_exists);
+  remove(file);
+}
+
+void bulk_load_fail_test() {
+  const char *file = "bulk_load_fail.db";
+  {
+    // the first leaf, the next one and their parent don't fit in the pool
+    BPlusTree tree{file, 2};
+    BulkLoader loader{tree};
+    for (auto i : shuffled(1000)) {
+      loader.add(std::to_string(i), std::to_string(i));
+    }
+    pure_assert(loader.finish() == std::errc::no_buffer_space);
+    PURE_TEST_TRUE(tree.empty());
+
+    // nothing is left pinned, the tree takes inserts
+    for (auto i = 0; i < 1000; ++i) {
+      PURE_TEST_TRUE(tree.insert(std::to_string(i), std::to_string(i)));
+    }
+    std::string val;
+    PURE_TEST_TRUE(tree.search(std::string("500"), val));
+  }
+  remove(file);
+  {
+    BPlusTree tree{file, 8};
+    BulkLoader loader{tree};
+    loader.add(std::string("a"), std::string("1"));
+    loader.add(std::string("b"), std::string(PAGE_SIZE, 'x'));
+    pure_assert(loader.finish() == std::errc::no_buffer_space);
+    PURE_TEST_TRUE(tree.empty());
+  }
+  remove(file);
+}
+
+int main(int, char **) {
+  PURE_TEST_PREPARE();
+  PURE_TEST_CASE(sorter_test);
+  PURE_TEST_CASE(bulk_load_test);
+  PURE_TEST_CASE(read_ahead_test);
+  PURE_TEST_CASE(readonly_mmap_test);
+  PURE_TEST_CASE(bulk_load_small_test);
+  PURE_TEST_CASE(bulk_load_fail_test);
+  PURE_TEST_RUN();
+}
@@ -0,0 +1,186 @@
+#include "../bplus_tree.hpp"
+#include "pure_test.hpp"
+
+#include <atomic>
+#include <stdexcept>
+#include <vector>
+
+PURE_TEST_INIT();
+
+static bytes to_bytes(int i) {
+  auto s = std::to_string(i);
+  return bytes(s.begin(), s.end());
+}
+
+static Task<int> add_one(int i) { co_return i + 1; }
+
+static Task<int> add_two(int i) {
+  int v = co_await add_one(i);
+  co_return co_await add_one(v);
+}
+
+static Task<void> fail() {
+  throw std::runtime_error("fail");
+  co_return;
+}
+
+void task_test() {
+  Scheduler scheduler{2};
+  PURE_TEST_EQ(scheduler.block_on(add_two(40)), 42);
+
+  bool thrown = false;
+  try {
+    scheduler.block_on(fail());
+  } catch (const std::runtime_error &) {
+    thrown = true;
+  }
+  PURE_TEST_TRUE(thrown);
+}
+
+static Task<void> lookup(BPlusTree &tree, int i, std::atomic<int> &found) {
+  value_type val;
+  if (co_await tree.co_search(to_bytes(i), val) && val == to_bytes(i)) {
+    found++;
+  }
+}
+
+void co_search_test() {
+  const char *file = "coro_search.db";
+  {
+    BPlusTree tree{file, 64};
+    for (auto i = 0; i < 5000; ++i) {
+      PURE_TEST_TRUE(tree.insert(std::to_string(i), std::to_string(i)));
+    }
+  }
+
+  // every lookup is in flight at once, most of them wait for a frame
+  BPlusTree tree{file, 64};
+  std::atomic<int> found{0};
+  {
+    Scheduler scheduler{4};
+    for (auto i = 0; i < 5000; ++i) {
+      scheduler.spawn(lookup(tree, i, found));
+    }
+    scheduler.wait();
+  }
+  PURE_TEST_EQ(found.load(), 5000);
+
+  value_type val;
+  Scheduler scheduler{1};
+  PURE_TEST_FALSE(scheduler.block_on(tree.co_search(to_bytes(-1), val)));
+  remove(file);
+}
+
+static Task<void> insert_range(BPlusTree &tree, int lo, int hi,
+                               std::atomic<int> &failed) {
+  for (auto i = lo; i < hi; ++i) {
+    if (!co_await tree.co_insert(to_bytes(i), to_bytes(i))) {
+      failed++;
+    }
+  }
+}
+
+static Task<void> search_range(BPlusTree &tree, int lo, int hi,
+                               std::atomic<int> &failed) {
+  for (auto i = lo; i < hi; ++i) {
+    value_type val;
+    if (!co_await tree.co_search(to_bytes(i), val) || val != to_bytes(i)) {
+      failed++;
+    }
+  }
+}
+
+void co_insert_scan_test() {
+  const char *file = "coro_insert.db";
+  BPlusTree tree{file, 64};
+  for (auto i = 0; i < 2000; ++i) {
+    PURE_TEST_TRUE(tree.insert(std::to_string(i), std::to_string(i)));
+  }
+
+  // readers run while writers split pages under them
+  std::atomic<int> failed{0};
+  Scheduler scheduler{4};
+  for (auto w = 0; w < 4; ++w) {
+    scheduler.spawn(insert_range(tree, 2000 + w * 1000, 3000 + w * 1000, failed));
+    scheduler.spawn(search_range(tree, w * 500, w * 500 + 500, failed));
+  }
+  scheduler.wait();
+  PURE_TEST_EQ(failed.load(), 0);
+
+  for (auto i = 0; i < 6000; ++i) {
+    std::string val;
+    PURE_TEST_TRUE(tree.search(std::to_string(i), val)) << " i " << i;
+  }
+
+  // keys are ordered as strings, ["1000", "2000") also holds 11..19 and
+  // 101..199
+  auto lo = to_bytes(1000), hi = to_bytes(2000);
+  size_t n = tree.scan(lo, hi, [](const key_type &, const value_type &) {
+    return true;
+  });
+  PURE_TEST_EQ(n, 1111);
+
+  key_type prev;
+  bool sorted = true;
+  size_t co_n = scheduler.block_on(tree.co_scan(
+      lo, hi, [&](const key_type &k, const value_type &v) {
+        sorted = sorted && prev < k && k == v;
+        prev = k;
+        return true;
+      }));
+  PURE_TEST_EQ(co_n, n);
+  PURE_TEST_TRUE(sorted);
+
+  // fn stops the scan
+  size_t limited = scheduler.block_on(tree.co_scan(
+      key_type{}, key_type{},
+      [](const key_type &, const value_type &) { return false; }));
+  PURE_TEST_EQ(limited, 1);
+  remove(file);
+}
+
+void co_scan_duplicates_test() {
+  const char *file = "coro_duplicates.db";
+  BPlusTree tree{file, 64};
+  // the records of a key span leaves
+  for (auto copy = 0; copy < 30; ++copy) {
+    for (auto i = 0; i < 100; ++i) {
+      PURE_TEST_TRUE(tree.insert(std::to_string(i), std::to_string(copy)));
+    }
+  }
+
+  using record = std::pair<key_type, value_type>;
+  auto lo = to_bytes(1), hi = to_bytes(9);
+  std::vector<record> expect;
+  tree.scan(lo, hi, [&](const key_type &k, const value_type &v) {
+    expect.emplace_back(k, v);
+    return true;
+  });
+  PURE_TEST_EQ(expect.size(), 2640);
+
+  // the inserts above the range make the scan restart from a key it is in
+  // the middle of
+  std::vector<record> got;
+  Scheduler scheduler{1};
+  size_t n = scheduler.block_on(tree.co_scan(
+      lo, hi, [&](const key_type &k, const value_type &v) {
+        got.emplace_back(k, v);
+        if (got.size() % 50 == 0) {
+          tree.insert(std::string("z") + std::to_string(got.size()),
+                      std::string("z"));
+        }
+        return true;
+      }));
+  PURE_TEST_EQ(n, expect.size());
+  PURE_TEST_TRUE(got == expect);
+  remove(file);
+}
+
+int main(int, char **) {
+  PURE_TEST_PREPARE();
+  PURE_TEST_CASE(task_test);
+  PURE_TEST_CASE(co_search_test);
+  PURE_TEST_CASE(co_insert_scan_test);
+  PURE_TEST_CASE(co_scan_duplicates_test);
+  PURE_TEST_RUN();
+}
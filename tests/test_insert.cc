@@ -1,5 +1,17 @@
 #include "../bplus_tree.hpp"
 #include "pure_test.hpp"
+
+#include <algorithm>
+#include <csignal>
+#include <map>
+#include <numeric>
+#include <random>
+#include <thread>
+
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
 PURE_TEST_INIT();
 
 class BPlusTreeTest {
@@ -31,12 +43,587 @@ public:
     }
 
     for (auto &&p : tree.buffer_pool_.pages_) {
-      auto page = p.get();
+      auto page = &p;
       pure_assert(page->pin_count == 0)
           << "page " << page->id << " pin_count " << page->pin_count;
     }
     remove("test");
   }
+
+  void resident_test() {
+    std::string_view db_name{"resident.db"};
+    BPlusTree tree{db_name, 64};
+    std::vector<int> keys(20000);
+    for (auto i = 0; i < 20000; ++i) {
+      keys[i] = i;
+    }
+    std::shuffle(keys.begin(), keys.end(), std::mt19937(3));
+    for (auto i : keys) {
+      PURE_TEST_TRUE(tree.insert(std::to_string(i), std::to_string(i)));
+    }
+    // the root and the level below it, every internal node of this tree
+    PURE_TEST_GT(tree.resident_.size(), 1);
+    PURE_TEST_TRUE(tree.resident_.count(tree.root_));
+
+    tree.scan({}, {}, [](const auto &, const auto &) { return true; });
+    auto before = tree.stats();
+    for (auto i = 0; i < 20000; i += 3) {
+      std::string val;
+      PURE_TEST_TRUE(tree.search(std::to_string(i), val)) << " i " << i;
+      PURE_TEST_EQ(val, std::to_string(i));
+    }
+    // only the leaves go through the pool
+    auto after = tree.stats();
+    PURE_TEST_EQ(after.hits + after.misses - before.hits - before.misses,
+                 (20000 + 2) / 3);
+
+    for (auto &&p : tree.buffer_pool_.pages_) {
+      pure_assert(p.pin_count == 0) << "page " << p.id;
+    }
+    remove("resident.db");
+  }
+
+  void wal_recovery_test() {
+    std::string_view db_name{"wal.db"};
+    BufferPoolOptions options;
+    options.wal.enabled = true;
+    // the child dies with its pool unflushed, only the log has the writes
+    pid_t pid = fork();
+    if (pid == 0) {
+      BPlusTree tree{db_name, 16, options};
+      for (auto i = 0; i < 3000; ++i) {
+        tree.insert(std::to_string(i), std::to_string(i));
+      }
+      _exit(0);
+    }
+    int status;
+    waitpid(pid, &status, 0);
+    PURE_TEST_TRUE(WIFEXITED(status));
+
+    {
+      BPlusTree tree{db_name, 16, options};
+      for (auto i = 0; i < 3000; ++i) {
+        std::string val;
+        PURE_TEST_TRUE(tree.search(std::to_string(i), val)) << " i " << i;
+        PURE_TEST_EQ(val, std::to_string(i));
+      }
+    }
+    remove("wal.db");
+    Wal::remove("wal.db.wal");
+  }
+
+  void wal_retry_test() {
+    const char *path = "retry.wal";
+    std::vector<char> page(PAGE_SIZE, 'w');
+    // the child can't write past the limit, the failed commit is written
+    // again by the next one
+    pid_t pid = fork();
+    if (pid == 0) {
+      signal(SIGXFSZ, SIG_IGN);
+      Wal wal{path, PAGE_SIZE};
+      bool ok = wal.commit(wal.append({{1, page.data()}}));
+      struct stat st;
+      stat((std::string(path) + ".1").c_str(), &st);
+      // room for half a record
+      struct rlimit limit{static_cast<rlim_t>(st.st_size + PAGE_SIZE / 2),
+                          RLIM_INFINITY};
+      setrlimit(RLIMIT_FSIZE, &limit);
+      ok = ok && !wal.commit(wal.append({{2, page.data()}}));
+      limit.rlim_cur = RLIM_INFINITY;
+      setrlimit(RLIMIT_FSIZE, &limit);
+      ok = ok && wal.commit(wal.append({{3, page.data()}}));
+      _exit(ok ? 0 : 1);
+    }
+    int status;
+    waitpid(pid, &status, 0);
+    PURE_TEST_TRUE(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+
+    std::vector<int64_t> ids;
+    {
+      Wal wal{path, PAGE_SIZE};
+      wal.recover(0, [&](int64_t id, const char *) { ids.push_back(id); });
+    }
+    PURE_TEST_TRUE((ids == std::vector<int64_t>{1, 2, 3}));
+    Wal::remove(path);
+  }
+
+  void group_commit_test() {
+    std::string_view db_name{"group.db"};
+    BufferPoolOptions options;
+    options.wal.enabled = true;
+    auto tree = std::make_unique<BPlusTree>(db_name, 64, options);
+    std::vector<std::thread> writers;
+    for (auto t = 0; t < 8; ++t) {
+      writers.emplace_back([&, t] {
+        for (auto i = t; i < 4000; i += 8) {
+          auto key = std::to_string(i);
+          tree->insert(key_type(key.begin(), key.end()),
+                       value_type(key.begin(), key.end()));
+        }
+      });
+    }
+    for (auto &w : writers) {
+      w.join();
+    }
+    auto stats = tree->stats();
+    PURE_TEST_EQ(stats.wal_commits, 4000);
+    PURE_TEST_LT(stats.wal_syncs, stats.wal_commits);
+    for (auto i = 0; i < 4000; ++i) {
+      std::string val;
+      PURE_TEST_TRUE(tree->search(std::to_string(i), val)) << " i " << i;
+    }
+    tree.reset();
+    remove("group.db");
+    Wal::remove("group.db.wal");
+  }
+
+  void fuzzy_checkpoint_test() {
+    std::string_view db_name{"ckpt.db"};
+    BufferPoolOptions options;
+    options.wal.enabled = true;
+    options.wal.checkpoint_bytes = 1 << 20;
+    options.flush_interval = std::chrono::milliseconds{5};
+    pid_t pid = fork();
+    if (pid == 0) {
+      BPlusTree tree{db_name, 32, options};
+      for (auto i = 0; i < 10000; ++i) {
+        tree.insert(std::to_string(i), std::to_string(i));
+      }
+      auto stats = tree.stats();
+      // the log stayed near the target while about ten times that was logged
+      _exit(stats.checkpoints > 0 && stats.wal_bytes < 4 << 20 ? 0 : 1);
+    }
+    int status;
+    waitpid(pid, &status, 0);
+    PURE_TEST_TRUE(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+
+    size_t log_bytes = 0;
+    for (auto &entry : std::filesystem::directory_iterator(".")) {
+      if (entry.path().filename().string().rfind("ckpt.db.wal.", 0) == 0) {
+        log_bytes += entry.file_size();
+      }
+    }
+    PURE_TEST_LT(log_bytes, 4 << 20);
+
+    {
+      BPlusTree tree{db_name, 32, options};
+      for (auto i = 0; i < 10000; ++i) {
+        std::string val;
+        PURE_TEST_TRUE(tree.search(std::to_string(i), val)) << " i " << i;
+        PURE_TEST_EQ(val, std::to_string(i));
+      }
+    }
+    remove("ckpt.db");
+    Wal::remove("ckpt.db.wal");
+  }
+
+  void cow_test() {
+    std::string_view db_name{"cow.db"};
+    BufferPoolOptions options;
+    options.cow.enabled = true;
+    // a crash leaves the last published root, nothing is redone
+    pid_t pid = fork();
+    if (pid == 0) {
+      BPlusTree tree{db_name, 32, options};
+      for (auto i = 0; i < 2000; ++i) {
+        tree.insert(std::to_string(i), std::to_string(i));
+      }
+      _exit(0);
+    }
+    int status;
+    waitpid(pid, &status, 0);
+    PURE_TEST_TRUE(WIFEXITED(status));
+
+    auto tree_ptr = std::make_unique<BPlusTree>(db_name, 32, options);
+    auto &tree = *tree_ptr;
+    for (auto i = 0; i < 2000; ++i) {
+      std::string val;
+      PURE_TEST_TRUE(tree.search(std::to_string(i), val)) << " i " << i;
+      PURE_TEST_EQ(val, std::to_string(i));
+    }
+    // the replaced pages were reused, not appended
+    size_t pages = tree.buffer_pool_.page_count();
+    PURE_TEST_LT(pages, 400);
+
+    {
+      // a reader keeps its version while the tree changes
+      BPlusTree::CowReader reader{tree};
+      for (auto i = 2000; i < 2500; ++i) {
+        PURE_TEST_TRUE(tree.insert(std::to_string(i), std::to_string(i)));
+      }
+      size_t count = 0;
+      tree.scan_cow(reader.root(), {}, {},
+                    [](const auto &, const auto &) { return true; }, count);
+      PURE_TEST_EQ(count, 2000);
+      PURE_TEST_EQ(tree.scan({}, {}, [](const auto &, const auto &) {
+        return true;
+      }), 2500);
+      PURE_TEST_GT(tree.cow_freed_.size(), 0);
+    }
+    PURE_TEST_TRUE(tree.insert(std::string("2500"), std::string("2500")));
+    PURE_TEST_EQ(tree.cow_freed_.size(), 0);
+
+    key_type lo{'1', '0', '0', '0'}, hi{'2', '0', '0', '0'};
+    size_t count = tree.scan(lo, hi, [](const auto &, const auto &) {
+      return true;
+    });
+    PURE_TEST_EQ(count, 1111);
+    tree_ptr.reset();
+    remove("cow.db");
+  }
+
+  void snapshot_test() {
+    std::string_view db_name{"snapshot.db"};
+    BufferPoolOptions options;
+    options.cow.enabled = true;
+    options.cow.sync = false;
+    auto tree_ptr = std::make_unique<BPlusTree>(db_name, 32, options);
+    auto &tree = *tree_ptr;
+    for (auto i = 0; i < 1000; ++i) {
+      tree.insert(std::to_string(i), std::to_string(i));
+    }
+
+    auto snapshot = tree.snapshot();
+    PURE_TEST_TRUE(snapshot != nullptr);
+    // writers don't wait for the snapshot
+    std::thread writer{[&] {
+      for (auto i = 1000; i < 3000; ++i) {
+        tree.insert(std::to_string(i), std::to_string(i));
+      }
+    }};
+    writer.join();
+    tree.checkpoint();
+
+    {
+      auto cursor = snapshot->cursor();
+      size_t count = 0;
+      key_type prev;
+      for (; cursor.valid(); cursor.next()) {
+        if (count > 0) {
+          PURE_TEST_TRUE(prev < cursor.key());
+        }
+        PURE_TEST_TRUE(cursor.key() == cursor.value());
+        prev = cursor.key();
+        ++count;
+      }
+      PURE_TEST_EQ(count, 1000);
+      PURE_TEST_EQ(snapshot->scan({}, {}, [](const auto &, const auto &) {
+        return true;
+      }), 1000);
+      key_type key{'2', '0', '0', '0'};
+      value_type val;
+      PURE_TEST_FALSE(snapshot->search(key, val));
+      PURE_TEST_TRUE(tree.search(key, val));
+      PURE_TEST_EQ(tree.scan({}, {}, [](const auto &, const auto &) {
+        return true;
+      }), 3000);
+
+      auto from = snapshot->cursor(key_type{'5'});
+      PURE_TEST_TRUE(from.valid());
+      PURE_TEST_TRUE((from.key() == key_type{'5'}));
+      PURE_TEST_FALSE(snapshot->cursor(key_type{'a'}).valid());
+
+      // a cursor keeps the version after the snapshot handle is released
+      snapshot.reset();
+      PURE_TEST_GT(tree.cow_freed_.size(), 0);
+      from.next();
+      PURE_TEST_TRUE((from.key() == key_type{'5', '0'}));
+    }
+    PURE_TEST_EQ(tree.cow_freed_.size(), 0);
+    tree_ptr.reset();
+    remove("snapshot.db");
+  }
+
+  void write_buffer_test() {
+    std::string_view db_name{"write_buffer.db"};
+    BufferPoolOptions options;
+    options.write_buffer = 512;
+    std::vector<int> keys(5000);
+    std::iota(keys.begin(), keys.end(), 0);
+    std::shuffle(keys.begin(), keys.end(), std::mt19937{42});
+
+    std::map<std::string, std::string> expect;
+    auto check = [&](BPlusTree &tree) {
+      for (auto i = 0; i < 5000; ++i) {
+        std::string key = std::to_string(i), val;
+        bool found = tree.search(key, val);
+        PURE_TEST_EQ(found, expect.count(key) > 0) << " key " << key;
+        if (found) {
+          PURE_TEST_EQ(val, expect[key]);
+        }
+      }
+      auto it = expect.begin();
+      size_t count = tree.scan({}, {}, [&](const auto &k, const auto &v) {
+        PURE_TEST_TRUE(it != expect.end());
+        PURE_TEST_EQ(std::string(k.begin(), k.end()), it->first);
+        PURE_TEST_EQ(std::string(v.begin(), v.end()), it->second);
+        ++it;
+        return true;
+      });
+      PURE_TEST_EQ(count, expect.size());
+      key_type lo{'1', '0', '0', '0'}, hi{'2'};
+      count = tree.scan(lo, hi, [](const auto &, const auto &) {
+        return true;
+      });
+      PURE_TEST_EQ(count, std::distance(expect.lower_bound("1000"),
+                                        expect.lower_bound("2")));
+    };
+
+    {
+      BPlusTree tree{db_name, 32, options};
+      for (auto i : keys) {
+        std::string key = std::to_string(i);
+        PURE_TEST_TRUE(tree.insert(key, key));
+        expect[key] = key;
+      }
+      // the writes wait in the buffers of the internal nodes
+      size_t buffered = 0;
+      for (auto &&p : tree.buffer_pool_.pages_) {
+        if (p.id != INVALID_PAGE_ID && p.page_type == kInternalPageType) {
+          auto node = InternalNode();
+          node.read(&p);
+          buffered += node.messages().size();
+        }
+      }
+      PURE_TEST_GT(buffered, 0);
+
+      for (auto i : keys) {
+        std::string k = std::to_string(i);
+        key_type key{k.begin(), k.end()};
+        if (i % 5 == 0) {
+          PURE_TEST_TRUE(tree.remove(key));
+          expect.erase(k);
+        } else if (i % 3 == 0) {
+          PURE_TEST_TRUE(tree.upsert(key, key_type{'u'}));
+          expect[k] = "u";
+        }
+      }
+      check(tree);
+    }
+
+    // the buffers are kept in the pages
+    {
+      BPlusTree tree{db_name, 32, options};
+      check(tree);
+    }
+    // and read with the setting of the file, whatever the options say
+    {
+      BPlusTree tree{db_name, 32};
+      PURE_TEST_EQ(tree.write_buffer_, 512);
+      check(tree);
+      key_type key{'x'};
+      PURE_TEST_TRUE(tree.insert(key, key));
+      PURE_TEST_TRUE(tree.remove(key));
+      check(tree);
+    }
+    check(*BPlusTree::open_readonly_mmap(db_name));
+    // copy-on-write mode doesn't read the buffers
+    BufferPoolOptions cow;
+    cow.cow.enabled = true;
+    bool refused = false;
+    try {
+      BPlusTree tree{db_name, 32, cow};
+    } catch (const std::system_error &e) {
+      refused = e.code() == std::errc::invalid_argument;
+    }
+    PURE_TEST_TRUE(refused);
+    remove("write_buffer.db");
+
+    // a file without buffers doesn't get them
+    {
+      BPlusTree tree{db_name, 32};
+      PURE_TEST_TRUE(tree.insert(std::string("a"), std::string("a")));
+    }
+    BPlusTree tree{db_name, 32, options};
+    PURE_TEST_EQ(tree.write_buffer_, 0);
+    remove("write_buffer.db");
+  }
+
+  void filter_test() {
+    std::string_view db_name{"filter.db"};
+    BufferPoolOptions options;
+    options.filter.enabled = true;
+    {
+      BPlusTree tree{db_name, 32, options};
+      for (auto i = 0; i < 20000; i += 2) {
+        tree.insert(std::to_string(i), std::to_string(i));
+      }
+      // it outgrew the filter of the empty tree
+      auto stats = tree.filter_stats();
+      PURE_TEST_GT(stats.rebuilds, 1);
+      PURE_TEST_EQ(stats.keys, 10000);
+
+      for (auto i = 0; i < 20000; ++i) {
+        std::string val;
+        bool found = tree.search(std::to_string(i), val);
+        PURE_TEST_EQ(found, i % 2 == 0);
+      }
+      stats = tree.filter_stats();
+      PURE_TEST_EQ(stats.negatives + stats.false_positives, 10000);
+      PURE_TEST_LT(stats.fpr(), 0.05);
+      PURE_TEST_GT(stats.bytes, 10000 * 10 / 8);
+
+      // a removed key passes the filter until it is built again
+      for (auto i = 0; i < 2000; i += 2) {
+        std::string key = std::to_string(i);
+        PURE_TEST_TRUE(tree.remove(key_type{key.begin(), key.end()}));
+      }
+      for (auto i = 0; i < 2000; ++i) {
+        std::string val;
+        PURE_TEST_FALSE(tree.search(std::to_string(i), val));
+      }
+    }
+
+    // built from the leaves when the tree is opened
+    BPlusTree tree{db_name, 32, options};
+    auto stats = tree.filter_stats();
+    PURE_TEST_EQ(stats.rebuilds, 1);
+    PURE_TEST_EQ(stats.keys, 9000);
+    for (auto i = 0; i < 20000; ++i) {
+      std::string val;
+      bool found = tree.search(std::to_string(i), val);
+      PURE_TEST_EQ(found, i >= 2000 && i % 2 == 0);
+    }
+    PURE_TEST_LT(tree.filter_stats().fpr(), 0.05);
+    remove("filter.db");
+  }
+
+  void adaptive_hash_test() {
+    std::string_view db_name{"adaptive_hash.db"};
+    BufferPoolOptions options;
+    options.adaptive_hash.enabled = true;
+    options.adaptive_hash.hot_threshold = 4;
+    BPlusTree tree{db_name, 32, options};
+    for (auto i = 0; i < 5000; ++i) {
+      tree.insert(std::to_string(i), std::to_string(i));
+    }
+
+    std::string val;
+    for (auto i = 0; i < 10; ++i) {
+      PURE_TEST_TRUE(tree.search(std::string("42"), val));
+      PURE_TEST_EQ(val, "42");
+    }
+    // indexed by the fourth search
+    auto stats = tree.adaptive_hash_stats();
+    PURE_TEST_EQ(stats.hits, 6);
+    PURE_TEST_EQ(stats.entries, 1);
+
+    // a change of the leaf makes the slot stale
+    tree.insert(std::string("42 "), std::string("x"));
+    PURE_TEST_TRUE(tree.search(std::string("42"), val));
+    PURE_TEST_EQ(val, "42");
+    PURE_TEST_EQ(tree.adaptive_hash_stats().hits, 6);
+    PURE_TEST_EQ(tree.adaptive_hash_stats().entries, 0);
+
+    for (auto i = 0; i < 4; ++i) {
+      PURE_TEST_TRUE(tree.search(std::string("42"), val));
+    }
+    PURE_TEST_EQ(tree.adaptive_hash_stats().entries, 1);
+    // splits and evictions elsewhere leave every answer right
+    for (auto i = 0; i < 5000; ++i) {
+      tree.insert("k" + std::to_string(i), std::to_string(i));
+    }
+    for (auto i = 0; i < 5000; i += 7) {
+      auto key = std::to_string(i);
+      PURE_TEST_TRUE(tree.search(key, val));
+      PURE_TEST_EQ(val, key);
+    }
+    PURE_TEST_TRUE(tree.search(std::string("42 "), val));
+    PURE_TEST_EQ(val, "x");
+    remove("adaptive_hash.db");
+  }
+
+  void remove_range_test() {
+    std::string_view db_name{"remove_range.db"};
+    for (size_t write_buffer : {0, 512}) {
+      BufferPoolOptions options;
+      options.write_buffer = write_buffer;
+      std::vector<int> keys(20000);
+      std::iota(keys.begin(), keys.end(), 0);
+      std::shuffle(keys.begin(), keys.end(), std::mt19937{42});
+
+      std::map<std::string, std::string> expect;
+      auto check = [&](BPlusTree &tree) {
+        for (auto i = 0; i < 20000; ++i) {
+          std::string key = std::to_string(i), val;
+          bool found = tree.search(key, val);
+          PURE_TEST_EQ(found, expect.count(key) > 0) << " key " << key;
+        }
+        auto it = expect.begin();
+        size_t count = tree.scan({}, {}, [&](const auto &k, const auto &) {
+          PURE_TEST_TRUE(it != expect.end());
+          PURE_TEST_EQ(std::string(k.begin(), k.end()), it->first);
+          ++it;
+          return true;
+        });
+        PURE_TEST_EQ(count, expect.size());
+      };
+      auto remove_range = [&](BPlusTree &tree, std::string lo, std::string hi) {
+        PURE_TEST_TRUE(tree.remove_range(key_type(lo.begin(), lo.end()),
+                                         key_type(hi.begin(), hi.end())));
+        expect.erase(expect.lower_bound(lo),
+                     hi.empty() ? expect.end() : expect.lower_bound(hi));
+      };
+
+      size_t free_pages = 0, pages = 0;
+      {
+        BPlusTree tree{db_name, 64, options};
+        for (auto i : keys) {
+          tree.insert(std::to_string(i), std::to_string(i));
+          expect[std::to_string(i)] = std::to_string(i);
+        }
+
+        free_pages = tree.buffer_pool_.free_page_count();
+        remove_range(tree, "1", "5");
+        check(tree);
+        PURE_TEST_LT(free_pages + 100, tree.buffer_pool_.free_page_count());
+
+        // the range takes new keys again
+        for (auto i : keys) {
+          std::string key = std::to_string(i);
+          if (i % 7 == 0 && key >= "1" && key < "5") {
+            tree.insert(key, key);
+            expect[key] = key;
+          }
+        }
+        check(tree);
+
+        remove_range(tree, "8", "");
+        remove_range(tree, "", "2");
+        remove_range(tree, "33", "34");
+        check(tree);
+        free_pages = tree.buffer_pool_.free_page_count();
+        pages = tree.buffer_pool_.page_count();
+      }
+      {
+        BPlusTree tree{db_name, 64, options};
+        check(tree);
+        // the free pages outlive the close
+        PURE_TEST_EQ(tree.buffer_pool_.free_page_count(), free_pages);
+        // everything but the first leaf
+        remove_range(tree, "", "");
+        check(tree);
+        tree.insert(std::string("1"), std::string("1"));
+        expect["1"] = "1";
+        check(tree);
+        free_pages = tree.buffer_pool_.free_page_count();
+      }
+      {
+        BPlusTree tree{db_name, 64, options};
+        PURE_TEST_EQ(tree.buffer_pool_.free_page_count(), free_pages);
+        // the tree grows back into the freed pages
+        for (auto i : keys) {
+          std::string key = std::to_string(i);
+          if (expect.emplace(key, key).second) {
+            tree.insert(key, key);
+          }
+        }
+        check(tree);
+        PURE_TEST_LT(tree.buffer_pool_.page_count(), pages + free_pages / 2);
+      }
+      remove(db_name.data());
+    }
+  }
 };
 
 void make_test() {
@@ -49,9 +636,75 @@ void check_buffer_pool_clean() {
   test.check_buffer_pool_clean();
 }
 
+void resident_test() {
+  BPlusTreeTest test;
+  test.resident_test();
+}
+
+void wal_recovery_test() {
+  BPlusTreeTest test;
+  test.wal_recovery_test();
+}
+
+void wal_retry_test() {
+  BPlusTreeTest test;
+  test.wal_retry_test();
+}
+
+void group_commit_test() {
+  BPlusTreeTest test;
+  test.group_commit_test();
+}
+
+void fuzzy_checkpoint_test() {
+  BPlusTreeTest test;
+  test.fuzzy_checkpoint_test();
+}
+
+void cow_test() {
+  BPlusTreeTest test;
+  test.cow_test();
+}
+
+void snapshot_test() {
+  BPlusTreeTest test;
+  test.snapshot_test();
+}
+
+void write_buffer_test() {
+  BPlusTreeTest test;
+  test.write_buffer_test();
+}
+
+void filter_test() {
+  BPlusTreeTest test;
+  test.filter_test();
+}
+
+void adaptive_hash_test() {
+  BPlusTreeTest test;
+  test.adaptive_hash_test();
+}
+
+void remove_range_test() {
+  BPlusTreeTest test;
+  test.remove_range_test();
+}
+
 int main(int argc, char **) {
   PURE_TEST_PREPARE();
   PURE_TEST_CASE(make_test);
   PURE_TEST_CASE(check_buffer_pool_clean);
+  PURE_TEST_CASE(resident_test);
+  PURE_TEST_CASE(wal_recovery_test);
+  PURE_TEST_CASE(wal_retry_test);
+  PURE_TEST_CASE(group_commit_test);
+  PURE_TEST_CASE(fuzzy_checkpoint_test);
+  PURE_TEST_CASE(cow_test);
+  PURE_TEST_CASE(snapshot_test);
+  PURE_TEST_CASE(write_buffer_test);
+  PURE_TEST_CASE(filter_test);
+  PURE_TEST_CASE(adaptive_hash_test);
+  PURE_TEST_CASE(remove_range_test);
   PURE_TEST_RUN();
 }
\ No newline at end of file
@@ -4,6 +4,7 @@
 
 #include <vector>
 #include <algorithm>
+#include <random>
 
 PURE_TEST_INIT();
 
@@ -97,9 +98,97 @@ BufferPool bfp{"leaf_node_rm.db", 1};
     remove("leaf_node_rm.db");
 }
 
+void leaf_node_find() {
+    BufferPool bfp{"leaf_node_find.db", 1};
+    bfp.open();
+
+    auto page = bfp.new_page();
+    page->page_type = kLeafPageType;
+    auto leaf = LeafNode();
+    leaf.read(page);
+
+    // long keys with a common prefix, each twice
+    std::string prefix(64, 'k');
+    std::vector<bytes> datas;
+    for (auto i = 0; i < 200; ++i) {
+        std::string num = prefix + std::to_string(rand() % 1000);
+        key_type k(num.begin(), num.end());
+        leaf.insert(k, k);
+        leaf.insert(k, k);
+        datas.push_back(k);
+    }
+    for (auto i = 0; i < 50; ++i) {
+        leaf.remove(datas[i]);
+        leaf.remove(datas[i]);
+    }
+
+    LeafNode half;
+    leaf.move_half_to(half);
+    for (auto *node : {&leaf, &half}) {
+        for (auto &k : datas) {
+            auto [exist, idx] = node->find(k);
+            auto first = node->find_idx(k);
+            pure_assert(idx == first);
+            pure_assert(exist == (first < node->size() && node->key(first) == k));
+        }
+    }
+
+    remove("leaf_node_find.db");
+}
+
+void internal_node_find() {
+    // 8 byte big endian ids after a table prefix
+    auto id_key = [](uint64_t id) {
+        key_type k{'t', '/'};
+        for (int i = 7; i >= 0; --i) {
+            k.push_back(static_cast<char>(id >> (i * 8)));
+        }
+        return k;
+    };
+    std::mt19937_64 rng{7};
+    auto check = [&](const InternalNode &node) {
+        std::vector<key_type> keys, probes;
+        for (auto i = 0; i < node.size(); ++i) {
+            keys.push_back(node.key(i));
+        }
+        probes = keys;
+        for (auto i = 0; i < 1000; ++i) {
+            probes.push_back(id_key(rng()));
+        }
+        probes.push_back({'t'});
+        probes.push_back({'u'});
+        for (auto &k : probes) {
+            auto lower = std::lower_bound(keys.begin(), keys.end(), k);
+            pure_assert(node.find_idx(k) == lower - keys.begin());
+        }
+    };
+
+    InternalNode uniform;
+    while (uniform.less_than(PAGE_SIZE)) {
+        uniform.insert(id_key(rng()), 0);
+    }
+    pure_assert(uniform.modeled());
+    check(uniform);
+
+    InternalNode half;
+    uniform.move_half_to(half);
+    check(uniform);
+    check(half);
+
+    // most ids small, the line misses them
+    InternalNode skewed;
+    for (auto i = 0; skewed.less_than(PAGE_SIZE); ++i) {
+        skewed.insert(id_key(i < 30 ? i : rng()), 0);
+    }
+    pure_assert(!skewed.modeled());
+    check(skewed);
+}
+
 int main(int argc, char* argv[]) {
     PURE_TEST_PREPARE();
     PURE_TEST_CASE(leaf_node_rm);
     PURE_TEST_CASE(internal_node_rm);
+    PURE_TEST_CASE(leaf_node_find);
+    PURE_TEST_CASE(internal_node_find);
     PURE_TEST_RUN();
 }
\ No newline at end of file
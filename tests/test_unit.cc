@@ -1,10 +1,13 @@
 #include "../buffer_pool.hpp"
 #include "../logger.hpp"
 #include "pure_test.hpp"
+#include <atomic>
 #include <cstdio>
 #include <random>
+#include <map>
 #include <set>
 #include <system_error>
+#include <thread>
 #include <variant>
 #include <vector>
 
@@ -56,6 +59,120 @@ void lru_test() {
   PURE_TEST_EQ_REPORT(victim, 2);
 }
 
+void clock_test() {
+  ClockReplacer<size_t> replacer{4};
+  for (size_t i = 0; i < 4; ++i) {
+    replacer.put(i);
+  }
+  size_t victim;
+  // every bit is set, the hand clears them and comes back to 0
+  PURE_TEST_TRUE(replacer.victim(victim));
+  PURE_TEST_EQ(victim, 0);
+
+  // 1 is referenced again, 2 is pinned
+  replacer.touch(1);
+  replacer.remove(2);
+  PURE_TEST_TRUE(replacer.victim(victim));
+  PURE_TEST_EQ(victim, 3);
+  PURE_TEST_TRUE(replacer.victim(victim));
+  PURE_TEST_EQ(victim, 1);
+  PURE_TEST_FALSE(replacer.victim(victim));
+  PURE_TEST_EQ(replacer.size(), 0);
+
+  replacer.put(2);
+  PURE_TEST_TRUE(replacer.victim(victim));
+  PURE_TEST_EQ(victim, 2);
+}
+
+// replay the trace on a cache of frames entries, a hit pins and unpins the
+// entry like the buffer pool does, return the hits
+template <typename Replacer>
+size_t replay(const std::vector<int64_t> &trace, size_t frames) {
+  Replacer replacer{frames};
+  std::set<int64_t> resident;
+  size_t hits = 0;
+  for (auto id : trace) {
+    if (resident.count(id)) {
+      ++hits;
+      replacer.remove(id);
+    } else {
+      if (resident.size() == frames) {
+        int64_t victim;
+        pure_assert(replacer.victim(victim));
+        resident.erase(victim);
+      }
+      resident.insert(id);
+    }
+    replacer.put(id);
+  }
+  return hits;
+}
+
+void scan_resistant_test() {
+  // point lookups skewed to 8 of 24 pages, broken by scans of cold pages
+  std::vector<int64_t> trace;
+  std::mt19937 rng(3);
+  int64_t cold = 1000;
+  for (auto round = 0; round < 400; ++round) {
+    for (auto i = 0; i < 8; ++i) {
+      trace.push_back(rng() % 4 == 0 ? rng() % 24 : rng() % 8);
+    }
+    if (round % 10 == 9) {
+      for (auto i = 0; i < 32; ++i) {
+        trace.push_back(cold++);
+      }
+    }
+  }
+
+  size_t lru = replay<LruReplacer<int64_t>>(trace, 12);
+  size_t lru_k = replay<LruKReplacer<int64_t>>(trace, 12);
+  size_t two_q = replay<TwoQueueReplacer<int64_t>>(trace, 12);
+  size_t arc = replay<ArcReplacer<int64_t>>(trace, 12);
+  PURE_TEST_GT(lru_k, lru);
+  PURE_TEST_GT(two_q, lru);
+  PURE_TEST_GT(arc, lru);
+
+  // pinned entries are never victims
+  ArcReplacer<int64_t> replacer{4};
+  for (int64_t i = 0; i < 4; ++i) {
+    replacer.put(i);
+  }
+  replacer.remove(0);
+  replacer.remove(1);
+  int64_t victim;
+  for (auto i = 0; i < 2; ++i) {
+    PURE_TEST_TRUE(replacer.victim(victim));
+    pure_assert(victim == 2 || victim == 3) << victim;
+  }
+  PURE_TEST_FALSE(replacer.victim(victim));
+}
+
+void page_table_test() {
+  PageTable table{64};
+  std::map<PageId, size_t> expect;
+  std::mt19937 rng(7);
+
+  // random inserts and erases keep the table equal to a std::map
+  for (auto round = 0; round < 20000; ++round) {
+    PageId id = rng() % 256;
+    if (expect.count(id)) {
+      PURE_TEST_EQ(table.find(id), expect[id]);
+      PURE_TEST_TRUE(table.erase(id));
+      expect.erase(id);
+    } else if (expect.size() < 64) {
+      table.insert(id, round);
+      expect[id] = round;
+    }
+    PURE_TEST_FALSE(table.erase(id + 1000));
+  }
+  PURE_TEST_EQ(table.size(), expect.size());
+  for (PageId id = 0; id < 256; ++id) {
+    auto it = expect.find(id);
+    PURE_TEST_EQ(table.find(id),
+                 it == expect.end() ? PageTable::npos : it->second);
+  }
+}
+
 void disk_test() {
   // write the DiskManager test here by pure_test.
   DiskManager dsk{"test.db", 1};
@@ -114,9 +231,108 @@ void disk_test() {
   remove("test.db");
 }
 
+// readers and writers run in parallel, the preallocated space isn't part of
+// the file size
+void concurrent_disk_test() {
+  constexpr int kPages = 2000;
+  {
+    IoOptions options;
+    options.extend_chunk = 64 * PAGE_SIZE;
+    DiskManager dsk{"concurrent.db", 1, options};
+    auto fill = [](char *buf, PageId id) {
+      std::fill(buf, buf + PAGE_SIZE, static_cast<char>('a' + id % 26));
+    };
+
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; ++t) {
+      threads.emplace_back([&, t] {
+        char buf[PAGE_SIZE];
+        for (PageId id = 1 + t; id <= kPages; id += 4) {
+          fill(buf, id);
+          pure_assert(dsk.write_page(id, buf)) << " id " << id;
+        }
+      });
+    }
+    for (auto &th : threads) {
+      th.join();
+    }
+    PURE_TEST_EQ_REPORT(dsk.file_size(), (kPages + 1) * PAGE_SIZE);
+    PURE_TEST_EQ_REPORT(std::filesystem::file_size("concurrent.db"),
+                        (kPages + 1) * PAGE_SIZE);
+
+    threads.clear();
+    std::atomic<int> bad{0};
+    for (int t = 0; t < 4; ++t) {
+      threads.emplace_back([&] {
+        char buf[PAGE_SIZE], expect[PAGE_SIZE];
+        for (PageId id = 1; id <= kPages; ++id) {
+          fill(expect, id);
+          if (!dsk.read_page(id, buf) || memcmp(buf, expect, PAGE_SIZE) != 0) {
+            ++bad;
+          }
+        }
+      });
+    }
+    for (auto &th : threads) {
+      th.join();
+    }
+    PURE_TEST_EQ_REPORT(bad.load(), 0);
+    char buf[PAGE_SIZE];
+    PURE_TEST_FALSE_REPORT(dsk.read_page(kPages + 1, buf));
+    dsk.close();
+  }
+  remove("concurrent.db");
+}
+
+// write pages in one batch and read them back, on both io backends
+void async_io_test() {
+  for (bool uring : {true, false}) {
+    IoOptions options;
+    options.use_io_uring = uring;
+    DiskManager dsk{"async.db", 1, options};
+
+    constexpr int kPages = 100;
+    std::vector<char> bufs(kPages * PAGE_SIZE);
+    std::vector<IoRequest> reqs;
+    std::atomic<int> ok{0};
+    for (int i = 0; i < kPages; ++i) {
+      char *buf = bufs.data() + i * PAGE_SIZE;
+      std::string s = "page" + std::to_string(i);
+      std::copy(s.begin(), s.end(), buf);
+      reqs.push_back(DiskManager::page_request(
+          IoRequest::Op::kWrite, i + 1, buf, [&](bool res) { ok += res; }));
+    }
+    dsk.submit(std::move(reqs));
+    dsk.io().drain();
+    PURE_TEST_EQ_REPORT(ok.load(), kPages);
+
+    std::fill(bufs.begin(), bufs.end(), 0);
+    ok = 0;
+    for (int i = 0; i < kPages; ++i) {
+      dsk.async_read_page(i + 1, bufs.data() + i * PAGE_SIZE,
+                          [&](bool res) { ok += res; });
+    }
+    dsk.io().drain();
+    PURE_TEST_EQ_REPORT(ok.load(), kPages);
+    for (int i = 0; i < kPages; ++i) {
+      std::string s = "page" + std::to_string(i);
+      PURE_TEST_EQ_REPORT(std::string_view(bufs.data() + i * PAGE_SIZE), s);
+    }
+
+    // the sync path sees the async writes
+    char cur_buf[PAGE_SIZE] = {0};
+    PURE_TEST_TRUE_REPORT(dsk.read_page(kPages, cur_buf));
+    PURE_TEST_EQ_REPORT(std::string_view{cur_buf},
+                        "page" + std::to_string(kPages - 1));
+
+    dsk.close();
+    remove("async.db");
+  }
+}
+
 void meta_page_test() {
-  char *buf = new char[PAGE_SIZE];
-  BfpMetaPage meta_page{buf};
+  std::vector<char> buf(PAGE_SIZE);
+  BfpMetaPage meta_page{buf.data()};
   meta_page.serliaze();
   for (auto i = 0;; ++i) {
     bool ok = meta_page.push_free_page(i);
@@ -131,6 +347,38 @@ void meta_page_test() {
   }
 }
 
+// a file whose meta page has no magic is not opened and not written
+void meta_format_test() {
+  const char *file = "old_format.db";
+  std::vector<char> buf(PAGE_SIZE * 2);
+  size_t page_count = 2;
+  std::memcpy(buf.data() + sizeof(PageId), &page_count, sizeof(size_t));
+  std::memcpy(buf.data() + PAGE_SIZE, "old page", 8);
+  FILE *f = fopen(file, "wb");
+  fwrite(buf.data(), 1, buf.size(), f);
+  fclose(f);
+
+  {
+    BufferPool bp{file, 4};
+    pure_assert(bp.open() == std::errc::not_supported);
+  }
+  PURE_TEST_EQ(std::filesystem::file_size(file), PAGE_SIZE * 2);
+
+  // this version's file opens again
+  remove(file);
+  {
+    BufferPool bp{file, 4};
+    pure_assert(bp.open() == std::error_code{});
+    bp.unpin(bp.new_page()->id, true);
+    bp.close();
+  }
+  BufferPool bp{file, 4};
+  pure_assert(bp.open() == std::error_code{});
+  PURE_TEST_EQ(bp.page_count(), 2);
+  bp.close();
+  remove(file);
+}
+
 class BufferPoolTest {
 public:
   void write2page(Page *p, std::string_view s) {
@@ -249,8 +497,14 @@ void test_serilze() {
 int main(int argc, char **argv) {
   PURE_TEST_PREPARE();
   PURE_TEST_CASE(lru_test);
+  PURE_TEST_CASE(clock_test);
+  PURE_TEST_CASE(scan_resistant_test);
+  PURE_TEST_CASE(page_table_test);
   PURE_TEST_CASE(disk_test);
+  PURE_TEST_CASE(concurrent_disk_test);
+  PURE_TEST_CASE(async_io_test);
   PURE_TEST_CASE(meta_page_test);
+  PURE_TEST_CASE(meta_format_test);
   PURE_TEST_CASE([] {
     BufferPoolTest().basic_test();
     remove("test.db");
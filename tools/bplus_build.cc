@@ -0,0 +1,109 @@
+// Build an index file from unsorted records.
+//
+// usage: bplus_build <db> [input] [options]
+//   input             one record per line, "key\tvalue", "-" or empty is stdin
+//   --memory <MB>     memory budget of the sort, default 64
+//   --threads <n>     sort threads, default hardware concurrency
+//   --tmp <dir>       directory of the spilled runs
+//   --fill <f>        fill factor of the pages, default 0.9
+//   --pool <n>        buffer pool size in pages, default 1024
+
+#include "../bulk_load.hpp"
+
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <string>
+
+static const char *phase_name(BulkLoadProgress::Phase phase) {
+  switch (phase) {
+  case BulkLoadProgress::Phase::kSort:
+    return "sort";
+  case BulkLoadProgress::Phase::kBuild:
+    return "build";
+  case BulkLoadProgress::Phase::kDone:
+    return "done";
+  }
+  return "";
+}
+
+static void usage() {
+  std::cerr << "usage: bplus_build <db> [input] [--memory MB] [--threads n] "
+               "[--tmp dir] [--fill f] [--pool n]"
+            << std::endl;
+}
+
+int main(int argc, char *argv[]) {
+  if (argc < 2) {
+    usage();
+    return 1;
+  }
+
+  std::string db = argv[1];
+  std::string input = "-";
+  size_t pool_size = 1024;
+  BulkLoadOptions options;
+
+  for (int i = 2; i < argc; ++i) {
+    std::string arg = argv[i];
+    bool has_value = i + 1 < argc;
+    if (arg == "--memory" && has_value) {
+      options.sort.memory_budget = std::stoul(argv[++i]) << 20;
+    } else if (arg == "--threads" && has_value) {
+      options.sort.threads = std::stoul(argv[++i]);
+    } else if (arg == "--tmp" && has_value) {
+      options.sort.temp_dir = argv[++i];
+    } else if (arg == "--fill" && has_value) {
+      options.fill_factor = std::stod(argv[++i]);
+    } else if (arg == "--pool" && has_value) {
+      pool_size = std::stoul(argv[++i]);
+    } else if (arg.rfind("--", 0) != 0) {
+      input = arg;
+    } else {
+      usage();
+      return 1;
+    }
+  }
+
+  std::ifstream file;
+  if (input != "-") {
+    file.open(input);
+    if (!file) {
+      std::cerr << "open " << input << " failed" << std::endl;
+      return 1;
+    }
+  }
+  std::istream &in = input == "-" ? std::cin : file;
+
+  options.progress = [](const BulkLoadProgress &p) {
+    std::cerr << "[" << phase_name(p.phase) << "] records " << p.records
+              << " runs " << p.runs << " " << p.seconds << "s "
+              << static_cast<size_t>(p.records_per_sec()) << " rec/s "
+              << p.mb_per_sec() << " MB/s" << std::endl;
+  };
+
+  BPlusTree tree{db, pool_size};
+  if (!tree.empty()) {
+    std::cerr << db << " is not empty" << std::endl;
+    return 1;
+  }
+
+  BulkLoader loader{tree, options};
+  std::string line;
+  while (std::getline(in, line)) {
+    auto tab = line.find('\t');
+    if (tab == std::string::npos) {
+      loader.add(bytes(line.begin(), line.end()), bytes());
+    } else {
+      loader.add(bytes(line.begin(), line.begin() + tab),
+                 bytes(line.begin() + tab + 1, line.end()));
+    }
+  }
+
+  auto ec = loader.finish();
+  if (ec) {
+    std::cerr << "build failed : " << ec.message() << std::endl;
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,373 @@
+#pragma once
+#include <algorithm>
+#include <cerrno>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+struct WalOptions {
+  // log every write of the tree before its pages may reach the data file,
+  // open() redoes the log after a crash
+  bool enabled = false;
+  // a background checkpoint starts when the log a crash would redo grows
+  // past this many bytes, and drops it once the pages it covers are in the
+  // data file. recovery redoes about this much, plus what was logged while
+  // the checkpoint ran. 0 leaves the log to checkpoint() and close()
+  size_t checkpoint_bytes = 64 << 20;
+};
+
+struct WalStats {
+  size_t commits = 0; // records appended
+  size_t syncs = 0;   // fdatasync calls, one per group of commits
+  size_t bytes = 0;   // the log a crash would redo
+};
+
+// Redo log of page images. A record holds the after-images of every page one
+// operation of the tree changed, so replaying it can't leave a split half
+// done. Commits are grouped: the first committer which finds no sync running
+// writes everything appended so far with one fdatasync, the others wait for
+// it and the next one takes what arrived meanwhile.
+//
+// The log is a sequence of segment files, path.1, path.2 ..., records are
+// appended to the last one. rotate() starts a new segment, and a checkpoint
+// drops the segments whose pages all reached the data file.
+//
+// | magic | count | lsn | checksum | count * (page id | page) |
+class Wal {
+public:
+  using Lsn = uint64_t;
+
+  Wal(const std::string &path, size_t page_size)
+      : path_(path), page_size_(page_size), segments_(list(path)) {
+    if (segments_.empty()) {
+      segments_[1] = 0;
+    }
+    open_segment(segments_.rbegin()->first);
+  }
+
+  ~Wal() {
+    if (fd_ >= 0) {
+      ::close(fd_);
+    }
+  }
+
+  Wal(const Wal &) = delete;
+  Wal &operator=(const Wal &) = delete;
+
+  // @brief remove every segment of the log at path
+  static void remove(const std::string &path) {
+    for (auto &[seq, bytes] : list(path)) {
+      ::unlink((path + "." + std::to_string(seq)).c_str());
+    }
+  }
+
+  // @brief call fn for the pages of every complete record in the segments
+  // from seq on, in order. a torn record at the end stops the replay. return
+  // the records replayed
+  size_t recover(uint64_t from,
+                 const std::function<void(int64_t, const char *)> &fn) {
+    size_t records = 0;
+    for (auto it = segments_.lower_bound(from); it != segments_.end(); ++it) {
+      bool torn = false;
+      records += replay(segment_path(it->first), fn, torn);
+      if (torn) {
+        break;
+      }
+    }
+    durable_ = next_lsn_;
+    return records;
+  }
+
+  // @brief after the recovered pages are synced: drop every segment and
+  // start a new one with a larger seq than any before, and than min_seq
+  uint64_t restart(uint64_t min_seq) {
+    std::unique_lock<std::mutex> lock{mutex_};
+    uint64_t seq = std::max(min_seq, segments_.rbegin()->first) + 1;
+    open_segment(seq);
+    drop_locked(seq);
+    return seq;
+  }
+
+  // @brief make the records so far durable and append the next ones to a
+  // new segment. return the last lsn in the segments before it
+  Lsn rotate() {
+    std::unique_lock<std::mutex> lock{mutex_};
+    cv_.wait(lock, [&] { return !syncing_; });
+    syncing_ = true;
+    std::vector<char> group;
+    group.swap(buffer_);
+    Lsn end = next_lsn_;
+    uint64_t seq = segments_.rbegin()->first + 1;
+    lock.unlock();
+    bool ok = write_all(group) && fdatasync(fd_) == 0;
+    lock.lock();
+    syncing_ = false;
+    stats_.syncs++;
+    if (ok) {
+      segments_.rbegin()->second += group.size();
+      durable_ = end;
+      open_segment(seq);
+    } else {
+      // keep the records, the next commit writes them again after what a
+      // partial write left
+      ::ftruncate(fd_, segments_.rbegin()->second);
+      group.insert(group.end(), buffer_.begin(), buffer_.end());
+      buffer_.swap(group);
+    }
+    cv_.notify_all();
+    return end;
+  }
+
+  // @brief the segment records are appended to
+  uint64_t segment() {
+    std::unique_lock<std::mutex> lock{mutex_};
+    return segments_.rbegin()->first;
+  }
+
+  // @brief remove the segments before seq, their pages are in the data file.
+  // the last segment is kept
+  void drop_before(uint64_t seq) {
+    std::unique_lock<std::mutex> lock{mutex_};
+    drop_locked(seq);
+  }
+
+  // @brief copy the page images into the log buffer, return the lsn to wait
+  // for. nothing is written yet
+  Lsn append(const std::vector<std::pair<int64_t, const char *>> &pages) {
+    std::vector<char> body(pages.size() * (sizeof(int64_t) + page_size_));
+    char *p = body.data();
+    for (auto [id, data] : pages) {
+      std::memcpy(p, &id, sizeof id);
+      std::memcpy(p + sizeof id, data, page_size_);
+      p += sizeof id + page_size_;
+    }
+
+    std::unique_lock<std::mutex> lock{mutex_};
+    Header header;
+    header.magic = kMagic;
+    header.count = pages.size();
+    header.lsn = ++next_lsn_;
+    header.checksum = checksum(body.data(), body.size(), header.count);
+    const char *h = reinterpret_cast<const char *>(&header);
+    buffer_.insert(buffer_.end(), h, h + kHeaderSize);
+    buffer_.insert(buffer_.end(), body.begin(), body.end());
+    stats_.commits++;
+    return header.lsn;
+  }
+
+  // @brief return when the record of lsn and everything before it is on
+  // disk
+  bool commit(Lsn lsn) {
+    std::unique_lock<std::mutex> lock{mutex_};
+    while (durable_ < lsn) {
+      if (syncing_) {
+        cv_.wait(lock);
+        continue;
+      }
+      // this committer syncs the group
+      syncing_ = true;
+      std::vector<char> group;
+      group.swap(buffer_);
+      Lsn end = next_lsn_;
+      lock.unlock();
+      bool ok = write_all(group) && fdatasync(fd_) == 0;
+      lock.lock();
+      syncing_ = false;
+      stats_.syncs++;
+      if (!ok) {
+        // keep the records, the next commit writes them again after what a
+        // partial write left
+        ::ftruncate(fd_, segments_.rbegin()->second);
+        group.insert(group.end(), buffer_.begin(), buffer_.end());
+        buffer_.swap(group);
+        cv_.notify_all();
+        return false;
+      }
+      segments_.rbegin()->second += group.size();
+      durable_ = end;
+      cv_.notify_all();
+    }
+    return true;
+  }
+
+  // @brief sync everything appended so far
+  bool flush() {
+    Lsn lsn;
+    {
+      std::unique_lock<std::mutex> lock{mutex_};
+      lsn = next_lsn_;
+    }
+    return commit(lsn);
+  }
+
+  Lsn durable_lsn() {
+    std::unique_lock<std::mutex> lock{mutex_};
+    return durable_;
+  }
+
+  // @brief bytes in the segments, what a crash would redo
+  size_t bytes() {
+    std::unique_lock<std::mutex> lock{mutex_};
+    return bytes_locked();
+  }
+
+  WalStats stats() {
+    std::unique_lock<std::mutex> lock{mutex_};
+    WalStats stats = stats_;
+    stats.bytes = bytes_locked();
+    return stats;
+  }
+
+private:
+  static constexpr uint32_t kMagic = 0x57414c31; // "WAL1"
+
+  struct Header {
+    uint32_t magic;
+    uint32_t count;
+    uint64_t lsn;
+    uint64_t checksum;
+  };
+  static constexpr size_t kHeaderSize = sizeof(Header);
+
+  // FNV-1a, enough to find a torn tail
+  static uint64_t checksum(const char *data, size_t len, uint32_t count) {
+    uint64_t h = 14695981039346656037ull ^ count;
+    for (size_t i = 0; i < len; ++i) {
+      h = (h ^ static_cast<unsigned char>(data[i])) * 1099511628211ull;
+    }
+    return h;
+  }
+
+  // seq -> bytes of the segment files of the log at path
+  static std::map<uint64_t, size_t> list(const std::string &path) {
+    namespace fs = std::filesystem;
+    fs::path base(path);
+    fs::path dir = base.has_parent_path() ? base.parent_path() : ".";
+    std::string prefix = base.filename().string() + ".";
+    std::map<uint64_t, size_t> segments;
+    for (auto &entry : fs::directory_iterator(dir)) {
+      std::string name = entry.path().filename().string();
+      if (name.rfind(prefix, 0) != 0 || name.size() == prefix.size() ||
+          name.find_first_not_of("0123456789", prefix.size()) !=
+              std::string::npos) {
+        continue;
+      }
+      segments[std::stoull(name.substr(prefix.size()))] = entry.file_size();
+    }
+    return segments;
+  }
+
+  std::string segment_path(uint64_t seq) const {
+    return path_ + "." + std::to_string(seq);
+  }
+
+  void open_segment(uint64_t seq) {
+    int fd = ::open(segment_path(seq).c_str(), O_RDWR | O_CREAT | O_APPEND,
+                    0644);
+    if (fd < 0) {
+      throw std::runtime_error("open wal failed");
+    }
+    if (fd_ >= 0) {
+      ::close(fd_);
+    }
+    fd_ = fd;
+    segments_.emplace(seq, 0);
+  }
+
+  void drop_locked(uint64_t seq) {
+    uint64_t last = segments_.rbegin()->first;
+    for (auto it = segments_.begin();
+         it != segments_.end() && it->first < seq && it->first != last;) {
+      ::unlink(segment_path(it->first).c_str());
+      it = segments_.erase(it);
+    }
+  }
+
+  size_t bytes_locked() const {
+    size_t bytes = buffer_.size();
+    for (auto &[seq, size] : segments_) {
+      bytes += size;
+    }
+    return bytes;
+  }
+
+  size_t replay(const std::string &path,
+                const std::function<void(int64_t, const char *)> &fn,
+                bool &torn) {
+    std::vector<char> log;
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+      return 0;
+    }
+    char buf[1 << 16];
+    ssize_t n;
+    while ((n = pread(fd, buf, sizeof buf, log.size())) > 0) {
+      log.insert(log.end(), buf, buf + n);
+    }
+    ::close(fd);
+
+    size_t records = 0, pos = 0;
+    size_t entry = sizeof(int64_t) + page_size_;
+    while (pos + kHeaderSize <= log.size()) {
+      Header header;
+      std::memcpy(&header, log.data() + pos, sizeof header);
+      size_t len = header.count * entry;
+      if (header.magic != kMagic || pos + kHeaderSize + len > log.size()) {
+        break;
+      }
+      const char *body = log.data() + pos + kHeaderSize;
+      if (checksum(body, len, header.count) != header.checksum) {
+        break;
+      }
+      for (uint32_t i = 0; i < header.count; ++i) {
+        int64_t id;
+        std::memcpy(&id, body + i * entry, sizeof id);
+        fn(id, body + i * entry + sizeof id);
+      }
+      next_lsn_ = std::max(next_lsn_, header.lsn);
+      pos += kHeaderSize + len;
+      ++records;
+    }
+    torn = pos != log.size();
+    return records;
+  }
+
+  bool write_all(const std::vector<char> &data) {
+    size_t done = 0;
+    while (done < data.size()) {
+      ssize_t n = ::write(fd_, data.data() + done, data.size() - done);
+      if (n < 0 && errno == EINTR) {
+        continue;
+      }
+      if (n <= 0) {
+        return false;
+      }
+      done += n;
+    }
+    return true;
+  }
+
+  std::string path_;
+  int fd_ = -1;
+  size_t page_size_;
+  // seq -> bytes of every segment, the last one is appended to
+  std::map<uint64_t, size_t> segments_;
+
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  std::vector<char> buffer_;
+  Lsn next_lsn_ = 0;
+  Lsn durable_ = 0;
+  bool syncing_ = false;
+  WalStats stats_;
+};